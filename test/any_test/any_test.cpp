@@ -13,6 +13,8 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <functional>
 
 // 若使用 gcc 或相似者则须通过 c++filt -t 过滤。
 // ./any_test | c++filt -t
@@ -79,9 +81,51 @@ void TestAny()
     }
 }
 
+// 小对象存放在内部缓冲区，大对象存放在堆上，复制和移动都要保持值不变
+struct BigValue
+{
+    char data[64];
+    int  n;
+};
+
+void TestAnyStorage()
+{
+    util::Any n1 = 100;
+    util::Any n2 = n1;          // 复制小对象，不分配内存
+    util::Any n3 = std::move(n1);
+    std::cout << "n2 = " << n2.AnyCast<int>() << ", n3 = " << n3.AnyCast<int>()
+              << ", n1.IsNull() = " << (n1.IsNull() ? "true" : "false") << std::endl;
+
+    std::function<int(int)> func = [](int i) { return i * 2; };
+    util::Any f1 = func;        // std::function也存放在内部缓冲区
+    util::Any f2 = f1;
+    std::cout << "f2(21) = " << f2.AnyCast<std::function<int(int)>>()(21) << std::endl;
+
+    BigValue big;
+    big.n = 64;
+    util::Any b1 = big;         // 大对象存放在堆上
+    util::Any b2 = b1;
+    b1 = std::string("big replaced by string");
+    std::cout << "b1 = " << b1.AnyCast<std::string>()
+              << ", b2.n = " << b2.AnyCast<BigValue>().n << std::endl;
+
+    // 放入vector中，扩容时移动元素
+    std::vector<util::Any> vec;
+    for (int i = 0; i < 100; i++) {
+        vec.push_back(i % 2 == 0 ? util::Any(i) : util::Any(std::to_string(i)));
+    }
+    std::cout << "vec[98] = " << vec[98].AnyCast<int>()
+              << ", vec[99] = " << vec[99].AnyCast<std::string>() << std::endl;
+
+    const util::Any c = 3.14;
+    std::cout << "c.Type().name() = " << c.Type().name()
+              << ", c = " << c.AnyCast<double>() << std::endl;
+}
+
 //////////////////////////////////////////////////////////////
 int main(int argc, char const *argv[])
 {
     TestAny();
+    TestAnyStorage();
     return 0;
 }
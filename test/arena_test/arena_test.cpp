@@ -0,0 +1,189 @@
+/**
+ * desc: 内存池Arena、FixedPool测试
+ * file: arena_test.cpp
+ *
+ * author:  myw31415926
+ * date:    20190412
+ * version: V0.1
+ *
+ * the closer you look, the less you see
+ */
+
+#include "arena.h"
+#include "util.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdlib>
+#include <cassert>
+
+struct Point
+{
+    Point(int x, int y) : x_(x), y_(y) {}
+    int x_;
+    int y_;
+};
+
+void ArenaTest()
+{
+    char buffer[256];
+    util::Arena arena(buffer, sizeof(buffer), 1024);
+
+    Point* p = arena.Create<Point>(1, 2);
+    std::cout << "point: " << p->x_ << ", " << p->y_ << std::endl;
+    std::cout << "point in buffer: " << std::boolalpha
+              << (reinterpret_cast<char*>(p) > buffer &&
+                  reinterpret_cast<char*>(p) < buffer + sizeof(buffer)) << std::endl;
+
+    double* d = static_cast<double*>(arena.Allocate(sizeof(double), alignof(double)));
+    assert(reinterpret_cast<uintptr_t>(d) % alignof(double) == 0);
+    *d = 3.14;
+
+    const char* str = "hello arena";
+    char* s = arena.Strdup(str, strlen(str));
+    std::cout << "strdup: " << s << std::endl;
+
+    // 超过外部缓冲区，申请新的内存块
+    int* arr = arena.CreateArray<int>(100);
+    arr[99] = 99;
+    std::cout << "used: " << arena.Used() << ", capacity: " << arena.Capacity() << std::endl;
+
+    // Reset后内存块保留，重新从外部缓冲区开始分配
+    size_t capacity = arena.Capacity();
+    arena.Reset();
+    Point* q = arena.Create<Point>(3, 4);
+    std::cout << "after reset, used: " << arena.Used() << ", capacity: " << arena.Capacity()
+              << ", reuse: " << (q == p && arena.Capacity() == capacity) << std::endl;
+
+    // rapidjson Allocator接口，最后一次分配的内存原地扩展
+    void* m = arena.Malloc(16);
+    void* r = arena.Realloc(m, 16, 32);
+    std::cout << "realloc in place: " << (m == r) << std::endl;
+
+    arena.Release();
+    std::cout << "after release, capacity: " << arena.Capacity() << std::endl;
+}
+
+void FixedPoolTest()
+{
+    util::FixedPool pool(sizeof(Point), 4);
+    std::cout << "block size: " << pool.BlockSize() << std::endl;
+
+    std::vector<void*> blocks;
+    for (int i = 0; i < 10; i++) {
+        blocks.push_back(pool.Allocate());
+    }
+
+    void* last = blocks.back();
+    pool.Deallocate(last);
+    std::cout << "reuse freed block: " << std::boolalpha << (pool.Allocate() == last) << std::endl;
+
+    for (auto block : blocks) {
+        pool.Deallocate(block);
+    }
+}
+
+void ArenaAllocatorTest()
+{
+    util::Arena arena;
+    {
+        util::ArenaVector<int> vec{util::ArenaAllocator<int>(&arena)};
+        for (int i = 0; i < 10; i++) {
+            vec.push_back(i);
+        }
+        std::cout << "vector size: " << vec.size() << ", back: " << vec.back() << std::endl;
+
+        util::ArenaString str("arena string, long enough to skip SSO",
+                              util::ArenaAllocator<char>(&arena));
+        std::cout << "string: " << str << std::endl;
+
+        using Alloc = util::ArenaAllocator<std::pair<const int, int>>;
+        std::map<int, int, std::less<int>, Alloc> m{std::less<int>(), Alloc(&arena)};
+        for (int i = 0; i < 10; i++) {
+            m[i] = i * i;
+        }
+        std::cout << "map size: " << m.size() << ", m[9]: " << m[9] << std::endl;
+    }
+    std::cout << "used: " << arena.Used() << std::endl;
+    arena.Reset();
+}
+
+//////////////////////////////////////////////////////////////
+// 性能对比：模拟每个请求分配一批小对象，请求结束后全部释放
+void ArenaBenchmark(int requests, int objects)
+{
+    std::vector<void*> ptrs(objects);
+
+    util::TimeSpan ts;
+    for (int r = 0; r < requests; r++) {
+        for (int i = 0; i < objects; i++) {
+            ptrs[i] = malloc(16 + i % 64);
+        }
+        for (int i = 0; i < objects; i++) {
+            free(ptrs[i]);
+        }
+    }
+    std::cout << "malloc/free:     " << ts.Span() << " ms" << std::endl;
+
+    util::Arena arena;
+    ts.Reset();
+    for (int r = 0; r < requests; r++) {
+        for (int i = 0; i < objects; i++) {
+            ptrs[i] = arena.Allocate(16 + i % 64);
+        }
+        arena.Reset();
+    }
+    std::cout << "arena/reset:     " << ts.Span() << " ms" << std::endl;
+
+    util::FixedPool pool(64);
+    ts.Reset();
+    for (int r = 0; r < requests; r++) {
+        for (int i = 0; i < objects; i++) {
+            ptrs[i] = pool.Allocate();
+        }
+        for (int i = 0; i < objects; i++) {
+            pool.Deallocate(ptrs[i]);
+        }
+    }
+    std::cout << "fixed pool:      " << ts.Span() << " ms" << std::endl;
+
+    ts.Reset();
+    for (int r = 0; r < requests; r++) {
+        std::vector<std::string> vec;
+        for (int i = 0; i < objects; i++) {
+            vec.emplace_back("a string longer than the small buffer");
+        }
+    }
+    std::cout << "std::vector:     " << ts.Span() << " ms" << std::endl;
+
+    ts.Reset();
+    for (int r = 0; r < requests; r++) {
+        util::ArenaVector<util::ArenaString> vec{util::ArenaAllocator<util::ArenaString>(&arena)};
+        for (int i = 0; i < objects; i++) {
+            vec.emplace_back("a string longer than the small buffer",
+                             util::ArenaAllocator<char>(&arena));
+        }
+        arena.Reset();
+    }
+    std::cout << "util::ArenaVector: " << ts.Span() << " ms" << std::endl;
+}
+
+//////////////////////////////////////////////////////////////
+int main(int argc, char const *argv[])
+{
+    std::cout << "*** ArenaTest ***" << std::endl;
+    ArenaTest();
+
+    std::cout << "*** FixedPoolTest ***" << std::endl;
+    FixedPoolTest();
+
+    std::cout << "*** ArenaAllocatorTest ***" << std::endl;
+    ArenaAllocatorTest();
+
+    std::cout << "*** ArenaBenchmark ***" << std::endl;
+    ArenaBenchmark(10000, 1000);
+
+    return 0;
+}
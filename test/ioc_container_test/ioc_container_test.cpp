@@ -10,8 +10,13 @@
  */
 
 #include "ioc_container.h"
+#include "util.h"
 
 #include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
 
 ///////////////////////////////////////////////////////////////////////
 struct Bus
@@ -129,11 +134,207 @@ void IocContainerTest()
     pad->Func();
 }
 
+//////////////////////////////////////////////////////////////
+// 冻结后的查找，以及冻结前后Resolve的耗时
+void IocContainerFreezeTest(int count)
+{
+    util::IocContainer ioc;
+    for (int i = 0; i < 50; i++) {
+        ioc.RegisterSimple<Bus>("service" + std::to_string(i));
+    }
+
+    ioc.Register<Base, DerivedC, int>("C");
+
+    auto bench = [&ioc, count](const std::string& name) {
+        std::string key = "service42";    // 耗时包含Bus的new/delete
+        util::TimeSpan ts;
+        for (int i = 0; i < count; i++) {
+            delete ioc.Resolve<Bus>(key);
+        }
+        std::cout << name << ": " << ts.SpanNano() / count << " ns per resolve" << std::endl;
+    };
+    bench("unordered_map");
+
+    ioc.Freeze();
+    std::cout << "frozen: " << std::boolalpha << ioc.Frozen() << std::endl;
+    bench("frozen table ");
+
+    auto pbc = ioc.ResolveShared<Base>("C", 300);
+    pbc->Func();
+    std::cout << "unknown key: " << (ioc.Resolve<Bus>("unknown") == nullptr) << std::endl;
+
+    try {
+        ioc.RegisterSimple<Bus>("late");
+    } catch (const std::logic_error& e) {
+        std::cout << "register after freeze: " << e.what() << std::endl;
+    }
+}
+
+//////////////////////////////////////////////////////////////
+// 生命周期：Singleton、PerThread、PerScope
+struct DBHandle
+{
+    DBHandle(const std::string& name) : name_(name) { count_++; }
+    ~DBHandle() { std::cout << "~DBHandle: " << name_ << std::endl; }
+
+    std::string name_;
+    static std::atomic<int> count_;
+};
+
+std::atomic<int> DBHandle::count_{0};
+
+void IocContainerLifetimeTest()
+{
+    util::IocContainer ioc;
+    ioc.RegisterSimple<DBHandle, std::string>("singleton", util::Lifetime::Singleton);
+    ioc.RegisterSimple<DBHandle, std::string>("thread", util::Lifetime::PerThread);
+    ioc.RegisterSimple<DBHandle, std::string>("scope", util::Lifetime::PerScope);
+    ioc.Freeze();
+
+    // 多线程并发Resolve，Singleton只创建一次，PerThread每个线程一次
+    std::string name = "db";
+    std::vector<std::thread> threads;
+    std::vector<DBHandle*> singletons(8);
+    for (int i = 0; i < 8; i++) {
+        threads.emplace_back([&ioc, &singletons, &name, i] {
+            singletons[i] = ioc.Resolve<DBHandle>("singleton", name);
+            DBHandle* t1 = ioc.Resolve<DBHandle>("thread", name);
+            DBHandle* t2 = ioc.Resolve<DBHandle>("thread", name);
+            if (t1 != t2) {
+                std::cerr << "PerThread object is not cached" << std::endl;
+            }
+        });
+    }
+    for (auto& thd : threads) {
+        thd.join();
+    }
+
+    bool same = true;
+    for (auto p : singletons) {
+        same = same && (p == singletons[0]);
+    }
+    std::cout << "singleton same: " << std::boolalpha << same
+              << ", construct count: " << DBHandle::count_ << std::endl;
+
+    auto s1 = ioc.ResolveShared<DBHandle>("singleton", name);
+    std::cout << "shared singleton same: " << (s1.get() == singletons[0]) << std::endl;
+
+    // 每个Scope一个对象，Scope析构时释放
+    {
+        name = "scope1";
+        util::IocContainer::Scope scope(ioc);
+        DBHandle* p1 = scope.Resolve<DBHandle>("scope", name);
+        DBHandle* p2 = scope.Resolve<DBHandle>("scope", name);
+        std::cout << "scope cached: " << (p1 == p2) << std::endl;
+        std::cout << "scope singleton same: "
+                  << (scope.Resolve<DBHandle>("singleton", name) == singletons[0]) << std::endl;
+    }
+    std::cout << "scope released" << std::endl;
+
+    try {
+        ioc.Resolve<DBHandle>("scope", name);
+    } catch (const std::logic_error& e) {
+        std::cout << "resolve without scope: " << e.what() << std::endl;
+    }
+}
+
+//////////////////////////////////////////////////////////////
+// 编译期依赖注入，多层依赖自动装配
+struct Engine
+{
+    virtual ~Engine() {}
+    virtual int Power() const = 0;
+};
+
+struct V8Engine : public Engine
+{
+    int Power() const override { return 8; }
+};
+
+struct Wheel
+{
+    int Size() const { return 18; }
+};
+
+struct Chassis
+{
+    using Inject = util::Inject<Wheel>;
+
+    Chassis(std::shared_ptr<Wheel> wheel) : wheel_(wheel) {}
+    std::shared_ptr<Wheel> wheel_;
+};
+
+struct Truck
+{
+    using Inject = util::Inject<Engine, Chassis>;
+
+    Truck(std::shared_ptr<Engine> engine, std::shared_ptr<Chassis> chassis, const std::string& name)
+        : engine_(engine), chassis_(chassis), name_(name) {}
+
+    void Test() const
+    {
+        std::cout << "Truck " << name_ << ": engine power = " << engine_->Power()
+                  << ", wheel size = " << chassis_->wheel_->Size() << std::endl;
+    }
+
+    std::shared_ptr<Engine>  engine_;
+    std::shared_ptr<Chassis> chassis_;
+    std::string name_;
+};
+
+// 显式给出依赖，不使用Impl::Inject
+struct Garage
+{
+    Garage(std::shared_ptr<Engine> engine, std::shared_ptr<Chassis> chassis)
+        : engine_(engine), chassis_(chassis) {}
+
+    std::shared_ptr<Engine>  engine_;
+    std::shared_ptr<Chassis> chassis_;
+};
+
+void StaticIocContainerTest(int count)
+{
+    using Container = util::StaticIocContainer<
+        util::Bind<Engine, V8Engine>,
+        util::Bind<Garage, Garage, Engine, Chassis>>;
+
+    std::string name = "T1";
+    auto truck = Container::Resolve<Truck>(name);
+    truck->Test();
+
+    auto garage = Container::Resolve<Garage>();
+    std::cout << "garage: engine power = " << garage->engine_->Power()
+              << ", wheel size = " << garage->chassis_->wheel_->Size() << std::endl;
+
+    // 与手写构造代码对比
+    util::TimeSpan ts;
+    for (int i = 0; i < count; i++) {
+        auto p = std::make_shared<Truck>(std::make_shared<V8Engine>(),
+            std::make_shared<Chassis>(std::make_shared<Wheel>()), name);
+    }
+    std::cout << "hand-written: " << ts.SpanNano() / count << " ns per resolve" << std::endl;
+
+    ts.Reset();
+    for (int i = 0; i < count; i++) {
+        auto p = Container::Resolve<Truck>(name);
+    }
+    std::cout << "static ioc  : " << ts.SpanNano() / count << " ns per resolve" << std::endl;
+}
+
 //////////////////////////////////////////////////////////////
 int main(int argc, char const *argv[])
 {
     std::cout << "*** IocContainerTest ***" << std::endl;
     IocContainerTest();
 
+    std::cout << "*** IocContainerFreezeTest ***" << std::endl;
+    IocContainerFreezeTest(1000000);
+
+    std::cout << "*** IocContainerLifetimeTest ***" << std::endl;
+    IocContainerLifetimeTest();
+
+    std::cout << "*** StaticIocContainerTest ***" << std::endl;
+    StaticIocContainerTest(1000000);
+
     return 0;
 }
@@ -12,6 +12,10 @@
 #include "msg_bus.h"
 
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <memory>
 
 //////////////////////////////////////////////////////////////
 // function_traits 测试
@@ -30,12 +34,12 @@ void MsgBusTest()
 {
     util::MsgBus bus;
 
-    // 注册消息
-    bus.Register([](int i) {std::cout << "no reference, i = " << i << std::endl; });
-    bus.Register([](int& i) {std::cout << "lvalue reference, i = " << i << std::endl; });
-    bus.Register([](int&& i) {std::cout << "rvalue reference, i = " << i << std::endl; });
-    bus.Register([](const int& i) {std::cout << "const lvalue reference, i = " << i << std::endl; });
-    bus.Register([](int i) {
+    // 注册消息，需要保存订阅句柄，句柄析构时消息被移除
+    auto s1 = bus.Register([](int i) {std::cout << "no reference, i = " << i << std::endl; });
+    auto s2 = bus.Register([](int& i) {std::cout << "lvalue reference, i = " << i << std::endl; });
+    auto s3 = bus.Register([](int&& i) {std::cout << "rvalue reference, i = " << i << std::endl; });
+    auto s4 = bus.Register([](const int& i) {std::cout << "const lvalue reference, i = " << i << std::endl; });
+    auto s5 = bus.Register([](int i) {
         std::cout << "const lvalue reference with topic, i = " << i << std::endl;
         return i;
     }, "i");    // 带topic
@@ -63,6 +67,135 @@ void MsgBusTest()
     bus.Send<void, const int&>(400);
     bus.Send<void, int&&>(500);
     bus.Send<int, int>(300, "i");
+    std::cout << "s1.Active()=" << (s1.Active() ? "true" : "false") << std::endl;
+}
+
+//////////////////////////////////////////////////////////////
+// 订阅句柄测试，只移除单个订阅者
+void SubscriptionTest()
+{
+    util::MsgBus bus;
+
+    auto s1 = bus.Register([](int i) { std::cout << "subscriber1, i = " << i << std::endl; });
+    auto s2 = bus.Register([](int i) { std::cout << "subscriber2, i = " << i << std::endl; });
+    {
+        // 出了作用域后自动移除
+        auto s3 = bus.Register([](int i) { std::cout << "subscriber3, i = " << i << std::endl; });
+        bus.Send<void, int>(1);
+    }
+
+    std::cout << "unsubscribe subscriber1" << std::endl;
+    s1.Unsubscribe();
+    bus.Send<void, int>(2);
+
+    // 在消息处理函数中移除自己
+    util::MsgBus::Subscription self;
+    self = bus.Register([&self](int i) {
+        std::cout << "subscriber self, i = " << i << ", unsubscribe self" << std::endl;
+        self.Unsubscribe();
+    });
+    bus.Send<void, int>(3);
+    bus.Send<void, int>(4);
+}
+
+// 多线程发送消息的同时注册和移除
+void ConcurrentSubscriptionTest()
+{
+    util::MsgBus bus;
+    std::atomic<int> count(0);
+    std::atomic<bool> running(true);
+
+    auto sub = bus.Register([&count](int i) { count += i; });
+
+    std::thread sender([&bus, &running] {
+        while (running) {
+            bus.Send<void, int>(1);
+        }
+    });
+
+    std::vector<std::thread> subscribers;
+    for (int t = 0; t < 4; t++) {
+        subscribers.emplace_back([&bus, &count] {
+            for (int i = 0; i < 10000; i++) {
+                auto s = bus.Register([&count](int n) { count += n; });
+            }
+        });
+    }
+
+    for (auto& thd : subscribers) {
+        thd.join();
+    }
+    running = false;
+    sender.join();
+
+    std::cout << "concurrent subscription test done, count > 0: "
+              << (count > 0 ? "true" : "false") << std::endl;
+}
+
+// 订阅者捕获this，在其他线程发送消息的同时析构，析构返回后处理函数不能再访问对象
+class Listener
+{
+public:
+    explicit Listener(util::MsgBus& bus)
+    {
+        for (auto& v : values_) {
+            v.store(0);
+        }
+        sub_ = bus.Register([this](int i) { OnValue(i); }, "listener");
+    }
+
+    void OnValue(int i)
+    {
+        for (auto& v : values_) {
+            v += i;
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    std::atomic<int>           values_[16];
+    util::MsgBus::Subscription sub_;   // 最后声明，最先析构
+};
+
+void DestroyWhileSendingTest()
+{
+    util::MsgBus bus;
+    std::atomic<bool> running(true);
+
+    std::vector<std::thread> senders;
+    for (int t = 0; t < 2; t++) {
+        senders.emplace_back([&bus, &running] {
+            while (running) {
+                bus.Send<void, int>(1, "listener");
+            }
+        });
+    }
+
+    for (int i = 0; i < 2000; i++) {
+        std::unique_ptr<Listener> listener(new Listener(bus));
+        std::this_thread::yield();
+    }
+    running = false;
+    for (auto& thd : senders) {
+        thd.join();
+    }
+    std::cout << "destroy while sending test done" << std::endl;
+}
+
+// 消息处理函数在锁外调用：处理函数中等待另一个线程发送消息，不会死锁
+void SendFromHandlerTest()
+{
+    util::MsgBus bus;
+    std::atomic<int> received(0);
+
+    auto inner = bus.Register([&received](int i) { received += i; }, "inner");
+    auto outer = bus.Register([&bus](int i) {
+        std::thread thd([&bus, i] { bus.Send<void, int>(i + 1, "inner"); });
+        thd.join();
+    }, "outer");
+
+    bus.Send<void, int>(1, "outer");
+    std::cout << "send from handler thread, received = " << received << std::endl;
 }
 
 //////////////////////////////////////////////////////////////
@@ -77,7 +210,7 @@ class Subject
 public:
     Subject()
     {
-        g_bus.Register([this] { DriveOK(); }, g_topic_ok);
+        sub_ = g_bus.Register([this] { DriveOK(); }, g_topic_ok);
     }
 
     void SendReq(const std::string& topic)
@@ -89,6 +222,9 @@ public:
     {
         std::cout << "Subject drive ok" << std::endl;
     }
+
+private:
+    util::MsgBus::Subscription sub_;
 };
 
 // 接收消息对象
@@ -97,7 +233,7 @@ class Car
 public:
     Car()
     {
-        g_bus.Register([this](int speed) { Drive(speed); }, g_topic);
+        sub_ = g_bus.Register([this](int speed) { Drive(speed); }, g_topic);
     }
 
     void Drive(const int speed)
@@ -105,6 +241,8 @@ public:
         std::cout << "Car drive is " << speed << std::endl;
         g_bus.Send<void>(g_topic_ok);
     }
+private:
+    util::MsgBus::Subscription sub_;   // 对象析构时移除消息，避免悬空的this
 };
 
 class Bus
@@ -112,7 +250,7 @@ class Bus
 public:
     Bus()
     {
-        g_bus.Register([this](int speed) { Drive(speed); }, g_topic);
+        sub_ = g_bus.Register([this](int speed) { Drive(speed); }, g_topic);
     }
 
     void Drive(const int speed)
@@ -120,6 +258,8 @@ public:
         std::cout << "Bus drive is " << speed << std::endl;
         g_bus.Send<void>(g_topic_ok);
     }
+private:
+    util::MsgBus::Subscription sub_;   // 对象析构时移除消息，避免悬空的this
 };
 
 class Truck
@@ -127,7 +267,7 @@ class Truck
 public:
     Truck()
     {
-        g_bus.Register([this](int speed) { Drive(speed); });
+        sub_ = g_bus.Register([this](int speed) { Drive(speed); });
     }
 
     void Drive(const int speed)
@@ -135,17 +275,23 @@ public:
         std::cout << "Truck drive is " << speed << std::endl;
         g_bus.Send<void>(g_topic_ok);
     }
+private:
+    util::MsgBus::Subscription sub_;   // 对象析构时移除消息，避免悬空的this
 };
 
 void SubjectMsgBusTest()
 {
     Subject sub;
-    Car cat;
     Bus bus;
     Truck truck;
+    {
+        Car car;
+        sub.SendReq(g_topic);
+        sub.SendReq("");
+    }
 
+    std::cout << "car destroyed" << std::endl;
     sub.SendReq(g_topic);
-    sub.SendReq("");
 
     std::cout << "msgbus remove<void, int>()" << std::endl; 
 
@@ -166,5 +312,17 @@ int main(int argc, char const *argv[])
     std::cout << "\n*** SubjectMsgBusTest ***" << std::endl;
     SubjectMsgBusTest();
 
+    std::cout << "\n*** SubscriptionTest ***" << std::endl;
+    SubscriptionTest();
+
+    std::cout << "\n*** ConcurrentSubscriptionTest ***" << std::endl;
+    ConcurrentSubscriptionTest();
+
+    std::cout << "\n*** SendFromHandlerTest ***" << std::endl;
+    SendFromHandlerTest();
+
+    std::cout << "\n*** DestroyWhileSendingTest ***" << std::endl;
+    DestroyWhileSendingTest();
+
     return 0;
 }
@@ -10,7 +10,12 @@
  */
 
 #include "object_pool.h"
+#include "util.h"
+
 #include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
 
 struct BigObject
 {
@@ -22,6 +27,14 @@ struct BigObject
 
     ~BigObject() { std::cout << "~BigObject : name = " << name_ << std::endl; }
 
+    void Clear()
+    {
+        n1_ = n2_ = 0;
+        name_.clear();
+    }
+
+    int N1() const { return n1_; }
+
     void Print(const std::string& str)
     {
         if (name_.empty()) name_ = str;
@@ -34,7 +47,8 @@ private:
     std::string name_;
 };
 
-void Print(std::shared_ptr<BigObject> obj, const std::string& str)
+template<typename Ptr>
+void Print(const Ptr& obj, const std::string& str)
 {
     if (obj != nullptr) {
         obj->Print(str);
@@ -45,7 +59,7 @@ void Print(std::shared_ptr<BigObject> obj, const std::string& str)
 
 void ObjectPoolTest()
 {
-    util::ObjectPool<BigObject> pool;
+    util::ObjectPool<BigObject> pool(0, 2);    // 每种构造签名最多2个对象
     pool.Init(2);   // 初始化对象池，创建2个对象
     {
         // 出了作用域后，对象池返回的对象会自动回收
@@ -73,11 +87,169 @@ void ObjectPoolTest()
     Print(p5, "p5");
 }
 
+//////////////////////////////////////////////////////////////
+// 弹性对象池：按需新建、达到上限后等待、空闲后收缩
+void PrintStats(util::ObjectPool<BigObject>& pool)
+{
+    auto stats = pool.Stats();
+    std::cout << "stats: size[" << stats.size << "], hits[" << stats.hits
+              << "], misses[" << stats.misses << "], waits[" << stats.waits
+              << "], timeouts[" << stats.timeouts << "], failures[" << stats.failures
+              << "]" << std::endl;
+}
+
+void ObjectPoolElasticTest()
+{
+    // 最少1个，最多3个对象，空闲50毫秒后可以收缩
+    util::ObjectPool<BigObject> pool(1, 3, std::chrono::milliseconds(50));
+    pool.Init(0, 1, 2);     // 只记录构造参数，创建最少的1个对象
+
+    auto p1 = pool.Get<int, int>();
+    auto p2 = pool.Get<int, int>();     // 池为空，新建对象
+    auto p3 = pool.Get<int, int>();
+    auto p4 = pool.Get<int, int>();     // 达到上限，nullptr
+    Print(p4, "p4");
+    PrintStats(pool);
+
+    // 等待其他线程归还
+    std::thread thd([&p1] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        p1.Reset();
+    });
+    auto p5 = pool.AcquireFor<int, int>(std::chrono::milliseconds(1000));
+    Print(p5, "p5");
+    thd.join();
+
+    auto p6 = pool.AcquireFor<int, int>(std::chrono::milliseconds(10));    // 超时，nullptr
+    Print(p6, "p6");
+    PrintStats(pool);
+
+    p2.Reset();
+    p3.Reset();
+    p5.Reset();
+    std::cout << "shrink before idle timeout: " << pool.Shrink() << std::endl;
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    std::cout << "shrink after idle timeout: " << pool.Shrink() << std::endl;
+    PrintStats(pool);
+}
+
+//////////////////////////////////////////////////////////////
+// 归还时的重置和检查钩子，调试模式
+void ObjectPoolHooksTest()
+{
+    util::ObjectPool<BigObject> pool(0, 2);
+    pool.SetReset([](BigObject& obj) { obj.Clear(); });                 // 归还时清空对象
+    pool.SetValidate([](const BigObject& obj) { return obj.N1() >= 0; });   // 不合法的对象直接销毁
+    pool.Init(1, 1, 2);
+
+    {
+        auto p1 = pool.Get<int, int>();
+        Print(p1, "hooks p1");
+    }
+    auto p2 = pool.Get<int, int>();     // 已被重置
+    Print(p2, "hooks p2");
+
+    // 转换为shared_ptr共享
+    std::shared_ptr<BigObject> sp = p2.Share();
+    std::cout << "p2 after share is null: " << (p2 == nullptr ? "true" : "false") << std::endl;
+    sp.reset();
+
+    // 调试模式：归还后句柄过期，重复归还会被发现
+    util::ObjectPool<BigObject> debug_pool;
+    debug_pool.SetDebug(true);
+    debug_pool.Init(1, 3, 4);
+    auto p3 = debug_pool.Get<int, int>();
+    Print(p3, "debug p3");
+    std::shared_ptr<BigObject> sp3 = p3.Share();
+    sp3.reset();    // 归还后对象被销毁并填充0xDD
+    std::cout << "debug stats size: " << debug_pool.Stats().size << std::endl;
+}
+
+//////////////////////////////////////////////////////////////
+// 多线程并发获取和回收对象
+void ObjectPoolConcurrentTest(int thread_num, int count)
+{
+    util::ObjectPool<BigObject> pool;
+    for (int i = 0; i < thread_num; i++) {
+        pool.Init(1, i, i);
+    }
+
+    util::TimeSpan ts;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_num; i++) {
+        threads.emplace_back([&pool, count] {
+            for (int n = 0; n < count; n++) {
+                auto p = pool.Get<int&, int&>();
+                if (p == nullptr) {
+                    std::cerr << "object pool get nullptr" << std::endl;
+                    return;
+                }
+            }
+        });
+    }
+
+    for (auto& thd : threads) {
+        thd.join();
+    }
+
+    auto span = ts.SpanNano();
+    std::cout << thread_num << " threads, " << count << " get/put per thread, "
+              << span / (int64_t(thread_num) * count) << " ns per get/put" << std::endl;
+}
+
+//////////////////////////////////////////////////////////////
+// 构造签名按对象类型编号，超过kMaxSignatures种对象类型的对象池互不影响
+template<int N>
+struct Tagged
+{
+    explicit Tagged(int v) : value(v) {}
+    int value;
+};
+
+template<int N>
+struct ManyPools
+{
+    static int Run()
+    {
+        util::ObjectPool<Tagged<N>> pool;
+        auto none = pool.template Get<double>();    // 未初始化的签名，不占用序号
+        pool.Init(1, N);
+        auto p = pool.template Get<int>();
+        bool ok = none == nullptr && p != nullptr && p->value == N;
+        return (ok ? 1 : 0) + ManyPools<N - 1>::Run();
+    }
+};
+
+template<>
+struct ManyPools<0>
+{
+    static int Run() { return 0; }
+};
+
+void ObjectPoolManyTypesTest()
+{
+    int ok = ManyPools<24>::Run();
+    std::cout << "24 pooled types, ok = " << ok << std::endl;
+    assert(ok == 24);
+}
+
 //////////////////////////////////////////////////////////////
 int main(int argc, char const *argv[])
 {
     std::cout << "*** ObjectPoolTest ***" << std::endl;
     ObjectPoolTest();
 
+    std::cout << "*** ObjectPoolElasticTest ***" << std::endl;
+    ObjectPoolElasticTest();
+
+    std::cout << "*** ObjectPoolHooksTest ***" << std::endl;
+    ObjectPoolHooksTest();
+
+    std::cout << "*** ObjectPoolManyTypesTest ***" << std::endl;
+    ObjectPoolManyTypesTest();
+
+    std::cout << "*** ObjectPoolConcurrentTest ***" << std::endl;
+    ObjectPoolConcurrentTest(32, 100000);
+
     return 0;
 }
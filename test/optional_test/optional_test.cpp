@@ -101,10 +101,32 @@ void LazyTest()
     t.Load();
 }
 
+//////////////////////////////////////////////////////////////
+// 内存布局回归测试：数据在前，1字节标志在后，没有虚函数表指针
+static_assert(sizeof(util::Optional<char>) == 2, "Optional<char> layout grows");
+static_assert(sizeof(util::Optional<int>) == 8, "Optional<int> layout grows");
+static_assert(sizeof(util::Optional<double>) == 2 * sizeof(double), "Optional<double> layout grows");
+static_assert(sizeof(util::Optional<std::string>) == sizeof(std::string) + alignof(std::string),
+    "Optional<std::string> layout grows");
+static_assert(alignof(util::Optional<double>) == alignof(double), "Optional<double> align changes");
+static_assert(std::is_standard_layout<util::Optional<int>>::value, "Optional must be standard layout");
+static_assert(std::is_trivially_destructible<util::Optional<int>>::value,
+    "Optional<int> must be trivially destructible");
+static_assert(!std::is_polymorphic<util::Optional<std::string>>::value, "Optional must not have vptr");
+
+void OptionalLayoutTest()
+{
+    std::cout << "sizeof(Optional<int>) = " << sizeof(util::Optional<int>)
+              << ", sizeof(Optional<double>) = " << sizeof(util::Optional<double>)
+              << ", sizeof(Optional<std::string>) = " << sizeof(util::Optional<std::string>)
+              << std::endl;
+}
+
 //////////////////////////////////////////////////////////////
 int main(int argc, char const *argv[])
 {
     OptionalTest();
+    OptionalLayoutTest();
 
     std::cout << "****************************" << std::endl;
     LazyTest();
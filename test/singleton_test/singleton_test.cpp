@@ -13,6 +13,9 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
 
 struct S1
 {
@@ -58,11 +61,52 @@ void SingletonTest()
     util::Singleton<S3>::Destroy();
 }
 
+//////////////////////////////////////////////////////////////
+// 多线程同时初始化，只构造一次
+struct S4
+{
+    S4() { count_++; }
+    static std::atomic<int> count_;
+};
+
+std::atomic<int> S4::count_{0};
+
+void SingletonConcurrentTest(int thread_num)
+{
+    std::vector<std::thread> threads;
+    std::atomic<bool> start{false};
+    std::vector<S4*> instances(thread_num);
+    for (int i = 0; i < thread_num; i++) {
+        threads.emplace_back([&start, &instances, i] {
+            while (!start) {
+                std::this_thread::yield();
+            }
+            instances[i] = util::Singleton<S4>::Instance();
+        });
+    }
+
+    start = true;
+    for (auto& thd : threads) {
+        thd.join();
+    }
+
+    bool same = true;
+    for (auto p : instances) {
+        same = same && (p == instances[0]);
+    }
+    std::cout << "construct count: " << S4::count_ << ", same instance: " << std::boolalpha
+              << same << std::endl;
+    util::Singleton<S4>::Destroy();
+}
+
 //////////////////////////////////////////////////////////////
 int main(int argc, char const *argv[])
 {
     std::cout << "*** SingletonTest ***" << std::endl;
     SingletonTest();
 
+    std::cout << "*** SingletonConcurrentTest ***" << std::endl;
+    SingletonConcurrentTest(16);
+
     return 0;
 }
@@ -0,0 +1,161 @@
+/**
+ * desc: 小对象分配器SmallAlloc测试
+ * file: small_alloc_test.cpp
+ *
+ * author:  myw31415926
+ * date:    20190415
+ * version: V0.1
+ *
+ * the closer you look, the less you see
+ */
+
+#include "small_alloc.h"
+#include "util.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <utility>
+#include <cstdlib>
+#include <cstring>
+
+void SmallAllocTest()
+{
+    void* p1 = util::SmallAlloc::Allocate(24);
+    void* p2 = util::SmallAlloc::Allocate(24);
+    std::cout << "aligned: " << std::boolalpha
+              << (reinterpret_cast<uintptr_t>(p1) % util::SmallAlloc::kGranularity == 0) << std::endl;
+
+    util::SmallAlloc::Deallocate(p2, 24);
+    void* p3 = util::SmallAlloc::Allocate(32);  // 与24字节同一级别，复用刚释放的块
+    std::cout << "reuse freed block: " << (p3 == p2) << std::endl;
+    util::SmallAlloc::Deallocate(p1, 24);
+    util::SmallAlloc::Deallocate(p3, 32);
+
+    // 大对象直接使用operator new
+    void* big = util::SmallAlloc::Allocate(1024);
+    memset(big, 0, 1024);
+    util::SmallAlloc::Deallocate(big, 1024);
+
+    // 其他线程释放，内存回到本线程的远程释放链表，之后可以再次分配
+    void* p4 = util::SmallAlloc::Allocate(64);
+    std::thread thd([p4] { util::SmallAlloc::Deallocate(p4, 64); });
+    thd.join();
+    void* p5 = util::SmallAlloc::Allocate(64);
+    std::cout << "remote freed block: " << (p5 == p4) << std::endl;
+    util::SmallAlloc::Deallocate(p5, 64);
+}
+
+void SmallAllocatorTest()
+{
+    std::list<std::string, util::SmallAllocator<std::string>> lst;
+    for (int i = 0; i < 10; i++) {
+        lst.push_back(std::to_string(i));
+    }
+    std::cout << "list size: " << lst.size() << ", back: " << lst.back() << std::endl;
+
+    using Alloc = util::SmallAllocator<std::pair<const int, std::string>>;
+    std::map<int, std::string, std::less<int>, Alloc> m;
+    for (int i = 0; i < 10; i++) {
+        m[i] = std::to_string(i * i);
+    }
+    std::cout << "map size: " << m.size() << ", m[9]: " << m[9] << std::endl;
+
+    auto sp = util::MakeSmallShared<std::string>("shared string");
+    std::cout << "shared: " << *sp << ", use_count: " << sp.use_count() << std::endl;
+}
+
+//////////////////////////////////////////////////////////////
+// 多线程分配/释放性能对比，每个线程分配一批不同大小的小对象后释放，
+// 其中一半由下一个线程释放，模拟生产者/消费者之间传递节点
+struct Malloc
+{
+    static void* Allocate(size_t size) { return malloc(size); }
+    static void Deallocate(void* p, size_t) { free(p); }
+};
+
+// 线程之间传递待释放对象的槽
+struct Handoff
+{
+    std::mutex mtx;
+    std::vector<std::pair<void*, size_t>> blocks;
+};
+
+template<typename Alloc>
+void FreeAll(std::vector<std::pair<void*, size_t>>& blocks)
+{
+    for (auto& block : blocks) {
+        Alloc::Deallocate(block.first, block.second);
+    }
+    blocks.clear();
+}
+
+template<typename Alloc>
+void ChurnBenchmark(const std::string& name, int thread_num, int rounds, int batch)
+{
+    std::vector<Handoff> handoff(thread_num);
+    std::vector<std::thread> threads;
+
+    util::TimeSpan ts;
+    for (int t = 0; t < thread_num; t++) {
+        threads.emplace_back([&handoff, t, thread_num, rounds, batch] {
+            std::vector<std::pair<void*, size_t>> ptrs(batch);
+            std::vector<std::pair<void*, size_t>> remote, received;
+            for (int r = 0; r < rounds; r++) {
+                for (int i = 0; i < batch; i++) {
+                    size_t size = 16 + (i * 7 + r) % 240;
+                    ptrs[i] = std::make_pair(Alloc::Allocate(size), size);
+                }
+
+                // 偶数下标的对象本线程释放，奇数下标的交给下一个线程释放
+                for (int i = 0; i < batch; i += 2) {
+                    Alloc::Deallocate(ptrs[i].first, ptrs[i].second);
+                }
+                for (int i = 1; i < batch; i += 2) {
+                    remote.push_back(ptrs[i]);
+                }
+                {
+                    Handoff& next = handoff[(t + 1) % thread_num];
+                    std::lock_guard<std::mutex> locker(next.mtx);
+                    next.blocks.insert(next.blocks.end(), remote.begin(), remote.end());
+                }
+                remote.clear();
+                {
+                    Handoff& mine = handoff[t];
+                    std::lock_guard<std::mutex> locker(mine.mtx);
+                    received.swap(mine.blocks);
+                }
+                FreeAll<Alloc>(received);
+            }
+        });
+    }
+    for (auto& thd : threads) {
+        thd.join();
+    }
+    for (auto& slot : handoff) {
+        FreeAll<Alloc>(slot.blocks);
+    }
+
+    std::cout << name << ": " << thread_num << " threads, "
+              << ts.SpanNano() / (int64_t(thread_num) * rounds * batch) << " ns per alloc/free" << std::endl;
+}
+
+//////////////////////////////////////////////////////////////
+int main(int argc, char const *argv[])
+{
+    std::cout << "*** SmallAllocTest ***" << std::endl;
+    SmallAllocTest();
+
+    std::cout << "*** SmallAllocatorTest ***" << std::endl;
+    SmallAllocatorTest();
+
+    std::cout << "*** ChurnBenchmark ***" << std::endl;
+    ChurnBenchmark<Malloc>("malloc/free", 8, 2000, 1000);
+    ChurnBenchmark<util::SmallAlloc>("SmallAlloc ", 8, 2000, 1000);
+
+    return 0;
+}
@@ -0,0 +1,468 @@
+/**
+ * desc: smartdb sqlite 查询结果缓存
+ * file: smartdb_cache.h
+ *
+ * author:  myw31415926
+ * date:    20190503
+ * version: V0.1
+ *
+ * the closer you look, the less you see
+ */
+
+#ifndef SMART_DB_CACHE_H_
+#define SMART_DB_CACHE_H_
+
+#include "any.h"
+
+#include "sqlite3.h"
+
+#include <chrono>
+#include <cctype>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <string>
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <unordered_map>
+
+namespace smartdb {
+
+// 查询结果缓存统计
+struct QueryCacheStats
+{
+    size_t size;            // 当前缓存的结果数
+    size_t hits;            // 命中次数
+    size_t misses;          // 未命中次数
+    size_t invalidations;   // 因为表被修改或者过期而失效的次数
+    size_t evictions;       // 淘汰次数
+};
+
+// 查询结果缓存，key为规范化的SQL（合并引号外的空白）加上绑定的参数，值为util::Any保存的查询结果
+// 每个结果记录读取的表在写入时的版本号，表被修改时版本号加1（sqlite3_update_hook），命中时发现版本变化即失效
+// 只能发现同一个连接上的修改，其他连接的修改只能靠TTL过期。按LRU淘汰，非线程安全
+// sqlite3_update_hook不报告WITHOUT ROWID表和sqlite_开头的系统表的修改，读取这些表的查询不缓存。
+// 判断WITHOUT ROWID时检查表能否按rowid查询，自定义了rowid、_rowid_和oid三个列的WITHOUT ROWID表会被误判
+class QueryCache
+{
+    using Clock = std::chrono::steady_clock;
+
+    // 一个表的版本号，节点的地址在表的生命周期内不变
+    struct TableVersion
+    {
+        std::string name;
+        uint64_t    version;
+    };
+    using VersionMap = std::unordered_map<std::string, TableVersion>;
+
+    struct Entry
+    {
+        std::string       key;
+        util::Any         value;
+        Clock::time_point expire;
+        std::vector<std::pair<const TableVersion*, uint64_t>> tables;  // 读取的表和当时的版本号
+    };
+    using EntryList = std::list<Entry>;
+
+    // 一条SQL读取的表，编译一次后保存
+    struct Plan
+    {
+        bool cacheable;
+        std::vector<std::string> tables;
+    };
+
+public:
+    QueryCache() : db_(nullptr), capacity_(0), max_rows_(0), ttl_(0), last_table_(nullptr), stats_{0, 0, 0, 0, 0} {}
+
+    ~QueryCache()
+    {
+        Disable();
+    }
+
+    /**
+     * @brief: 打开缓存，在连接上注册sqlite3_update_hook
+     * @param[in] db: 数据库句柄
+     * @param[in] capacity: 最多缓存的结果数
+     * @param[in] ttl: 结果的有效期
+     * @param[in] max_rows: 超过max_rows行的查询结果不缓存，避免一个大结果挤掉全部小结果
+     */
+    void Enable(sqlite3* db, size_t capacity, std::chrono::milliseconds ttl, size_t max_rows)
+    {
+        Disable();
+        db_ = db;
+        capacity_ = capacity;
+        max_rows_ = max_rows;
+        ttl_ = ttl;
+        sqlite3_update_hook(db_, &QueryCache::OnUpdate, this);
+    }
+
+    // 关闭缓存，清空全部结果，注销update hook
+    void Disable()
+    {
+        if (db_ != nullptr) {
+            sqlite3_update_hook(db_, nullptr, nullptr);
+            db_ = nullptr;
+        }
+        Clear();
+        plans_.clear();
+        capacity_ = 0;
+    }
+
+    bool Enabled() const
+    {
+        return db_ != nullptr;
+    }
+
+    size_t MaxRows() const
+    {
+        return max_rows_;
+    }
+
+    /**
+     * @brief: 生成缓存的key：种类、规范化的SQL和参数
+     * @param[in] kind: 结果的种类，区分同一SQL的不同用法，例如Query和ExcecuteScalar
+     */
+    template<typename... Args>
+    static std::string MakeKey(char kind, const std::string& sql, const Args&... args)
+    {
+        std::string key(1, kind);
+        key.reserve(sql.size() + 16 * sizeof...(Args) + 1);
+        AppendSql(key, sql);
+        AppendArgs(key, args...);
+        return key;
+    }
+
+    /**
+     * @brief: 查找未过期、读取的表没有被修改的结果
+     * @return: 命中返回结果，否则返回nullptr
+     */
+    util::Any* Find(const std::string& key)
+    {
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            stats_.misses++;
+            return nullptr;
+        }
+
+        Entry& entry = *it->second;
+        if (Stale(entry)) {
+            Erase(it->second);
+            stats_.invalidations++;
+            stats_.misses++;
+            return nullptr;
+        }
+
+        stats_.hits++;
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return &entry.value;
+    }
+
+    /**
+     * @brief: 保存查询结果。只读、读取了表、不在事务中的语句才缓存：
+     *         事务中读到的可能是未提交的数据；没有读取表的语句（例如PRAGMA、select changes()）无法判断何时失效
+     * @param[in] key: MakeKey生成的key
+     * @param[in] sql: 原始的SQL，用于分析读取的表
+     * @param[in] value: 查询结果
+     */
+    void Insert(const std::string& key, const std::string& sql, util::Any value)
+    {
+        if (capacity_ == 0 || !sqlite3_get_autocommit(db_)) {
+            return;
+        }
+
+        const Plan& plan = GetPlan(sql);
+        if (!plan.cacheable) {
+            return;
+        }
+
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            Erase(it->second);
+        }
+
+        entries_.push_front(Entry{key, std::move(value), Clock::now() + ttl_, {}});
+        Entry& entry = entries_.front();
+        entry.tables.reserve(plan.tables.size());
+        for (auto& table : plan.tables) {
+            TableVersion& tv = Version(table);
+            entry.tables.emplace_back(&tv, tv.version);
+        }
+        index_.emplace(entry.key, entries_.begin());
+
+        while (entries_.size() > capacity_) {
+            Erase(std::prev(entries_.end()));
+            stats_.evictions++;
+        }
+    }
+
+    /**
+     * @brief: 使读取了table的结果全部失效
+     */
+    void Invalidate(const std::string& table)
+    {
+        auto it = versions_.find(Lower(table.c_str()));
+        if (it != versions_.end()) {
+            it->second.version++;
+        }
+    }
+
+    // 清空全部结果。表结构可能已经改变（例如重建为WITHOUT ROWID表），分析过的SQL也一起清空
+    void Clear()
+    {
+        entries_.clear();
+        index_.clear();
+        versions_.clear();
+        last_table_ = nullptr;
+        plans_.clear();
+    }
+
+    QueryCacheStats Stats() const
+    {
+        QueryCacheStats stats = stats_;
+        stats.size = entries_.size();
+        return stats;
+    }
+
+private:
+    // 禁止复制和赋值
+    QueryCache(const QueryCache&) = delete;
+    QueryCache& operator=(const QueryCache&) = delete;
+
+    // 合并引号外的连续空白，去掉首尾的空白和分号，引号内的内容保持不变
+    static void AppendSql(std::string& key, const std::string& sql)
+    {
+        size_t begin = key.size();
+        char quote = 0;
+        bool space = false;
+        for (char c : sql) {
+            if (quote != 0) {
+                key += c;
+                quote = (c == quote) ? 0 : quote;
+            } else if (std::isspace(static_cast<unsigned char>(c))) {
+                space = true;
+            } else {
+                if (space && key.size() > begin) {
+                    key += ' ';
+                }
+                space = false;
+                key += c;
+                quote = (c == '\'' || c == '"' || c == '`') ? c : 0;
+            }
+        }
+        while (key.size() > begin && key.back() == ';') {
+            key.pop_back();
+        }
+    }
+
+    static void AppendArgs(std::string&) {}
+
+    template<typename T, typename... Args>
+    static void AppendArgs(std::string& key, const T& first, const Args&... args)
+    {
+        AppendArg(key, first);
+        AppendArgs(key, args...);
+    }
+
+    // 参数按类型标记加二进制内容编码，不同类型的相同值不会冲突
+    template<typename T>
+    static typename std::enable_if<std::is_integral<T>::value>::type AppendArg(std::string& key, T t)
+    {
+        AppendBytes(key, 'i', static_cast<int64_t>(t));
+    }
+
+    template<typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type AppendArg(std::string& key, T t)
+    {
+        AppendBytes(key, 'd', static_cast<double>(t));
+    }
+
+    static void AppendArg(std::string& key, const std::string& t)
+    {
+        AppendData(key, 's', t.data(), t.size());
+    }
+
+    static void AppendArg(std::string& key, const char* t)
+    {
+        AppendData(key, 's', t, t != nullptr ? std::strlen(t) : 0);
+    }
+
+    static void AppendArg(std::string& key, std::nullptr_t)
+    {
+        key += 'n';
+    }
+
+    // 其他类型（SqliteBlob、视图等）按{data, size}编码
+    template<typename T>
+    static auto AppendArg(std::string& key, const T& t) -> decltype(t.size, void())
+    {
+        AppendData(key, 'b', reinterpret_cast<const char*>(DataOf(t)), static_cast<size_t>(t.size));
+    }
+
+    template<typename T>
+    static auto DataOf(const T& t) -> decltype(t.buf)
+    {
+        return t.buf;
+    }
+
+    template<typename T>
+    static auto DataOf(const T& t) -> decltype(t.data)
+    {
+        return t.data;
+    }
+
+    template<typename T>
+    static void AppendBytes(std::string& key, char tag, T t)
+    {
+        key += tag;
+        key.append(reinterpret_cast<const char*>(&t), sizeof(t));
+    }
+
+    static void AppendData(std::string& key, char tag, const char* data, size_t size)
+    {
+        AppendBytes(key, tag, static_cast<uint32_t>(size));
+        key.append(data != nullptr ? data : "", size);
+    }
+
+    bool Stale(const Entry& entry) const
+    {
+        if (Clock::now() >= entry.expire) {
+            return true;
+        }
+        for (auto& table : entry.tables) {
+            if (table.first->version != table.second) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Erase(EntryList::iterator it)
+    {
+        index_.erase(it->key);
+        entries_.erase(it);
+    }
+
+    static std::string Lower(const char* name)
+    {
+        std::string lower(name);
+        for (auto& c : lower) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        return lower;
+    }
+
+    TableVersion& Version(const std::string& table)
+    {
+        std::string name = Lower(table.c_str());
+        auto it = versions_.find(name);
+        if (it == versions_.end()) {
+            it = versions_.emplace(name, TableVersion{name, 0}).first;
+        }
+        return it->second;
+    }
+
+    // 编译语句，通过authorizer收集读取的表。只读并且至少读取一个表的语句才缓存，
+    // 使用了随机数、changes()等结果每次不同的函数的语句，以及读取了修改时不触发update hook的表的语句不缓存
+    const Plan& GetPlan(const std::string& sql)
+    {
+        auto it = plans_.find(sql);
+        if (it != plans_.end()) {
+            return it->second;
+        }
+        if (plans_.size() >= capacity_ * 4) {
+            plans_.clear();
+        }
+
+        Plan plan{true, {}};
+        sqlite3_set_authorizer(db_, &QueryCache::OnAuthorize, &plan);
+        sqlite3_stmt* stmt = nullptr;
+        int ret = sqlite3_prepare_v2(db_, sql.c_str(), static_cast<int>(sql.size()), &stmt, nullptr);
+        sqlite3_set_authorizer(db_, nullptr, nullptr);
+        plan.cacheable = plan.cacheable && ret == SQLITE_OK && stmt != nullptr
+            && sqlite3_stmt_readonly(stmt) && !plan.tables.empty();
+        sqlite3_finalize(stmt);
+
+        for (size_t i = 0; plan.cacheable && i < plan.tables.size(); i++) {
+            plan.cacheable = HasUpdateHook(plan.tables[i]);
+        }
+
+        return plans_.emplace(sql, std::move(plan)).first->second;
+    }
+
+    // 表的修改是否会触发update hook：系统表和WITHOUT ROWID表不会。在authorizer之外调用，可以编译语句
+    bool HasUpdateHook(const std::string& table)
+    {
+        if (table.compare(0, 7, "sqlite_") == 0) {
+            return false;
+        }
+
+        std::string quoted;
+        for (char c : table) {
+            quoted += c;
+            if (c == '"') {
+                quoted += c;
+            }
+        }
+        std::string sql = "SELECT rowid, _rowid_, oid FROM \"" + quoted + "\";";
+        sqlite3_stmt* stmt = nullptr;
+        int ret = sqlite3_prepare_v2(db_, sql.c_str(), static_cast<int>(sql.size()), &stmt, nullptr);
+        sqlite3_finalize(stmt);
+        return ret == SQLITE_OK;
+    }
+
+    static int OnAuthorize(void* data, int action, const char* arg1, const char* arg2, const char*, const char*)
+    {
+        Plan* plan = static_cast<Plan*>(data);
+        if (action == SQLITE_READ && arg1 != nullptr) {
+            if (std::find(plan->tables.begin(), plan->tables.end(), Lower(arg1)) == plan->tables.end()) {
+                plan->tables.push_back(Lower(arg1));
+            }
+        } else if (action == SQLITE_PRAGMA) {
+            plan->cacheable = false;
+        } else if (action == SQLITE_FUNCTION && arg2 != nullptr) {
+            static const char* const volatile_funcs[] = {
+                "random", "randomblob", "changes", "total_changes", "last_insert_rowid"
+            };
+            for (const char* func : volatile_funcs) {
+                if (sqlite3_stricmp(arg2, func) == 0) {
+                    plan->cacheable = false;
+                }
+            }
+        }
+        return SQLITE_OK;
+    }
+
+    // 表被修改。同一语句修改多行时表名指针相同，先和上一次的表比较，避免每行都查找
+    static void OnUpdate(void* data, int, const char*, const char* table, sqlite3_int64)
+    {
+        QueryCache* cache = static_cast<QueryCache*>(data);
+        if (cache->last_table_ == nullptr || sqlite3_stricmp(cache->last_table_->name.c_str(), table) != 0) {
+            auto it = cache->versions_.find(Lower(table));
+            if (it == cache->versions_.end()) {
+                return;     // 没有缓存的结果读取这个表
+            }
+            cache->last_table_ = &it->second;
+        }
+        cache->last_table_->version++;
+    }
+
+private:
+    sqlite3*  db_;
+    size_t    capacity_;
+    size_t    max_rows_;
+    std::chrono::milliseconds ttl_;
+
+    EntryList entries_;     // 最近使用的在前
+    std::unordered_map<std::string, EntryList::iterator> index_;
+    VersionMap versions_;
+    TableVersion* last_table_;  // 最近一次修改的表
+    std::unordered_map<std::string, Plan> plans_;
+
+    QueryCacheStats stats_;
+};
+
+}
+#endif // SMART_DB_CACHE_H_
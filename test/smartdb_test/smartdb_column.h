@@ -0,0 +1,825 @@
+/**
+ * desc: smartdb sqlite 列式导出，导出文件通过mmap零拷贝读取
+ * file: smartdb_column.h
+ *
+ * author:  myw31415926
+ * date:    20190512
+ * version: V0.1
+ *
+ * the closer you look, the less you see
+ */
+
+#ifndef SMART_DB_COLUMN_H_
+#define SMART_DB_COLUMN_H_
+
+#include "smartdb_sqlite.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace smartdb {
+
+// 列的存储类型
+enum class ColumnKind : uint32_t
+{
+    Int64  = 1,     // int64_t数组
+    Double = 2,     // double数组
+    String = 3,     // 字典编码：uint32_t编码数组 + 每块一个字典
+    Blob   = 4,     // 偏移数组 + 连续的数据
+};
+
+static const uint32_t kColumnFileVersion = 1;
+
+// 列式文件格式，字节序为本机字节序，全部缓冲区按8字节对齐：
+//   ColumnFileHeader | 块数据 ... | 列名 | ColumnFileColumn[columns] | ColumnFileChunk[chunks * columns]
+// 行按chunk_rows分块，每块内每列的数据连续存放，最后一块可能不满。块数据和目录中的偏移都是相对文件开头的字节数
+struct ColumnFileHeader
+{
+    char     magic[4];      // "SDBC"
+    uint32_t version;
+    uint32_t columns;
+    uint32_t chunk_rows;    // 每块的行数
+    uint64_t rows;
+    uint64_t chunks;
+    uint64_t footer;        // 列定义和块目录的偏移
+};
+
+struct ColumnFileColumn
+{
+    uint32_t kind;          // ColumnKind
+    uint32_t name_size;
+    uint64_t name;          // 列名的偏移
+};
+
+// 一块中一列的数据。n为块的行数
+struct ColumnFileChunk
+{
+    uint64_t validity;      // null位图，ceil(n / 8)字节，第i位为1表示第i行不为NULL；0表示没有NULL
+    uint64_t values;        // Int64、Double为n个值，String为n个字典编码，NULL的位置为0
+    uint64_t offsets;       // String为dict_size + 1个uint64_t的字典偏移，Blob为n + 1个uint64_t的值偏移
+    uint64_t data;          // String的字典内容，Blob的值内容
+    uint64_t data_size;
+    uint32_t null_count;
+    uint32_t dict_size;     // String的字典项数
+};
+
+// 一块中一列的定长值，指向mmap的内存，不复制
+template<typename T>
+struct ColumnSpan
+{
+    const T*       data;
+    size_t         size;
+    const uint8_t* validity;    // 为nullptr时没有NULL
+
+    const T* begin() const { return data; }
+    const T* end() const { return data + size; }
+
+    T operator[](size_t i) const
+    {
+        return data[i];
+    }
+
+    bool IsNull(size_t i) const
+    {
+        return validity != nullptr && ((validity[i >> 3] >> (i & 7)) & 1) == 0;
+    }
+};
+
+// 一块中的字典编码字符串列，codes为每行的字典编码
+// 打开文件时不检查每行的编码和字典偏移，访问时检查，文件损坏时抛出std::out_of_range，不会读到映射之外
+struct StringColumnSpan
+{
+    ColumnSpan<uint32_t> codes;
+    const uint64_t* dict_offsets;
+    const char*     dict_data;
+    uint32_t        dict_size;
+    uint64_t        data_size;  // 字典内容的字节数
+
+    size_t size() const
+    {
+        return codes.size;
+    }
+
+    bool IsNull(size_t i) const
+    {
+        return codes.IsNull(i);
+    }
+
+    // 字典中的第code项
+    SqliteTextView Dict(uint32_t code) const
+    {
+        if (code >= dict_size) {
+            throw std::out_of_range("column file string code out of range");
+        }
+        uint64_t begin = dict_offsets[code];
+        uint64_t end = dict_offsets[code + 1];
+        if (begin > end || end > data_size) {
+            throw std::out_of_range("column file string offset out of range");
+        }
+        return SqliteTextView{dict_data + begin, static_cast<int>(end - begin)};
+    }
+
+    // 第i行的值，NULL返回{nullptr, 0}
+    SqliteTextView operator[](size_t i) const
+    {
+        return IsNull(i) ? SqliteTextView{nullptr, 0} : Dict(codes[i]);
+    }
+};
+
+// 一块中的blob列，每行的偏移在访问时检查，文件损坏时抛出std::out_of_range
+struct BlobColumnSpan
+{
+    const uint64_t* offsets;
+    const char*     data;
+    size_t          size;
+    const uint8_t*  validity;
+    uint64_t        data_size;  // 全部值的字节数
+
+    bool IsNull(size_t i) const
+    {
+        return validity != nullptr && ((validity[i >> 3] >> (i & 7)) & 1) == 0;
+    }
+
+    // 第i行的值，NULL返回{nullptr, 0}
+    SqliteBlobView operator[](size_t i) const
+    {
+        if (IsNull(i)) {
+            return SqliteBlobView{nullptr, 0};
+        }
+        uint64_t begin = offsets[i];
+        uint64_t end = offsets[i + 1];
+        if (begin > end || end > data_size) {
+            throw std::out_of_range("column file blob offset out of range");
+        }
+        return SqliteBlobView{data + begin, static_cast<int>(end - begin)};
+    }
+};
+
+// 列式导出。逐行读取查询结果，按块缓存在各列的缓冲区中，每满一块写入文件，内存占用与块大小有关，与结果集大小无关
+// 列类型优先由声明类型决定（INTEGER、REAL、TEXT、BLOB亲和性），表达式或NUMERIC列由第一个非NULL值决定，
+// 之后类型不同的值按sqlite的规则转换（例如Int64列中的文本按sqlite3_column_int64转换）
+// 先写入临时文件，完成后改名，读者不会看到写了一半的文件
+class ColumnExporter
+{
+    struct ColumnBuffer
+    {
+        ColumnKind            kind;
+        bool                  resolved;     // 类型已确定，未确定时按String缓存NULL
+        std::string           name;
+        std::vector<uint8_t>  validity;
+        uint32_t              null_count;
+        std::vector<int64_t>  ints;
+        std::vector<double>   doubles;
+        std::vector<uint32_t> codes;
+        std::unordered_map<std::string, uint32_t> dict;
+        std::vector<uint64_t> offsets;  // String为字典偏移，Blob为值偏移
+        std::string           data;
+    };
+
+public:
+    /**
+     * @param[in] chunk_rows: 每块的行数，影响导出时的内存占用和读取时的块数
+     */
+    explicit ColumnExporter(uint32_t chunk_rows = 65536)
+        : chunk_rows_(chunk_rows), fp_(nullptr), offset_(0), rows_(0), chunk_size_(0), err_code_(SQLITE_OK)
+    {
+        if (chunk_rows_ == 0) {
+            throw std::invalid_argument("column export chunk rows must be greater than 0");
+        }
+    }
+
+    virtual ~ColumnExporter()
+    {
+        CloseFile();
+    }
+
+    /**
+     * @brief: 把查询结果导出为列式文件
+     * @param[in] db: 数据库
+     * @param[in] path: 导出文件名，已存在时覆盖
+     * @param[in] sql: 查询语句，导出整个表时为 SELECT * FROM table
+     * @param[in] args: SQL语句参数
+     * @return: 成功返回true; 失败返回false，错误码通过GetLastErrCode获取，不会留下不完整的文件
+     */
+    template<typename... Args>
+    bool Export(SmartDBSqlite& db, const std::string& path, const std::string& sql, Args&&... args)
+    {
+        auto cursor = db.QueryCursor<std::tuple<>>(sql, std::forward<Args>(args)...);
+        if (!cursor.Valid()) {
+            err_code_ = cursor.GetLastErrCode();
+            return false;
+        }
+
+        std::string tmp_path = path + ".tmp";
+        if (!Begin(tmp_path, cursor.Statement())) {
+            return Fail(tmp_path);
+        }
+        while (cursor.Next()) {
+            if (!Append(cursor.Statement())) {
+                return Fail(tmp_path);
+            }
+        }
+        if (cursor.GetLastErrCode() != SQLITE_DONE) {
+            err_code_ = cursor.GetLastErrCode();
+            return Fail(tmp_path);
+        }
+
+        if (!Finish() || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            err_code_ = SQLITE_IOERR;
+            return Fail(tmp_path);
+        }
+        err_code_ = SQLITE_OK;
+        return true;
+    }
+
+    /**
+     * @brief: 导出整个表
+     */
+    bool ExportTable(SmartDBSqlite& db, const std::string& path, const std::string& table)
+    {
+        return Export(db, path, "SELECT * FROM " + table + ";");
+    }
+
+    // 最近一次导出的行数
+    uint64_t Rows() const
+    {
+        return rows_;
+    }
+
+    /**
+     * @brief: 获取最近一次错误代码，文件读写失败为SQLITE_CANTOPEN或SQLITE_IOERR
+     * @return: 返回最近一次错误代码
+     */
+    int GetLastErrCode() const
+    {
+        return err_code_;
+    }
+
+private:
+    // 禁止复制和赋值
+    ColumnExporter(const ColumnExporter&) = delete;
+    ColumnExporter& operator=(const ColumnExporter&) = delete;
+
+    // 创建文件，写入占位的文件头，按声明类型确定列类型
+    bool Begin(const std::string& path, sqlite3_stmt* stmt)
+    {
+        fp_ = std::fopen(path.c_str(), "wb");
+        if (fp_ == nullptr) {
+            err_code_ = SQLITE_CANTOPEN;
+            return false;
+        }
+        std::setvbuf(fp_, nullptr, _IOFBF, 1 << 20);
+
+        offset_ = 0;
+        rows_ = 0;
+        chunk_size_ = 0;
+        chunks_.clear();
+        int count = sqlite3_column_count(stmt);
+        columns_.resize(count);
+        for (int i = 0; i < count; i++) {
+            ColumnBuffer& column = columns_[i];
+            const char* name = sqlite3_column_name(stmt, i);
+            column.name = name != nullptr ? name : "";
+            column.kind = ColumnKind::String;
+            column.resolved = KindOfDecl(sqlite3_column_decltype(stmt, i), column.kind);
+            ResetColumn(column);
+        }
+
+        ColumnFileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        return Write(&header, sizeof(header));
+    }
+
+    // 把当前行追加到各列的缓冲区，满一块时写入文件
+    bool Append(sqlite3_stmt* stmt)
+    {
+        size_t index = chunk_size_;
+        for (size_t i = 0; i < columns_.size(); i++) {
+            ColumnBuffer& column = columns_[i];
+            int col = static_cast<int>(i);
+            int type = sqlite3_column_type(stmt, col);
+            if (!column.resolved && type != SQLITE_NULL) {
+                // 块内之前的行都是NULL，按确定的类型补齐
+                column.kind = KindOfValue(type);
+                column.resolved = true;
+                column.codes.clear();
+                column.ints.assign(column.kind == ColumnKind::Int64 ? index : 0, 0);
+                column.doubles.assign(column.kind == ColumnKind::Double ? index : 0, 0);
+                column.codes.assign(column.kind == ColumnKind::String ? index : 0, 0);
+                column.offsets.assign(column.kind == ColumnKind::Blob ? index + 1 : 1, 0);
+            }
+
+            if (index % 8 == 0) {
+                column.validity.push_back(0);
+            }
+            if (type == SQLITE_NULL) {
+                column.null_count++;
+            } else {
+                column.validity.back() |= static_cast<uint8_t>(1 << (index % 8));
+            }
+
+            switch (column.kind) {
+            case ColumnKind::Int64:
+                column.ints.push_back(type == SQLITE_NULL ? 0 : sqlite3_column_int64(stmt, col));
+                break;
+            case ColumnKind::Double:
+                column.doubles.push_back(type == SQLITE_NULL ? 0 : sqlite3_column_double(stmt, col));
+                break;
+            case ColumnKind::String:
+                column.codes.push_back(type == SQLITE_NULL ? 0 : Encode(column, stmt, col));
+                break;
+            case ColumnKind::Blob:
+                if (type != SQLITE_NULL) {
+                    // 先取指针再取长度
+                    const char* blob = static_cast<const char*>(sqlite3_column_blob(stmt, col));
+                    column.data.append(blob != nullptr ? blob : "", sqlite3_column_bytes(stmt, col));
+                }
+                column.offsets.push_back(column.data.size());
+                break;
+            }
+        }
+
+        rows_++;
+        return ++chunk_size_ < chunk_rows_ || FlushChunk();
+    }
+
+    // 写入最后一块、列名和目录，回填文件头
+    bool Finish()
+    {
+        if (chunk_size_ > 0 && !FlushChunk()) {
+            return false;
+        }
+
+        std::vector<ColumnFileColumn> descs;
+        for (auto& column : columns_) {
+            uint64_t name = WriteBuffer(column.name.data(), column.name.size());
+            descs.push_back(ColumnFileColumn{static_cast<uint32_t>(column.kind),
+                static_cast<uint32_t>(column.name.size()), name});
+        }
+
+        ColumnFileHeader header;
+        std::memcpy(header.magic, "SDBC", 4);
+        header.version = kColumnFileVersion;
+        header.columns = static_cast<uint32_t>(columns_.size());
+        header.chunk_rows = chunk_rows_;
+        header.rows = rows_;
+        header.chunks = columns_.empty() ? 0 : chunks_.size() / columns_.size();
+        header.footer = WriteBuffer(descs.data(), descs.size() * sizeof(ColumnFileColumn));
+        WriteBuffer(chunks_.data(), chunks_.size() * sizeof(ColumnFileChunk));
+
+        bool ok = fp_ != nullptr && std::fseek(fp_, 0, SEEK_SET) == 0 && Write(&header, sizeof(header));
+        return CloseFile() && ok;
+    }
+
+    // 写入一块的全部列，清空缓冲区（保留容量）
+    bool FlushChunk()
+    {
+        for (auto& column : columns_) {
+            ColumnFileChunk chunk;
+            std::memset(&chunk, 0, sizeof(chunk));
+            chunk.null_count = column.null_count;
+            if (column.null_count > 0) {
+                chunk.validity = WriteBuffer(column.validity.data(), column.validity.size());
+            }
+
+            switch (column.kind) {
+            case ColumnKind::Int64:
+                chunk.values = WriteBuffer(column.ints.data(), column.ints.size() * sizeof(int64_t));
+                break;
+            case ColumnKind::Double:
+                chunk.values = WriteBuffer(column.doubles.data(), column.doubles.size() * sizeof(double));
+                break;
+            case ColumnKind::String:
+                chunk.values = WriteBuffer(column.codes.data(), column.codes.size() * sizeof(uint32_t));
+                chunk.dict_size = static_cast<uint32_t>(column.dict.size());
+                break;
+            case ColumnKind::Blob:
+                break;
+            }
+            if (column.kind == ColumnKind::String || column.kind == ColumnKind::Blob) {
+                chunk.offsets = WriteBuffer(column.offsets.data(), column.offsets.size() * sizeof(uint64_t));
+                chunk.data = WriteBuffer(column.data.data(), column.data.size());
+                chunk.data_size = column.data.size();
+            }
+
+            chunks_.push_back(chunk);
+            ResetColumn(column);
+            column.resolved = true;     // 整块都是NULL的列已经按String写入，之后不能再改变类型
+        }
+
+        chunk_size_ = 0;
+        return fp_ != nullptr;
+    }
+
+    void ResetColumn(ColumnBuffer& column)
+    {
+        column.validity.clear();
+        column.null_count = 0;
+        column.ints.clear();
+        column.doubles.clear();
+        column.codes.clear();
+        column.dict.clear();
+        column.offsets.assign(1, 0);
+        column.data.clear();
+    }
+
+    // 字符串按块内的字典编码，相同的字符串只保存一次
+    uint32_t Encode(ColumnBuffer& column, sqlite3_stmt* stmt, int col)
+    {
+        ColumnReader<std::string>::Read(stmt, col, key_);
+        auto it = column.dict.find(key_);
+        if (it != column.dict.end()) {
+            return it->second;
+        }
+
+        uint32_t code = static_cast<uint32_t>(column.dict.size());
+        column.dict.emplace(key_, code);
+        column.data += key_;
+        column.offsets.push_back(column.data.size());
+        return code;
+    }
+
+    // 按sqlite的类型亲和性规则由声明类型确定列类型，NUMERIC或者没有声明类型（表达式）时返回false
+    static bool KindOfDecl(const char* decl, ColumnKind& kind)
+    {
+        if (decl == nullptr) {
+            return false;
+        }
+
+        std::string type(decl);
+        for (auto& c : type) {
+            c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        }
+        if (type.find("INT") != std::string::npos) {
+            kind = ColumnKind::Int64;
+        } else if (type.find("CHAR") != std::string::npos || type.find("CLOB") != std::string::npos
+            || type.find("TEXT") != std::string::npos) {
+            kind = ColumnKind::String;
+        } else if (type.empty() || type.find("BLOB") != std::string::npos) {
+            kind = ColumnKind::Blob;
+        } else if (type.find("REAL") != std::string::npos || type.find("FLOA") != std::string::npos
+            || type.find("DOUB") != std::string::npos) {
+            kind = ColumnKind::Double;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    static ColumnKind KindOfValue(int type)
+    {
+        switch (type) {
+        case SQLITE_INTEGER:
+            return ColumnKind::Int64;
+        case SQLITE_FLOAT:
+            return ColumnKind::Double;
+        case SQLITE_TEXT:
+            return ColumnKind::String;
+        default:
+            return ColumnKind::Blob;
+        }
+    }
+
+    // 写入一个缓冲区并补齐到8字节，返回缓冲区的偏移
+    uint64_t WriteBuffer(const void* data, size_t size)
+    {
+        static const char padding[8] = {0};
+        uint64_t offset = offset_;
+        size_t pad = (8 - size % 8) % 8;
+        if (!Write(data, size) || !Write(padding, pad)) {
+            CloseFile();
+        }
+        return offset;
+    }
+
+    bool Write(const void* data, size_t size)
+    {
+        if (fp_ == nullptr) {
+            return false;
+        }
+        if (size > 0 && std::fwrite(data, 1, size, fp_) != size) {
+            err_code_ = SQLITE_IOERR;
+            return false;
+        }
+        offset_ += size;
+        return true;
+    }
+
+    bool CloseFile()
+    {
+        if (fp_ == nullptr) {
+            return false;
+        }
+        bool ok = std::fclose(fp_) == 0;
+        fp_ = nullptr;
+        return ok;
+    }
+
+    bool Fail(const std::string& path)
+    {
+        CloseFile();
+        std::remove(path.c_str());
+        return false;
+    }
+
+private:
+    uint32_t    chunk_rows_;
+    std::FILE*  fp_;
+    uint64_t    offset_;        // 已写入的字节数
+    uint64_t    rows_;
+    uint32_t    chunk_size_;    // 当前块已缓存的行数
+    std::vector<ColumnBuffer>    columns_;
+    std::vector<ColumnFileChunk> chunks_;   // 已写入的块目录
+    std::string key_;           // 字典编码时复用的字符串
+    int         err_code_;
+};
+
+// 列式文件读取。打开时mmap整个文件，检查文件头、目录中每个缓冲区的起止位置在文件内，
+// 以及字符串和blob列偏移数组的最后一项等于数据大小，打开的耗时与块数和列数成正比，与数据量无关。
+// 每行的字典编码和偏移在打开时不检查，由StringColumnSpan和BlobColumnSpan在访问时检查
+// 各列以ColumnSpan等形式直接指向映射的内存，不复制，文件关闭后失效。只能移动，不能复制
+class ColumnFile
+{
+public:
+    ColumnFile() : base_(nullptr), size_(0), header_(nullptr), columns_(nullptr), chunks_(nullptr),
+        err_code_(SQLITE_OK) {}
+
+    ColumnFile(ColumnFile&& other) noexcept
+        : base_(other.base_), size_(other.size_), header_(other.header_), columns_(other.columns_),
+          chunks_(other.chunks_), err_code_(other.err_code_)
+    {
+        other.base_ = nullptr;
+        other.size_ = 0;
+        other.header_ = nullptr;
+    }
+
+    ColumnFile& operator=(ColumnFile&& other) noexcept
+    {
+        if (this != &other) {
+            Close();
+            std::swap(base_, other.base_);
+            std::swap(size_, other.size_);
+            std::swap(header_, other.header_);
+            columns_ = other.columns_;
+            chunks_ = other.chunks_;
+            err_code_ = other.err_code_;
+        }
+        return *this;
+    }
+
+    virtual ~ColumnFile()
+    {
+        Close();
+    }
+
+    /**
+     * @brief: 映射列式文件
+     * @param[in] path: ColumnExporter导出的文件
+     * @return: 成功返回true; 失败返回false，打不开为SQLITE_CANTOPEN，格式错误为SQLITE_NOTADB或SQLITE_CORRUPT
+     */
+    bool Open(const std::string& path)
+    {
+        Close();
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || ::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(ColumnFileHeader))) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            err_code_ = SQLITE_CANTOPEN;
+            return false;
+        }
+
+        void* base = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);    // 映射建立后可以关闭文件
+        if (base == MAP_FAILED) {
+            err_code_ = SQLITE_CANTOPEN;
+            return false;
+        }
+        base_ = static_cast<const char*>(base);
+        size_ = static_cast<size_t>(st.st_size);
+
+        err_code_ = Validate();
+        if (err_code_ != SQLITE_OK) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close()
+    {
+        if (base_ != nullptr) {
+            ::munmap(const_cast<char*>(base_), size_);
+            base_ = nullptr;
+            size_ = 0;
+            header_ = nullptr;
+        }
+    }
+
+    uint64_t Rows() const
+    {
+        return header_->rows;
+    }
+
+    size_t Columns() const
+    {
+        return header_->columns;
+    }
+
+    size_t Chunks() const
+    {
+        return static_cast<size_t>(header_->chunks);
+    }
+
+    // 第chunk块的行数，只有最后一块可能不满
+    size_t ChunkRows(size_t chunk) const
+    {
+        uint64_t first = static_cast<uint64_t>(chunk) * header_->chunk_rows;
+        return static_cast<size_t>(std::min<uint64_t>(header_->chunk_rows, header_->rows - first));
+    }
+
+    SqliteTextView ColumnName(size_t column) const
+    {
+        const ColumnFileColumn& desc = columns_[column];
+        return SqliteTextView{base_ + desc.name, static_cast<int>(desc.name_size)};
+    }
+
+    ColumnKind Kind(size_t column) const
+    {
+        return static_cast<ColumnKind>(columns_[column].kind);
+    }
+
+    // 按名称查找列，没有时返回-1
+    int FindColumn(const std::string& name) const
+    {
+        for (size_t i = 0; i < Columns(); i++) {
+            SqliteTextView n = ColumnName(i);
+            if (name.size() == static_cast<size_t>(n.size) && name.compare(0, name.size(), n.data, n.size) == 0) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    ColumnSpan<int64_t> Int64Column(size_t chunk, size_t column) const
+    {
+        const ColumnFileChunk& c = Chunk(chunk, column, ColumnKind::Int64);
+        return ColumnSpan<int64_t>{At<int64_t>(c.values), ChunkRows(chunk), Validity(c)};
+    }
+
+    ColumnSpan<double> DoubleColumn(size_t chunk, size_t column) const
+    {
+        const ColumnFileChunk& c = Chunk(chunk, column, ColumnKind::Double);
+        return ColumnSpan<double>{At<double>(c.values), ChunkRows(chunk), Validity(c)};
+    }
+
+    StringColumnSpan StringColumn(size_t chunk, size_t column) const
+    {
+        const ColumnFileChunk& c = Chunk(chunk, column, ColumnKind::String);
+        return StringColumnSpan{ColumnSpan<uint32_t>{At<uint32_t>(c.values), ChunkRows(chunk), Validity(c)},
+            At<uint64_t>(c.offsets), base_ + c.data, c.dict_size, c.data_size};
+    }
+
+    BlobColumnSpan BlobColumn(size_t chunk, size_t column) const
+    {
+        const ColumnFileChunk& c = Chunk(chunk, column, ColumnKind::Blob);
+        return BlobColumnSpan{At<uint64_t>(c.offsets), base_ + c.data, ChunkRows(chunk), Validity(c), c.data_size};
+    }
+
+    bool Valid() const
+    {
+        return base_ != nullptr;
+    }
+
+    /**
+     * @brief: 获取最近一次错误代码
+     * @return: 返回最近一次错误代码
+     */
+    int GetLastErrCode() const
+    {
+        return err_code_;
+    }
+
+private:
+    // 禁止复制和赋值
+    ColumnFile(const ColumnFile&) = delete;
+    ColumnFile& operator=(const ColumnFile&) = delete;
+
+    template<typename T>
+    const T* At(uint64_t offset) const
+    {
+        return reinterpret_cast<const T*>(base_ + offset);
+    }
+
+    const uint8_t* Validity(const ColumnFileChunk& c) const
+    {
+        return c.validity != 0 ? At<uint8_t>(c.validity) : nullptr;
+    }
+
+    const ColumnFileChunk& Chunk(size_t chunk, size_t column, ColumnKind kind) const
+    {
+        if (chunk >= Chunks() || column >= Columns()) {
+            throw std::out_of_range("column file chunk or column out of range");
+        }
+        if (Kind(column) != kind) {
+            throw std::invalid_argument("column file column kind mismatch");
+        }
+        return chunks_[chunk * Columns() + column];
+    }
+
+    // 缓冲区[offset, offset + size)在文件内，typed为true时还要求8字节对齐
+    bool InFile(uint64_t offset, uint64_t size, bool typed = true) const
+    {
+        return offset <= size_ && size <= size_ - offset && (!typed || offset % 8 == 0);
+    }
+
+    // 检查文件头、目录以及每个缓冲区的起止位置，字符串和blob列还检查偏移数组的最后一项与数据大小一致。
+    // 每行的编码和中间的偏移不在这里检查
+    int Validate()
+    {
+        header_ = At<ColumnFileHeader>(0);
+        if (std::memcmp(header_->magic, "SDBC", 4) != 0 || header_->version != kColumnFileVersion) {
+            return SQLITE_NOTADB;
+        }
+
+        uint64_t columns = header_->columns;
+        uint64_t chunks = header_->chunks;
+        uint64_t rows = header_->rows;
+        uint64_t chunk_rows = header_->chunk_rows;
+        if (chunk_rows == 0 && rows != 0) {
+            return SQLITE_CORRUPT;
+        }
+
+        // 块数由行数决定，且与列数无关地受文件大小限制，避免没有列时按任意大的块数遍历
+        uint64_t expected = chunk_rows == 0 ? 0 : rows / chunk_rows + (rows % chunk_rows != 0 ? 1 : 0);
+        if (columns > (1u << 20) || chunks != expected
+            || chunks > size_ / sizeof(ColumnFileChunk) / std::max<uint64_t>(columns, 1)
+            || !InFile(header_->footer, columns * sizeof(ColumnFileColumn) + columns * chunks * sizeof(ColumnFileChunk))) {
+            return SQLITE_CORRUPT;
+        }
+        columns_ = At<ColumnFileColumn>(header_->footer);
+        chunks_ = At<ColumnFileChunk>(header_->footer + columns * sizeof(ColumnFileColumn));
+
+        for (uint64_t i = 0; i < columns; i++) {
+            if (columns_[i].kind < 1 || columns_[i].kind > 4 || !InFile(columns_[i].name, columns_[i].name_size, false)) {
+                return SQLITE_CORRUPT;
+            }
+        }
+
+        for (uint64_t chunk = 0; chunk < chunks; chunk++) {
+            uint64_t n = ChunkRows(static_cast<size_t>(chunk));
+            for (uint64_t i = 0; i < columns; i++) {
+                const ColumnFileChunk& c = chunks_[chunk * columns + i];
+                if (c.validity != 0 && !InFile(c.validity, (n + 7) / 8, false)) {
+                    return SQLITE_CORRUPT;
+                }
+
+                bool ok = true;
+                switch (static_cast<ColumnKind>(columns_[i].kind)) {
+                case ColumnKind::Int64:
+                case ColumnKind::Double:
+                    ok = InFile(c.values, n * 8);
+                    break;
+                case ColumnKind::String:
+                    ok = InFile(c.values, n * 4) && InFile(c.offsets, (c.dict_size + 1ULL) * 8)
+                        && InFile(c.data, c.data_size, false) && At<uint64_t>(c.offsets)[c.dict_size] == c.data_size;
+                    break;
+                case ColumnKind::Blob:
+                    ok = InFile(c.offsets, (n + 1) * 8) && InFile(c.data, c.data_size, false)
+                        && At<uint64_t>(c.offsets)[n] == c.data_size;
+                    break;
+                }
+                if (!ok) {
+                    return SQLITE_CORRUPT;
+                }
+            }
+        }
+        return SQLITE_OK;
+    }
+
+private:
+    const char* base_;      // 映射的起始地址
+    size_t      size_;
+    const ColumnFileHeader* header_;
+    const ColumnFileColumn* columns_;
+    const ColumnFileChunk*  chunks_;
+    int err_code_;
+};
+
+}
+#endif // SMART_DB_COLUMN_H_
@@ -0,0 +1,307 @@
+/**
+ * desc: smartdb sqlite 连接池
+ * file: smartdb_pool.h
+ *
+ * author:  myw31415926
+ * date:    20190422
+ * version: V0.1
+ *
+ * the closer you look, the less you see
+ */
+
+#ifndef SMART_DB_POOL_H_
+#define SMART_DB_POOL_H_
+
+#include "smartdb_sqlite.h"
+
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <vector>
+#include <string>
+#include <thread>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace smartdb {
+
+// sqlite连接池。连接以SQLITE_OPEN_NOMUTEX打开，sqlite内部不再加锁，由连接池保证同一时刻只有一个线程使用一个连接
+// 默认使用SmartDBOptions::Balanced()，数据库为WAL模式，读不阻塞写，多个读连接可以并发执行；
+// 写操作仍然是串行的，通过busy timeout等待写锁
+// 每个连接有自己的预编译语句缓存，连接归还后缓存保留，下次借出时继续使用
+// 线程优先借出上一次使用的连接（线程亲和），该连接的语句缓存和页缓存都是热的
+class SmartDBPool
+{
+    // 连接槽，busy表示已借出。填充到一个cache line大小，避免相邻连接借出时的伪共享
+    struct Slot
+    {
+        Slot() : busy(false) {}
+
+        std::unique_ptr<SmartDBSqlite> db;
+        std::atomic<bool> busy;
+        char padding[64 - sizeof(std::unique_ptr<SmartDBSqlite>) - sizeof(std::atomic<bool>)];
+    };
+
+public:
+    // 借出的连接，析构时自动归还。只能移动，不能复制
+    class Connection
+    {
+    public:
+        Connection() : pool_(nullptr), index_(0) {}
+
+        Connection(Connection&& other) noexcept : pool_(other.pool_), index_(other.index_)
+        {
+            other.pool_ = nullptr;
+        }
+
+        Connection& operator=(Connection&& other) noexcept
+        {
+            if (this != &other) {
+                Release();
+                pool_ = other.pool_;
+                index_ = other.index_;
+                other.pool_ = nullptr;
+            }
+            return *this;
+        }
+
+        ~Connection()
+        {
+            Release();
+        }
+
+        SmartDBSqlite* operator->() const { return pool_->slots_[index_].db.get(); }
+        SmartDBSqlite& operator*() const { return *pool_->slots_[index_].db; }
+
+        explicit operator bool() const
+        {
+            return pool_ != nullptr;
+        }
+
+        // 提前归还连接
+        void Release()
+        {
+            if (pool_ != nullptr) {
+                pool_->Release(index_);
+                pool_ = nullptr;
+            }
+        }
+
+    private:
+        friend class SmartDBPool;
+
+        Connection(SmartDBPool* pool, size_t index) : pool_(pool), index_(index) {}
+
+        // 禁止复制和赋值
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+
+    private:
+        SmartDBPool* pool_;
+        size_t       index_;
+    };
+
+    SmartDBPool() : id_(NextId()), slots_(nullptr), size_(0), waiters_(0), err_code_(SQLITE_OK) {}
+
+    // 析构时不能抛出异常：仍有借出的连接属于使用错误，输出错误信息后照常关闭
+    virtual ~SmartDBPool()
+    {
+        if (!CloseIdle()) {
+            std::cerr << "connection pool destroyed with connections still in use" << std::endl;
+            assert(false);
+            slots_.reset();
+            size_ = 0;
+        }
+    }
+
+    /**
+     * @brief: 打开size个数据库连接，每个连接设置相同的参数
+     * @param[in] db_name: 数据库名称，不存在时创建
+     * @param[in] size: 连接数，一般与并发的线程数相同
+     * @param[in] options: 连接参数，并发读需要WAL模式
+     * @return: 成功返回true; 失败返回false，已打开的连接被关闭
+     */
+    bool Open(const std::string& db_name, size_t size, const SmartDBOptions& options = SmartDBOptions::Balanced())
+    {
+        if (size == 0) {
+            throw std::invalid_argument("connection pool size must be greater than 0");
+        }
+        Close();
+
+        slots_.reset(new Slot[size]);
+        size_ = size;
+        for (size_t i = 0; i < size_; i++) {
+            Slot& slot = slots_[i];
+            slot.db.reset(new SmartDBSqlite());
+            if (!slot.db->Open(db_name, options, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX)) {
+                err_code_ = slot.db->GetLastErrCode();
+                Close();
+                return false;
+            }
+        }
+
+        err_code_ = SQLITE_OK;
+        return true;
+    }
+
+    /**
+     * @brief: 关闭全部连接，此时不能有借出的连接
+     */
+    void Close()
+    {
+        if (!CloseIdle()) {
+            throw std::logic_error("connection pool closed with connections still in use");
+        }
+    }
+
+    /**
+     * @brief: 借出一个连接，优先借出本线程上一次使用的连接，全部连接都在使用时等待
+     * @return: 返回借出的连接，析构时归还
+     */
+    Connection Acquire()
+    {
+        if (size_ == 0) {
+            throw std::logic_error("connection pool is not opened");
+        }
+
+        // 快速路径：本线程上次使用的连接
+        size_t& hint = Affinity();
+        if (hint < size_ && TryAcquire(hint)) {
+            return Connection(this, hint);
+        }
+
+        // 从hint开始扫描空闲连接，全部借出时等待归还
+        size_t start = hint < size_ ? hint : 0;
+        std::unique_lock<std::mutex> locker(mtx_);
+        waiters_.fetch_add(1);
+        while (true) {
+            for (size_t n = 0; n < size_; n++) {
+                size_t index = (start + n) % size_;
+                if (TryAcquire(index)) {
+                    waiters_.fetch_sub(1);
+                    hint = index;
+                    return Connection(this, index);
+                }
+            }
+            not_busy_.wait(locker);
+        }
+    }
+
+    /**
+     * @brief: 运行时切换全部连接的参数，调用时不能有借出的连接
+     *         WAL不能在还有其他连接时切换到其他日志模式，连接池内切换时options的journal_mode应为空或WAL
+     * @return: 成功返回true; 失败返回false
+     */
+    bool ApplyOptions(const SmartDBOptions& options)
+    {
+        for (size_t i = 0; i < size_; i++) {
+            if (!slots_[i].db->ApplyOptions(options)) {
+                err_code_ = slots_[i].db->GetLastErrCode();
+                return false;
+            }
+        }
+        err_code_ = SQLITE_OK;
+        return true;
+    }
+
+    /**
+     * @brief: 对每个连接执行func，例如设置语句缓存大小，调用时不能有借出的连接
+     */
+    template<typename Func>
+    void ForEach(Func&& func)
+    {
+        for (size_t i = 0; i < size_; i++) {
+            func(*slots_[i].db);
+        }
+    }
+
+    // 连接数
+    size_t Size() const
+    {
+        return size_;
+    }
+
+    /**
+     * @brief: 获取最近一次错误代码
+     * @return: 返回最近一次错误代码
+     */
+    int GetLastErrCode() const
+    {
+        return err_code_;
+    }
+
+private:
+    // 禁止复制和赋值
+    SmartDBPool(const SmartDBPool&) = delete;
+    SmartDBPool& operator=(const SmartDBPool&) = delete;
+
+    // 没有借出的连接时关闭全部连接，否则返回false，不做修改
+    bool CloseIdle()
+    {
+        for (size_t i = 0; i < size_; i++) {
+            if (slots_[i].busy.load(std::memory_order_acquire)) {
+                return false;
+            }
+        }
+        slots_.reset();
+        size_ = 0;
+        return true;
+    }
+
+    // 先读再CAS，减少竞争时的缓存行写入。读取也必须是seq_cst，与Release中的store和waiters_构成全序，
+    // 否则等待者可能读到旧的busy值后进入等待，错过归还时的唤醒
+    bool TryAcquire(size_t index)
+    {
+        bool expected = false;
+        return !slots_[index].busy.load()
+            && slots_[index].busy.compare_exchange_strong(expected, true);
+    }
+
+    // 归还连接。先释放连接再检查等待者，与Acquire中先登记等待者再扫描的顺序配合，不会丢失唤醒
+    void Release(size_t index)
+    {
+        slots_[index].busy.store(false);
+        if (waiters_.load() > 0) {
+            std::lock_guard<std::mutex> locker(mtx_);
+            not_busy_.notify_one();
+        }
+    }
+
+    // 本线程在这个连接池上次使用的连接
+    size_t& Affinity()
+    {
+        static thread_local std::unordered_map<uint64_t, size_t> affinity;
+        auto it = affinity.find(id_);
+        if (it == affinity.end()) {
+            // 第一次使用时按线程id分散到不同的连接
+            size_t index = std::hash<std::thread::id>()(std::this_thread::get_id()) % size_;
+            it = affinity.emplace(id_, index).first;
+        }
+        return it->second;
+    }
+
+    // 连接池的唯一id，避免连接池析构后地址被复用导致线程亲和错乱
+    static uint64_t NextId()
+    {
+        static std::atomic<uint64_t> id{0};
+        return ++id;
+    }
+
+private:
+    const uint64_t id_;
+    std::unique_ptr<Slot[]> slots_;
+    size_t size_;
+
+    std::mutex              mtx_;
+    std::condition_variable not_busy_;
+    std::atomic<int>        waiters_;   // 等待空闲连接的线程数
+
+    int err_code_;
+};
+
+}
+#endif // SMART_DB_POOL_H_
@@ -0,0 +1,114 @@
+/**
+ * desc: smartdb 结构体反射宏，生成表名、列名和按成员访问的代码，用于ORM映射
+ * file: smartdb_reflect.h
+ *
+ * author:  myw31415926
+ * date:    20190429
+ * version: V0.1
+ *
+ * the closer you look, the less you see
+ */
+
+#ifndef SMART_DB_REFLECT_H_
+#define SMART_DB_REFLECT_H_
+
+#include <cstddef>
+
+namespace smartdb {
+
+// 结构体的反射信息，由SMARTDB_REFLECT特化：
+//   Table():   表名
+//   Columns(): 列名，与成员的顺序相同
+//   kSize:     列数
+//   Visit(t, visitor): 按顺序对每个成员调用visitor(member, index)，编译期展开，没有运行时的类型分发
+template<typename T>
+struct Reflection;
+
+template<typename Row>
+struct RowReader;
+
+}
+
+// 参数个数，最多32个
+#define SMARTDB_EXPAND(x) x
+#define SMARTDB_CONCAT(a, b) SMARTDB_CONCAT_(a, b)
+#define SMARTDB_CONCAT_(a, b) a##b
+#define SMARTDB_ARG_COUNT(...) SMARTDB_EXPAND(SMARTDB_ARG_N(__VA_ARGS__, 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1))
+#define SMARTDB_ARG_N(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, N, ...) N
+
+// 对每个参数展开M(x)
+#define SMARTDB_FOR_EACH(M, ...) \
+    SMARTDB_EXPAND(SMARTDB_CONCAT(SMARTDB_FOR_EACH_, SMARTDB_ARG_COUNT(__VA_ARGS__))(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_1(M, x) M(x)
+#define SMARTDB_FOR_EACH_2(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_1(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_3(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_2(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_4(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_3(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_5(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_4(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_6(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_5(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_7(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_6(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_8(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_7(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_9(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_8(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_10(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_9(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_11(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_10(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_12(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_11(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_13(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_12(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_14(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_13(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_15(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_14(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_16(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_15(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_17(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_16(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_18(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_17(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_19(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_18(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_20(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_19(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_21(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_20(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_22(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_21(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_23(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_22(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_24(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_23(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_25(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_24(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_26(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_25(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_27(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_26(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_28(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_27(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_29(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_28(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_30(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_29(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_31(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_30(M, __VA_ARGS__))
+#define SMARTDB_FOR_EACH_32(M, x, ...) M(x) SMARTDB_EXPAND(SMARTDB_FOR_EACH_31(M, __VA_ARGS__))
+
+#define SMARTDB_REFLECT_NAME(field) #field,
+#define SMARTDB_REFLECT_VISIT(field) visitor(t.field, index++);
+
+// 注册结构体的成员，表名为结构体名，列名为成员名。必须在全局命名空间中使用，结构体需要可以默认构造
+// 第一个成员作为主键，Update按主键更新
+//   struct Person { int ID; std::string Name; std::string Address; };
+//   SMARTDB_REFLECT(Person, ID, Name, Address)
+#define SMARTDB_REFLECT(Type, ...) SMARTDB_REFLECT_TABLE(Type, #Type, __VA_ARGS__)
+
+// 指定表名，用于带命名空间的结构体或者表名与结构体名不同的情况
+#define SMARTDB_REFLECT_TABLE(Type, TableName, ...) \
+namespace smartdb { \
+template<> \
+struct Reflection<Type> \
+{ \
+    enum { kSize = SMARTDB_ARG_COUNT(__VA_ARGS__) }; \
+    static const char* Table() { return TableName; } \
+    static const char* const* Columns() \
+    { \
+        static const char* const columns[] = { SMARTDB_FOR_EACH(SMARTDB_REFLECT_NAME, __VA_ARGS__) }; \
+        return columns; \
+    } \
+    template<typename T, typename Visitor> \
+    static void Visit(T& t, Visitor&& visitor) \
+    { \
+        int index = 0; \
+        SMARTDB_FOR_EACH(SMARTDB_REFLECT_VISIT, __VA_ARGS__) \
+    } \
+}; \
+template<> \
+struct RowReader<Type> \
+{ \
+    static void Read(sqlite3_stmt* stmt, Type& t) \
+    { \
+        Reflection<Type>::Visit(t, MemberReader{stmt}); \
+    } \
+}; \
+}
+
+#endif // SMART_DB_REFLECT_H_
@@ -0,0 +1,505 @@
+/**
+ * desc: smartdb sqlite 按rowid分区的并行扫描和聚合
+ * file: smartdb_scan.h
+ *
+ * author:  myw31415926
+ * date:    20190508
+ * version: V0.1
+ *
+ * the closer you look, the less you see
+ */
+
+#ifndef SMART_DB_SCAN_H_
+#define SMART_DB_SCAN_H_
+
+#include "smartdb_sqlite.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+
+namespace smartdb {
+
+// 聚合函数
+enum class AggregateFunc
+{
+    Count,  // count(expr)，expr为"*"时统计行数
+    Sum,    // sum(expr)，全部为整数时结果为整数
+    Min,    // min(expr)
+    Max,    // max(expr)
+};
+
+// 一个聚合项，例如 {AggregateFunc::Sum, "Salary"}
+struct ScanAggregate
+{
+    AggregateFunc func;
+    std::string   expr;
+};
+
+// 扫描结果中的一个值，type为SQLITE_INTEGER、SQLITE_FLOAT、SQLITE_TEXT、SQLITE_BLOB或SQLITE_NULL
+struct ScanValue
+{
+    int           type;
+    sqlite3_int64 i;
+    double        d;
+    std::string   str;      // TEXT和BLOB
+
+    bool IsNull() const
+    {
+        return type == SQLITE_NULL;
+    }
+
+    double AsDouble() const
+    {
+        return type == SQLITE_INTEGER ? static_cast<double>(i) : d;
+    }
+};
+
+// 扫描结果的一行，按SQL结果列的顺序保存，Aggregate的结果为分组列在前，聚合项在后
+struct ScanRow
+{
+    std::vector<ScanValue> values;
+};
+
+// 按结果的实际列数读取一行，string的容量逐行复用
+template<>
+struct RowReader<ScanRow>
+{
+    static void Read(sqlite3_stmt* stmt, ScanRow& row)
+    {
+        int columns = sqlite3_column_count(stmt);
+        row.values.resize(columns);
+        for (int index = 0; index < columns; index++) {
+            ScanValue& v = row.values[index];
+            v.type = sqlite3_column_type(stmt, index);
+            switch (v.type) {
+            case SQLITE_INTEGER:
+                v.i = sqlite3_column_int64(stmt, index);
+                break;
+            case SQLITE_FLOAT:
+                v.d = sqlite3_column_double(stmt, index);
+                break;
+            case SQLITE_TEXT:
+                ColumnReader<std::string>::Read(stmt, index, v.str);
+                break;
+            case SQLITE_BLOB: {
+                const char* blob = static_cast<const char*>(sqlite3_column_blob(stmt, index));
+                v.str.assign(blob != nullptr ? blob : "", sqlite3_column_bytes(stmt, index));
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+};
+
+// 分区并行扫描。sqlite的一条查询只在一个线程中执行，大表的聚合无法利用多核
+// 按rowid把表划分为多个区间，每个连接在线程池中依次领取区间执行，连接数即并发数；
+// 区间数为连接数的若干倍，某个区间的行较多（rowid不连续）时其他连接可以多领取几个区间，负载更均衡
+// 区间按rowid的最小值和最大值等分，不按行数划分：rowid极不均匀时（例如只有一行的rowid为2^62），
+// 几乎全部行落在第一个区间，退化为单个连接扫描
+// 连接以只读和SQLITE_OPEN_NOMUTEX打开，数据库应为WAL模式，扫描不阻塞写入，但各区间不在同一个快照中，
+// 扫描期间有写入时结果可能不一致。不支持WITHOUT ROWID表
+class SmartDBScanner
+{
+public:
+    SmartDBScanner() : partitions_per_conn_(0), err_code_(SQLITE_OK) {}
+
+    virtual ~SmartDBScanner()
+    {
+        Close();
+    }
+
+    // 扫描连接的默认参数：只读连接不设置日志模式和同步方式，加大页缓存并使用mmap
+    static SmartDBOptions ScanOptions()
+    {
+        SmartDBOptions options = SmartDBOptions::Balanced();
+        options.journal_mode.clear();
+        options.synchronous.clear();
+        return options;
+    }
+
+    /**
+     * @brief: 打开connections个只读连接，启动同样数量的工作线程
+     * @param[in] db_name: 数据库名称
+     * @param[in] connections: 连接数，一般与CPU核数相同
+     * @param[in] partitions_per_conn: 每个连接平均分到的区间数
+     * @param[in] options: 连接参数
+     * @return: 成功返回true; 失败返回false，已打开的连接被关闭
+     */
+    bool Open(const std::string& db_name, size_t connections, size_t partitions_per_conn = 4,
+        const SmartDBOptions& options = ScanOptions())
+    {
+        if (connections == 0 || partitions_per_conn == 0) {
+            throw std::invalid_argument("scanner connections and partitions must be greater than 0");
+        }
+        Close();
+
+        for (size_t i = 0; i < connections; i++) {
+            std::unique_ptr<SmartDBSqlite> db(new SmartDBSqlite());
+            if (!db->Open(db_name, options, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX)) {
+                err_code_ = db->GetLastErrCode();
+                Close();
+                return false;
+            }
+            dbs_.push_back(std::move(db));
+        }
+
+        partitions_per_conn_ = partitions_per_conn;
+        pool_.reset(new util::ThreadPool(static_cast<int>(connections)));
+        err_code_ = SQLITE_OK;
+        return true;
+    }
+
+    /**
+     * @brief: 停止工作线程，关闭全部连接
+     */
+    void Close()
+    {
+        pool_.reset();
+        dbs_.clear();
+    }
+
+    /**
+     * @brief: 把表按rowid划分为多个区间，在工作线程中对每个区间调用func，调用者等待全部区间完成
+     *         func在多个线程中同时执行，只能访问传入的连接和自己的区间
+     * @param[in] table: 表名
+     * @param[in] func: R func(SmartDBSqlite& db, sqlite3_int64 first, sqlite3_int64 last)，
+     *                  区间为 first <= rowid <= last，SQL中一般写作 rowid BETWEEN ? AND ?
+     * @return: 每个区间的结果，按rowid从小到大排列，表为空时没有区间；func抛出的异常重新抛出
+     */
+    template<typename Func>
+    auto ScanPartitions(const std::string& table, Func&& func)
+        -> std::vector<typename std::result_of<Func(SmartDBSqlite&, sqlite3_int64, sqlite3_int64)>::type>
+    {
+        using R = typename std::result_of<Func(SmartDBSqlite&, sqlite3_int64, sqlite3_int64)>::type;
+        static_assert(!std::is_same<R, bool>::value, "std::vector<bool> can not be written concurrently");
+        if (dbs_.empty()) {
+            throw std::logic_error("scanner is not opened");
+        }
+
+        std::vector<Range> ranges = Split(table);
+        std::vector<R> results(ranges.size());
+        std::atomic<size_t> next(0);
+
+        std::vector<std::future<void>> futures;
+        futures.reserve(dbs_.size());
+        for (size_t i = 0; i < dbs_.size() && i < ranges.size(); i++) {
+            SmartDBSqlite* db = dbs_[i].get();
+            std::packaged_task<void()> task([&, db] {
+                try {
+                    size_t p;
+                    while ((p = next.fetch_add(1)) < ranges.size()) {
+                        results[p] = func(*db, ranges[p].first, ranges[p].last);
+                    }
+                } catch (...) {
+                    next = ranges.size();   // 出错后其他连接不再领取新的区间
+                    throw;
+                }
+            });
+            futures.push_back(task.get_future());
+            pool_->AddTask(std::move(task));
+        }
+
+        // 先等待全部任务结束，任务引用了本函数的局部变量
+        for (auto& future : futures) {
+            future.wait();
+        }
+        for (auto& future : futures) {
+            future.get();
+        }
+        return results;
+    }
+
+    /**
+     * @brief: 并行聚合，相当于
+     *         SELECT group_by, aggregates... FROM table WHERE (where) GROUP BY group_by
+     *         每个区间在sqlite中聚合，部分结果在C++中合并：count和sum相加，min和max比较，分组按分组列的值合并
+     *         整数sum合并时溢出与sqlite的sum一样报错，抛出std::logic_error
+     * @param[in] table: 表名
+     * @param[in] aggregates: 聚合项
+     * @param[in] group_by: 分组列，多个列用逗号分隔，为空时不分组
+     * @param[in] where: 过滤条件，为空时不过滤
+     * @return: 分组列在前，聚合项在后；按分组列排序，不分组时只有一行
+     */
+    std::vector<ScanRow> Aggregate(const std::string& table, const std::vector<ScanAggregate>& aggregates,
+        const std::string& group_by = "", const std::string& where = "")
+    {
+        if (aggregates.empty()) {
+            throw std::invalid_argument("aggregate list is empty");
+        }
+
+        std::string sql = AggregateSql(table, aggregates, group_by, where);
+        auto partials = ScanPartitions(table, [&sql](SmartDBSqlite& db, sqlite3_int64 first, sqlite3_int64 last) {
+            std::vector<ScanRow> rows;
+            auto cursor = db.QueryCursor<ScanRow>(sql, first, last);
+            for (auto& row : cursor) {
+                rows.push_back(row);
+            }
+            if (cursor.GetLastErrCode() != SQLITE_DONE) {
+                throw std::logic_error("partition scan error: " + std::to_string(cursor.GetLastErrCode()));
+            }
+            return rows;
+        });
+
+        std::vector<ScanRow> merged;
+        std::unordered_map<std::string, size_t> groups;     // 分组列的编码 -> merged中的位置
+        std::string key;
+        for (auto& rows : partials) {
+            for (auto& row : rows) {
+                size_t keys = row.values.size() - aggregates.size();
+                key.clear();
+                for (size_t k = 0; k < keys; k++) {
+                    AppendKey(key, row.values[k]);
+                }
+
+                auto it = groups.find(key);
+                if (it == groups.end()) {
+                    groups.emplace(key, merged.size());
+                    merged.push_back(std::move(row));
+                    continue;
+                }
+
+                ScanRow& target = merged[it->second];
+                for (size_t a = 0; a < aggregates.size(); a++) {
+                    Merge(aggregates[a].func, target.values[keys + a], row.values[keys + a]);
+                }
+            }
+        }
+
+        if (group_by.empty() && merged.empty()) {
+            // 空表：count为0，其他为NULL，与sqlite一致
+            ScanRow row;
+            for (auto& aggregate : aggregates) {
+                bool count = aggregate.func == AggregateFunc::Count;
+                row.values.push_back(ScanValue{count ? SQLITE_INTEGER : SQLITE_NULL, 0, 0, std::string()});
+            }
+            merged.push_back(std::move(row));
+        }
+
+        size_t keys = merged.empty() ? 0 : merged[0].values.size() - aggregates.size();
+        std::sort(merged.begin(), merged.end(), [keys](const ScanRow& a, const ScanRow& b) {
+            for (size_t k = 0; k < keys; k++) {
+                int ret = Compare(a.values[k], b.values[k]);
+                if (ret != 0) {
+                    return ret < 0;
+                }
+            }
+            return false;
+        });
+        return merged;
+    }
+
+    // 连接数
+    size_t Size() const
+    {
+        return dbs_.size();
+    }
+
+    /**
+     * @brief: 获取最近一次错误代码
+     * @return: 返回最近一次错误代码
+     */
+    int GetLastErrCode() const
+    {
+        return err_code_;
+    }
+
+private:
+    // rowid区间，first <= rowid <= last
+    struct Range
+    {
+        sqlite3_int64 first;
+        sqlite3_int64 last;
+    };
+
+    // 禁止复制和赋值
+    SmartDBScanner(const SmartDBScanner&) = delete;
+    SmartDBScanner& operator=(const SmartDBScanner&) = delete;
+
+    // 按rowid的最小值和最大值等分区间，min和max走rowid索引，不扫描表
+    std::vector<Range> Split(const std::string& table)
+    {
+        SmartDBSqlite& db = *dbs_[0];
+        sqlite3_int64 first = db.ExcecuteScalar<sqlite3_int64>("SELECT coalesce(min(rowid), 0) FROM " + table + ";");
+        sqlite3_int64 last = db.ExcecuteScalar<sqlite3_int64>("SELECT coalesce(max(rowid), -1) FROM " + table + ";");
+        err_code_ = db.GetLastErrCode();
+        if (err_code_ != SQLITE_ROW) {
+            throw std::logic_error("scan table " + table + " error: " + std::to_string(err_code_));
+        }
+
+        std::vector<Range> ranges;
+        if (last < first) {
+            return ranges;
+        }
+
+        // 无符号运算，rowid跨度超过int64范围时不溢出
+        uint64_t span = static_cast<uint64_t>(last) - static_cast<uint64_t>(first);
+        uint64_t count = dbs_.size() * partitions_per_conn_;
+        count = span < count ? span + 1 : count;
+        uint64_t step = span / count;
+        uint64_t extra = span % count + 1;  // 前extra个区间多一个rowid
+        uint64_t begin = static_cast<uint64_t>(first);
+        for (uint64_t p = 0; p < count; p++) {
+            uint64_t size = step + (p < extra ? 1 : 0);
+            ranges.push_back(Range{static_cast<sqlite3_int64>(begin), static_cast<sqlite3_int64>(begin + size - 1)});
+            begin += size;
+        }
+        return ranges;
+    }
+
+    static std::string AggregateSql(const std::string& table, const std::vector<ScanAggregate>& aggregates,
+        const std::string& group_by, const std::string& where)
+    {
+        static const char* const names[] = { "count", "sum", "min", "max" };
+
+        std::string sql = "SELECT ";
+        if (!group_by.empty()) {
+            sql += group_by + ", ";
+        }
+        for (size_t i = 0; i < aggregates.size(); i++) {
+            sql += i == 0 ? "" : ", ";
+            sql += std::string(names[static_cast<int>(aggregates[i].func)]) + "(" + aggregates[i].expr + ")";
+        }
+        sql += " FROM " + table + " WHERE rowid BETWEEN ? AND ?";
+        if (!where.empty()) {
+            sql += " AND (" + where + ")";
+        }
+        if (!group_by.empty()) {
+            sql += " GROUP BY " + group_by;
+        }
+        return sql + ";";
+    }
+
+    // 合并两个部分聚合结果，NULL表示该区间没有非NULL的值
+    static void Merge(AggregateFunc func, ScanValue& target, ScanValue& value)
+    {
+        if (value.IsNull()) {
+            return;
+        }
+        if (target.IsNull()) {
+            target = std::move(value);
+            return;
+        }
+
+        switch (func) {
+        case AggregateFunc::Count:
+            target.i = AddInteger(target.i, value.i);
+            break;
+        case AggregateFunc::Sum:
+            if (target.type == SQLITE_INTEGER && value.type == SQLITE_INTEGER) {
+                target.i = AddInteger(target.i, value.i);
+            } else {
+                target.d = target.AsDouble() + value.AsDouble();
+                target.type = SQLITE_FLOAT;
+            }
+            break;
+        case AggregateFunc::Min:
+            if (Compare(value, target) < 0) {
+                target = std::move(value);
+            }
+            break;
+        case AggregateFunc::Max:
+            if (Compare(value, target) > 0) {
+                target = std::move(value);
+            }
+            break;
+        }
+    }
+
+    // 整数相加，溢出时与sqlite的sum一样报错
+    static sqlite3_int64 AddInteger(sqlite3_int64 a, sqlite3_int64 b)
+    {
+        sqlite3_int64 sum;
+        if (__builtin_add_overflow(a, b, &sum)) {
+            throw std::logic_error("integer overflow");
+        }
+        return sum;
+    }
+
+    // 按sqlite的规则比较：NULL < 数值 < TEXT < BLOB，TEXT和BLOB按字节比较（BINARY排序规则）
+    static int Compare(const ScanValue& a, const ScanValue& b)
+    {
+        int ra = Rank(a.type);
+        int rb = Rank(b.type);
+        if (ra != rb) {
+            return ra < rb ? -1 : 1;
+        }
+
+        switch (ra) {
+        case 0:
+            return 0;
+        case 1:
+            if (a.type == SQLITE_INTEGER && b.type == SQLITE_INTEGER) {
+                return a.i < b.i ? -1 : (a.i > b.i ? 1 : 0);
+            }
+            return a.AsDouble() < b.AsDouble() ? -1 : (a.AsDouble() > b.AsDouble() ? 1 : 0);
+        default:
+            return a.str.compare(b.str);
+        }
+    }
+
+    static int Rank(int type)
+    {
+        switch (type) {
+        case SQLITE_NULL:
+            return 0;
+        case SQLITE_INTEGER:
+        case SQLITE_FLOAT:
+            return 1;
+        case SQLITE_TEXT:
+            return 2;
+        default:
+            return 3;
+        }
+    }
+
+    // 分组列编码为key。与sqlite的GROUP BY一致，值为整数的浮点数与整数属于同一组
+    static void AppendKey(std::string& key, const ScanValue& v)
+    {
+        int type = v.type;
+        sqlite3_int64 i = v.i;
+        if (type == SQLITE_FLOAT && v.d >= -9.2e18 && v.d <= 9.2e18 && static_cast<double>(
+            static_cast<sqlite3_int64>(v.d)) == v.d) {
+            type = SQLITE_INTEGER;
+            i = static_cast<sqlite3_int64>(v.d);
+        }
+
+        key += static_cast<char>(type);
+        switch (type) {
+        case SQLITE_INTEGER:
+            key.append(reinterpret_cast<const char*>(&i), sizeof(i));
+            break;
+        case SQLITE_FLOAT:
+            key.append(reinterpret_cast<const char*>(&v.d), sizeof(v.d));
+            break;
+        case SQLITE_TEXT:
+        case SQLITE_BLOB: {
+            uint32_t size = static_cast<uint32_t>(v.str.size());
+            key.append(reinterpret_cast<const char*>(&size), sizeof(size));
+            key += v.str;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<SmartDBSqlite>> dbs_;
+    std::unique_ptr<util::ThreadPool> pool_;    // 工作线程数与连接数相同
+    size_t partitions_per_conn_;
+    int    err_code_;
+};
+
+}
+#endif // SMART_DB_SCAN_H_
@@ -13,6 +13,8 @@
 #define SMART_DB_SQLITE_H_
 
 #include "variant.h"
+#include "smartdb_reflect.h"
+#include "smartdb_cache.h"
 
 #include "sqlite3.h"
 #include "rapidjson/document.h"
@@ -21,7 +23,14 @@
 
 #include <string>
 #include <memory>
+#include <cassert>
+#include <cctype>
+#include <chrono>
 #include <cstring>
+#include <strings.h>
+#include <list>
+#include <vector>
+#include <algorithm>
 #include <type_traits>
 #include <unordered_map>
 
@@ -39,13 +48,748 @@ struct SqliteBlob
     int  size;
 };
 
+// 文本视图（C++11没有std::string_view），不持有内存
+// 作为查询结果时指向sqlite内部的内存，在下一次step、reset或者读取同一列的其他类型前有效
+// 作为参数时以SQLITE_STATIC绑定，sqlite不复制，调用者保证语句执行完成前内存有效
+struct SqliteTextView
+{
+    const char* data;
+    int         size;
+
+    std::string ToString() const
+    {
+        return data != nullptr ? std::string(data, size) : std::string();
+    }
+};
+
+// 二进制视图，与SqliteTextView相同，不持有内存
+struct SqliteBlobView
+{
+    const void* data;
+    int         size;
+};
+
+// 预编译语句缓存统计
+struct StatementCacheStats
+{
+    size_t size;        // 当前缓存的语句数
+    size_t hits;        // 命中次数
+    size_t misses;      // 未命中（需要重新编译）次数
+    size_t evictions;   // 淘汰次数
+};
+
+// 数据库连接参数，对应sqlite的PRAGMA，Open时设置，也可以通过ApplyOptions在运行时切换
+// 字符串为空、数值为kUnset的项不设置，保持sqlite的默认值（或者当前值）
+struct SmartDBOptions
+{
+    static const int kUnset = -1;
+
+    SmartDBOptions() : cache_size(0), mmap_size(kUnset), page_size(kUnset), busy_timeout(kUnset) {}
+
+    std::string   journal_mode;     // DELETE, TRUNCATE, PERSIST, MEMORY, WAL, OFF
+    std::string   synchronous;      // OFF, NORMAL, FULL, EXTRA
+    int           cache_size;       // 页缓存，正数为页数，负数为KiB，0不设置
+    sqlite3_int64 mmap_size;        // 内存映射读取的最大字节数，0关闭
+    std::string   temp_store;       // DEFAULT, FILE, MEMORY
+    int           page_size;        // 页大小，只对新建的数据库有效（WAL模式下不能修改）
+    int           busy_timeout;     // 等待其他连接释放锁的毫秒数
+
+    // 持久：WAL + FULL，每次提交都fsync，掉电不丢失已提交的事务
+    static SmartDBOptions Durable()
+    {
+        SmartDBOptions options;
+        options.journal_mode = "WAL";
+        options.synchronous = "FULL";
+        options.busy_timeout = 5000;
+        return options;
+    }
+
+    // 均衡：WAL + NORMAL，只在checkpoint时fsync，掉电可能丢失最近的事务但不会损坏数据库
+    // 加大页缓存并打开mmap，读取不经过read系统调用
+    static SmartDBOptions Balanced()
+    {
+        SmartDBOptions options;
+        options.journal_mode = "WAL";
+        options.synchronous = "NORMAL";
+        options.cache_size = -16 * 1024;            // 16MB
+        options.mmap_size = 256 * 1024 * 1024;
+        options.temp_store = "MEMORY";
+        options.busy_timeout = 5000;
+        return options;
+    }
+
+    // 批量导入：日志放在内存中、不fsync，崩溃时数据库可能损坏，只用于可以重新导入的数据
+    // 从WAL切换到其他日志模式时，不能有其他连接打开这个数据库
+    static SmartDBOptions BulkLoad()
+    {
+        SmartDBOptions options;
+        options.journal_mode = "MEMORY";
+        options.synchronous = "OFF";
+        options.cache_size = -64 * 1024;            // 64MB
+        options.mmap_size = 256 * 1024 * 1024;
+        options.temp_store = "MEMORY";
+        options.busy_timeout = 5000;
+        return options;
+    }
+};
+
+// 预编译语句的LRU缓存，以SQL文本为key。语句通过Acquire借出、Release归还，借出期间不会被重置或淘汰，
+// 因此游标遍历时可以执行其他语句；同一条SQL同时借出多次时，额外编译一个不缓存的语句
+// 借出时清空绑定，归还时重置语句（释放读锁），淘汰和清空时finalize
+// 缓存中的语句属于同一个数据库连接，非线程安全
+class StatementCache
+{
+    struct Entry
+    {
+        std::string   sql;
+        sqlite3_stmt* stmt;
+        bool          in_use;
+    };
+    using EntryList = std::list<Entry>;
+
+public:
+    // 借出的语句
+    class Handle
+    {
+    public:
+        Handle() : stmt_(nullptr), cached_(false) {}
+
+        sqlite3_stmt* Get() const
+        {
+            return stmt_;
+        }
+
+    private:
+        friend class StatementCache;
+
+        sqlite3_stmt*       stmt_;
+        EntryList::iterator pos_;       // 缓存的语句在列表中的位置
+        bool                cached_;
+    };
+
+    explicit StatementCache(size_t capacity = 64)
+        : capacity_(capacity), borrowed_(0), hits_(0), misses_(0), evictions_(0) {}
+
+    ~StatementCache()
+    {
+        Clear();
+    }
+
+    /**
+     * @brief: 借出SQL语句对应的预编译语句，不存在时编译并加入缓存
+     * @param[in] db: 数据库句柄
+     * @param[in] sql: SQL语句
+     * @param[out] handle: 借出的语句，用完后必须调用Release归还
+     * @return: 返回sqlite3的error code
+     */
+    int Acquire(sqlite3* db, const std::string& sql, Handle& handle)
+    {
+        auto it = index_.find(sql);
+        if (it != index_.end() && !it->second->in_use) {
+            hits_++;
+            Entry& entry = *it->second;
+            entry.in_use = true;
+            in_use_.splice(in_use_.begin(), lru_, it->second);
+            sqlite3_clear_bindings(entry.stmt);
+            handle.stmt_ = entry.stmt;
+            handle.pos_ = it->second;
+            handle.cached_ = true;
+            borrowed_++;
+            return SQLITE_OK;
+        }
+
+        misses_++;
+        sqlite3_stmt* stmt = nullptr;
+        int ret = sqlite3_prepare_v2(db, sql.c_str(), static_cast<int>(sql.size()), &stmt, nullptr);
+        if (ret != SQLITE_OK) {
+            sqlite3_finalize(stmt);
+            return ret;
+        }
+
+        handle.stmt_ = stmt;
+        handle.cached_ = (capacity_ > 0 && it == index_.end());
+        borrowed_++;
+        if (handle.cached_) {
+            in_use_.push_front(Entry{sql, stmt, true});
+            handle.pos_ = in_use_.begin();
+            index_.emplace(sql, handle.pos_);
+        }
+        return ret;
+    }
+
+    /**
+     * @brief: 归还语句。缓存的语句重置后放回LRU列表，没有缓存的语句直接finalize
+     */
+    void Release(Handle& handle)
+    {
+        if (handle.stmt_ == nullptr) {
+            return;
+        }
+
+        if (handle.cached_) {
+            sqlite3_reset(handle.stmt_);
+            handle.pos_->in_use = false;
+            lru_.splice(lru_.begin(), in_use_, handle.pos_);
+            Shrink();
+        } else {
+            sqlite3_finalize(handle.stmt_);
+        }
+        borrowed_--;
+        handle = Handle();
+    }
+
+    /**
+     * @brief: 设置缓存容量，多余的语句被淘汰。容量为0表示不缓存
+     */
+    void SetCapacity(size_t capacity)
+    {
+        capacity_ = capacity;
+        Shrink();
+    }
+
+    // 借出未归还的语句数，包括没有缓存的语句
+    size_t Borrowed() const
+    {
+        return borrowed_;
+    }
+
+    /**
+     * @brief: finalize全部语句，关闭数据库前必须调用，此时不能有借出的语句（Borrowed()为0）
+     */
+    void Clear()
+    {
+        assert(borrowed_ == 0);
+        for (auto& entry : lru_) {
+            sqlite3_finalize(entry.stmt);
+        }
+        for (auto& entry : in_use_) {
+            sqlite3_finalize(entry.stmt);
+        }
+        lru_.clear();
+        in_use_.clear();
+        index_.clear();
+    }
+
+    StatementCacheStats Stats() const
+    {
+        return StatementCacheStats{lru_.size() + in_use_.size(), hits_, misses_, evictions_};
+    }
+
+private:
+    // 淘汰最久未使用的语句，借出的语句不会被淘汰
+    void Shrink()
+    {
+        while (!lru_.empty() && lru_.size() + in_use_.size() > capacity_) {
+            Entry& entry = lru_.back();
+            sqlite3_finalize(entry.stmt);
+            index_.erase(entry.sql);
+            lru_.pop_back();
+            evictions_++;
+        }
+    }
+
+private:
+    size_t    capacity_;
+    size_t    borrowed_;    // 借出未归还的语句数
+    EntryList lru_;         // 空闲的语句，最近使用的在前
+    EntryList in_use_;      // 借出的语句
+    std::unordered_map<std::string, EntryList::iterator> index_;
+
+    size_t hits_;
+    size_t misses_;
+    size_t evictions_;
+};
+
+// 列值读取，直接读到已有的对象中。std::string复用已有的容量，const char*、SqliteBlob和视图类型指向sqlite内部的内存，
+// 在下一次读取前有效，因此逐行遍历时不分配内存
+template<typename T, typename = void>
+struct ColumnReader;
+
+template<typename T>
+struct ColumnReader<T, typename std::enable_if<std::is_integral<T>::value>::type>
+{
+    static void Read(sqlite3_stmt* stmt, int index, T& t)
+    {
+        t = static_cast<T>(sqlite3_column_int64(stmt, index));
+    }
+};
+
+template<typename T>
+struct ColumnReader<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+    static void Read(sqlite3_stmt* stmt, int index, T& t)
+    {
+        t = static_cast<T>(sqlite3_column_double(stmt, index));
+    }
+};
+
+template<>
+struct ColumnReader<std::string>
+{
+    static void Read(sqlite3_stmt* stmt, int index, std::string& t)
+    {
+        const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, index));
+        if (text != nullptr) {
+            t.assign(text, sqlite3_column_bytes(stmt, index));
+        } else {
+            t.clear();
+        }
+    }
+};
+
+template<>
+struct ColumnReader<const char*>
+{
+    static void Read(sqlite3_stmt* stmt, int index, const char*& t)
+    {
+        t = reinterpret_cast<const char*>(sqlite3_column_text(stmt, index));
+    }
+};
+
+template<>
+struct ColumnReader<SqliteBlob>
+{
+    static void Read(sqlite3_stmt* stmt, int index, SqliteBlob& t)
+    {
+        // 先取指针再取长度
+        t.buf = static_cast<char*>(const_cast<void*>(sqlite3_column_blob(stmt, index)));
+        t.size = sqlite3_column_bytes(stmt, index);
+    }
+};
+
+template<>
+struct ColumnReader<SqliteTextView>
+{
+    static void Read(sqlite3_stmt* stmt, int index, SqliteTextView& t)
+    {
+        t.data = reinterpret_cast<const char*>(sqlite3_column_text(stmt, index));
+        t.size = sqlite3_column_bytes(stmt, index);
+    }
+};
+
+template<>
+struct ColumnReader<SqliteBlobView>
+{
+    static void Read(sqlite3_stmt* stmt, int index, SqliteBlobView& t)
+    {
+        t.data = sqlite3_column_blob(stmt, index);
+        t.size = sqlite3_column_bytes(stmt, index);
+    }
+};
+
+// 行读取，把一行查询结果读到Row中。std::tuple按列的顺序读取，结构体可以特化RowReader
+//   template<> struct RowReader<Person> { static void Read(sqlite3_stmt* stmt, Person& p) {...} };
+template<typename Row>
+struct RowReader;
+
+template<size_t Index, size_t Size>
+struct TupleReader
+{
+    template<typename Tuple>
+    static void Read(sqlite3_stmt* stmt, Tuple& row)
+    {
+        using T = typename std::tuple_element<Index, Tuple>::type;
+        ColumnReader<T>::Read(stmt, static_cast<int>(Index), std::get<Index>(row));
+        TupleReader<Index + 1, Size>::Read(stmt, row);
+    }
+};
+
+template<size_t Size>
+struct TupleReader<Size, Size>
+{
+    template<typename Tuple>
+    static void Read(sqlite3_stmt*, Tuple&) {}
+};
+
+template<typename... Cols>
+struct RowReader<std::tuple<Cols...>>
+{
+    static void Read(sqlite3_stmt* stmt, std::tuple<Cols...>& row)
+    {
+        TupleReader<0, sizeof...(Cols)>::Read(stmt, row);
+    }
+};
+
+// 按成员读取一行，用于SMARTDB_REFLECT生成的RowReader，列的顺序与成员的顺序相同
+struct MemberReader
+{
+    template<typename M>
+    void operator()(M& m, int index) const
+    {
+        ColumnReader<M>::Read(stmt, index, m);
+    }
+
+    sqlite3_stmt* stmt;
+};
+
+// 成员类型对应的列类型，用于CreateTable
+template<typename T, typename = void>
+struct ColumnType;
+
+template<typename T>
+struct ColumnType<T, typename std::enable_if<std::is_integral<T>::value>::type>
+{
+    static const char* Name() { return "INTEGER"; }
+};
+
+template<typename T>
+struct ColumnType<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+    static const char* Name() { return "REAL"; }
+};
+
+template<>
+struct ColumnType<std::string>
+{
+    static const char* Name() { return "TEXT"; }
+};
+
+template<>
+struct ColumnType<SqliteBlob>
+{
+    static const char* Name() { return "BLOB"; }
+};
+
+// 只能前进的查询游标，每次Next执行一次sqlite3_step，把当前行读到内部的Row中，不缓存整个结果集
+// 游标持有借出的语句，析构或Close时归还，游标不能比数据库连接活得更久
+template<typename Row>
+class Cursor
+{
+public:
+    // 输入迭代器，支持 for (auto& row : cursor)
+    class Iterator
+    {
+    public:
+        explicit Iterator(Cursor* cursor) : cursor_(cursor) {}
+
+        const Row& operator*() const { return cursor_->row_; }
+        const Row* operator->() const { return &cursor_->row_; }
+
+        Iterator& operator++()
+        {
+            if (!cursor_->Next()) {
+                cursor_ = nullptr;
+            }
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const { return cursor_ == other.cursor_; }
+        bool operator!=(const Iterator& other) const { return cursor_ != other.cursor_; }
+
+    private:
+        Cursor* cursor_;
+    };
+
+    Cursor(Cursor&& other) noexcept
+        : cache_(other.cache_), handle_(other.handle_), row_(std::move(other.row_)),
+          err_code_(other.err_code_), started_(other.started_)
+    {
+        other.handle_ = StatementCache::Handle();
+    }
+
+    ~Cursor()
+    {
+        Close();
+    }
+
+    /**
+     * @brief: 读取下一行
+     * @return: 读到一行返回true；没有更多的行或者出错返回false，错误码通过GetLastErrCode获取
+     */
+    bool Next()
+    {
+        sqlite3_stmt* stmt = handle_.Get();
+        if (stmt == nullptr) {
+            return false;
+        }
+
+        started_ = true;
+        err_code_ = sqlite3_step(stmt);
+        if (err_code_ != SQLITE_ROW) {
+            Close();
+            return false;
+        }
+        RowReader<Row>::Read(stmt, row_);
+        return true;
+    }
+
+    // 当前行
+    const Row& Get() const
+    {
+        return row_;
+    }
+
+    Iterator begin()
+    {
+        if (!started_ && !Next()) {
+            return end();
+        }
+        return Iterator(handle_.Get() != nullptr ? this : nullptr);
+    }
+
+    Iterator end()
+    {
+        return Iterator(nullptr);
+    }
+
+    // 是否持有有效的语句
+    bool Valid() const
+    {
+        return handle_.Get() != nullptr;
+    }
+
+    // 底层语句，用于读取列数、列名和声明类型，或者在下一次Next之前直接读取当前行。结束后为nullptr
+    sqlite3_stmt* Statement() const
+    {
+        return handle_.Get();
+    }
+
+    // 提前归还语句
+    void Close()
+    {
+        if (handle_.Get() != nullptr) {
+            cache_->Release(handle_);
+        }
+    }
+
+    // 最近一次sqlite3_step的返回值，正常结束时为SQLITE_DONE
+    int GetLastErrCode() const
+    {
+        return err_code_;
+    }
+
+private:
+    friend class SmartDBSqlite;
+
+    Cursor(StatementCache* cache, const StatementCache::Handle& handle, int err_code)
+        : cache_(cache), handle_(handle), row_(), err_code_(err_code), started_(false) {}
+
+    // 禁止复制和赋值
+    Cursor(const Cursor&) = delete;
+    Cursor& operator=(const Cursor&) = delete;
+
+private:
+    StatementCache*        cache_;
+    StatementCache::Handle handle_;
+    Row  row_;
+    int  err_code_;
+    bool started_;
+};
+
+// 增量blob读写（sqlite3_blob_open），按块读写大的blob，不需要把整个blob放到内存中
+// 只能读写已有的blob，不能改变长度：写入前先用zeroblob(n)插入指定长度的blob
+// 打开期间占用所属连接，用完及时关闭；不能比数据库连接活得更久。只能移动，不能复制
+class BlobStream
+{
+public:
+    BlobStream() : blob_(nullptr), err_code_(SQLITE_OK) {}
+
+    BlobStream(BlobStream&& other) noexcept : blob_(other.blob_), err_code_(other.err_code_)
+    {
+        other.blob_ = nullptr;
+    }
+
+    BlobStream& operator=(BlobStream&& other) noexcept
+    {
+        if (this != &other) {
+            Close();
+            blob_ = other.blob_;
+            err_code_ = other.err_code_;
+            other.blob_ = nullptr;
+        }
+        return *this;
+    }
+
+    ~BlobStream()
+    {
+        Close();
+    }
+
+    // 是否打开成功
+    bool Valid() const
+    {
+        return blob_ != nullptr;
+    }
+
+    // blob的字节数
+    int Size() const
+    {
+        return blob_ != nullptr ? sqlite3_blob_bytes(blob_) : 0;
+    }
+
+    /**
+     * @brief: 从offset开始读取size字节，offset + size不能超过Size()
+     * @return: 成功返回true; 失败返回false
+     */
+    bool Read(void* buf, int size, int offset)
+    {
+        err_code_ = blob_ != nullptr ? sqlite3_blob_read(blob_, buf, size, offset) : SQLITE_MISUSE;
+        return (err_code_ == SQLITE_OK);
+    }
+
+    /**
+     * @brief: 从offset开始写入size字节，必须以可写方式打开，不能超过blob的长度
+     * @return: 成功返回true; 失败返回false
+     */
+    bool Write(const void* buf, int size, int offset)
+    {
+        err_code_ = blob_ != nullptr ? sqlite3_blob_write(blob_, buf, size, offset) : SQLITE_MISUSE;
+        return (err_code_ == SQLITE_OK);
+    }
+
+    /**
+     * @brief: 按块读取全部内容，每块调用一次sink(const char* data, int size)，内存占用为一块的大小
+     * @return: 成功返回true; 失败返回false
+     */
+    template<typename Sink>
+    bool ReadAll(Sink&& sink, int chunk_size = 64 * 1024)
+    {
+        std::vector<char> chunk(chunk_size);
+        int size = Size();
+        for (int offset = 0; offset < size; offset += chunk_size) {
+            int n = std::min(chunk_size, size - offset);
+            if (!Read(chunk.data(), n, offset)) {
+                return false;
+            }
+            sink(static_cast<const char*>(chunk.data()), n);
+        }
+        return true;
+    }
+
+    /**
+     * @brief: 切换到同一表同一列的另一行，比重新打开快
+     * @return: 成功返回true; 失败返回false，此时blob不可用
+     */
+    bool Reopen(sqlite3_int64 rowid)
+    {
+        err_code_ = blob_ != nullptr ? sqlite3_blob_reopen(blob_, rowid) : SQLITE_MISUSE;
+        return (err_code_ == SQLITE_OK);
+    }
+
+    // 关闭blob，可写的blob在关闭时提交（不在事务中时）
+    void Close()
+    {
+        if (blob_ != nullptr) {
+            err_code_ = sqlite3_blob_close(blob_);
+            blob_ = nullptr;
+        }
+    }
+
+    int GetLastErrCode() const
+    {
+        return err_code_;
+    }
+
+private:
+    friend class SmartDBSqlite;
+
+    BlobStream(sqlite3_blob* blob, int err_code) : blob_(blob), err_code_(err_code) {}
+
+    // 禁止复制和赋值
+    BlobStream(const BlobStream&) = delete;
+    BlobStream& operator=(const BlobStream&) = delete;
+
+private:
+    sqlite3_blob* blob_;
+    int           err_code_;
+};
+
 class SmartDBSqlite
 {
     using SqliteValue = util::Variant<int, uint32_t, sqlite3_int64, sqlite3_uint64,
         double, char*, const char*, std::string, SqliteBlob, std::nullptr_t>;
-    using JsonBuilder = rapidjson::Writer<rapidjson::StringBuffer>;
+
+    // 批量插入时缓存的一个值，字符串和blob复制到str中，缓冲区在批次之间复用
+    struct BulkValue
+    {
+        int           type;     // SQLITE_INTEGER等
+        sqlite3_int64 i;
+        double        d;
+        std::string   str;
+    };
+
 public:
-    SmartDBSqlite() : db_handle_(nullptr), sql_stmt_(nullptr), json_builder_(json_sbuf_) {}
+    // 批量插入的一行，由行数据源填充。每列调用一次Add，或者用Bind一次给出整行
+    class BulkRow
+    {
+    public:
+        template<typename... Args>
+        void Bind(Args&&... args)
+        {
+            BindAll(std::forward<Args>(args)...);
+        }
+
+        template<typename T>
+        typename std::enable_if<std::is_integral<T>::value>::type Add(T t)
+        {
+            BulkValue& v = Next();
+            v.type = SQLITE_INTEGER;
+            v.i = static_cast<sqlite3_int64>(t);
+        }
+
+        template<typename T>
+        typename std::enable_if<std::is_floating_point<T>::value>::type Add(T t)
+        {
+            BulkValue& v = Next();
+            v.type = SQLITE_FLOAT;
+            v.d = t;
+        }
+
+        void Add(const std::string& t)
+        {
+            BulkValue& v = Next();
+            v.type = SQLITE_TEXT;
+            v.str.assign(t);
+        }
+
+        void Add(const char* t)
+        {
+            BulkValue& v = Next();
+            v.type = SQLITE_TEXT;
+            v.str.assign(t);
+        }
+
+        void Add(const SqliteBlob& t)
+        {
+            BulkValue& v = Next();
+            v.type = SQLITE_BLOB;
+            v.str.assign(t.buf, t.size);
+        }
+
+        void Add(std::nullptr_t)
+        {
+            Next().type = SQLITE_NULL;
+        }
+
+    private:
+        friend class SmartDBSqlite;
+
+        BulkRow(BulkValue* values, size_t columns) : values_(values), columns_(columns), count_(0) {}
+
+        void BindAll() {}
+
+        template<typename T, typename... Args>
+        void BindAll(T&& first, Args&&... args)
+        {
+            Add(std::forward<T>(first));
+            BindAll(std::forward<Args>(args)...);
+        }
+
+        BulkValue& Next()
+        {
+            if (count_ >= columns_) {
+                throw std::out_of_range("bulk insert row has too many values");
+            }
+            return values_[count_++];
+        }
+
+    private:
+        BulkValue* values_;
+        size_t     columns_;
+        size_t     count_;      // 已填充的列数
+    };
+
+    SmartDBSqlite() : err_code_(SQLITE_OK), db_handle_(nullptr), sql_stmt_(nullptr), bind_destructor_(SQLITE_STATIC) {}
 
     virtual ~SmartDBSqlite()
     {
@@ -55,27 +799,108 @@ public:
     /**
      * @brief: 打开数据库。如果数据库不存在，则将创建并打开数据库
      * @param[in] db_name: 数据库名称
-     * @param[in] userdata: 用户数据
+     * @param[in] userdata: 用户数据，一般传入用户名和密码，sqlite3不使用。设置连接参数使用SmartDBOptions的重载
+     * @param[in] flags: sqlite3_open_v2的打开标志，例如连接池使用SQLITE_OPEN_NOMUTEX
      * @return: 成功返回true; 失败返回false
      */
-    bool Open(const std::string& db_name, void* userdata)
+    bool Open(const std::string& db_name, void* userdata, int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)
     {
-        (void)userdata;     // 一般传入用户名和密码，sqlite3不使用，避免unused警告
-        err_code_ = sqlite3_open(db_name.c_str(), &db_handle_);
-        return (err_code_ == SQLITE_OK);
+        (void)userdata;     // 避免unused警告
+        return Open(db_name, SmartDBOptions(), flags);
     }
 
     /**
-     * @brief: 关闭数据库
+     * @brief: 打开数据库，并设置连接参数
+     * @param[in] db_name: 数据库名称
+     * @param[in] options: 连接参数，例如SmartDBOptions::Balanced()
+     * @param[in] flags: sqlite3_open_v2的打开标志
+     * @return: 成功返回true; 失败返回false，设置参数失败时数据库被关闭
+     */
+    bool Open(const std::string& db_name, const SmartDBOptions& options,
+        int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)
+    {
+        err_code_ = sqlite3_open_v2(db_name.c_str(), &db_handle_, flags, nullptr);
+        if (err_code_ != SQLITE_OK) {
+            CloseDBHandle();    // 打开失败时也会返回句柄，需要关闭
+            db_handle_ = nullptr;
+            return false;
+        }
+
+        if (!ApplyOptions(options)) {
+            int err_code = err_code_;
+            Close();
+            err_code_ = err_code;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief: 设置连接参数，可以在运行时切换，例如导入数据前切换到BulkLoad，导入后切换回Balanced
+     *         不能在事务中调用；journal_mode设置后读回检查，切换失败（例如离开WAL时还有其他连接）返回false
+     * @param[in] options: 连接参数，没有指定的项保持当前值
      * @return: 成功返回true; 失败返回false
      */
+    bool ApplyOptions(const SmartDBOptions& options)
+    {
+        // page_size必须在切换到WAL之前设置
+        if (options.page_size != SmartDBOptions::kUnset
+            && !Excecute("PRAGMA page_size=" + std::to_string(options.page_size) + ";")) {
+            return false;
+        }
+
+        if (!options.journal_mode.empty()) {
+            // 切换失败时sqlite不报错，而是返回当前的日志模式
+            std::string mode = ExcecuteScalar<std::string>("PRAGMA journal_mode=" + options.journal_mode + ";");
+            if (err_code_ != SQLITE_ROW) {
+                return false;
+            }
+            if (strcasecmp(mode.c_str(), options.journal_mode.c_str()) != 0) {
+                err_code_ = SQLITE_ERROR;
+                return false;
+            }
+        }
+
+        if (!options.synchronous.empty() && !Excecute("PRAGMA synchronous=" + options.synchronous + ";")) {
+            return false;
+        }
+        if (options.cache_size != 0
+            && !Excecute("PRAGMA cache_size=" + std::to_string(options.cache_size) + ";")) {
+            return false;
+        }
+        if (options.mmap_size != SmartDBOptions::kUnset
+            && !Excecute("PRAGMA mmap_size=" + std::to_string(options.mmap_size) + ";")) {
+            return false;
+        }
+        if (!options.temp_store.empty() && !Excecute("PRAGMA temp_store=" + options.temp_store + ";")) {
+            return false;
+        }
+        if (options.busy_timeout != SmartDBOptions::kUnset && !SetBusyTimeout(options.busy_timeout)) {
+            return false;
+        }
+
+        err_code_ = SQLITE_OK;
+        return true;
+    }
+
+    /**
+     * @brief: 关闭数据库
+     * @return: 成功返回true; 失败返回false，还有未关闭的游标时不关闭，错误码为SQLITE_BUSY
+     */
     bool Close()
     {
         if (db_handle_ == nullptr) {
             return true;
         }
 
-        sqlite3_finalize(sql_stmt_);
+        // 还有游标持有借出的语句时不能关闭：关闭会finalize这些语句，游标归还时访问已释放的语句
+        ReleaseStmt();
+        if (stmt_cache_.Borrowed() > 0) {
+            err_code_ = SQLITE_BUSY;
+            return false;
+        }
+        stmt_cache_.Clear();    // 缓存的语句必须在关闭连接前finalize
+        query_cache_.Disable();
         err_code_ = CloseDBHandle();
         db_handle_ = nullptr;
         sql_stmt_  = nullptr;
@@ -89,6 +914,10 @@ public:
      */
     bool Excecute(const std::string& sql)
     {
+        // update hook不报告DDL和不带where的delete，除事务控制语句外清空查询结果缓存
+        if (query_cache_.Enabled() && !IsTransactionControl(sql)) {
+            query_cache_.Clear();
+        }
         err_code_ = sqlite3_exec(db_handle_, sql.c_str(), nullptr, nullptr, nullptr);
         return (SQLITE_OK == err_code_);
     }
@@ -113,11 +942,21 @@ public:
      *         返回结果可能是多种类型，使用variant保存和获取
      * @param[in] sql: SQL语句
      * @param[in] args: SQL语句参数
-     * @return: 返回查询结果
+     * @return: 返回查询结果，开启结果缓存时命中则不执行SQL
      */
     template<typename R, typename... Args>
     R ExcecuteScalar(const std::string& sql, Args... args)
     {
+        std::string key;
+        if (query_cache_.Enabled()) {
+            key = QueryCache::MakeKey('S', sql, args...);
+            util::Any* hit = query_cache_.Find(key);
+            if (hit != nullptr) {
+                err_code_ = SQLITE_ROW;
+                return hit->AnyCast<SqliteValue>().Get<R>();
+            }
+        }
+
         if (!Prepare(sql)) {
             return GetErrorVal<R>();
         }
@@ -136,66 +975,317 @@ public:
         R ret = val.Get<R>();
         sqlite3_reset(sql_stmt_);
 
+        if (query_cache_.Enabled()) {
+            query_cache_.Insert(key, sql, std::move(val));
+        }
+        return ret;
+    }
+
+    /**
+     * @brief: 执行SQL语句
+     * @param[in] sql: SQL语句
+     * @param[in] json: SQL语句参数，位于json数组中，格式如下
+     *      [{"ID" : 1, "Name" : "name1"}, {"ID" : 1, "Name" : "name1"}]
+     * @return: 成功返回true; 失败返回false
+     */
+    bool ExcecuteJson(const std::string& sql, const char* json)
+    {
+        // 解析json串
+        rapidjson::Document doc;
+        //doc.Parse<0>(json);
+        doc.Parse(json);
+        if (doc.HasParseError()) {
+            throw std::logic_error("json parse error: " + std::to_string(doc.GetParseError()));
+        }
+
+        if (!doc.IsArray()) {
+            throw std::logic_error("json error: json is not the array");
+        }
+
+        // 解析SQL语句
+        if (!Prepare(sql)) {
+            return false;
+        }
+
+        // 启动事务写数据
+        return JosnTransaction(doc);
+    }
+
+    /**
+     * @brief: 执行SQL查询语句
+     * @param[in] sql: SQL语句
+     * @param[in] args: SQL语句参数
+     * @return: 返回查询结果，封装到json数组中，格式如下
+     *      [{"ID" : 1, "Name" : "name1"}, {"ID" : 1, "Name" : "name1"}]
+     *      开启结果缓存时命中则不执行SQL，返回缓存结果的副本，调用者可以修改
+     */
+    template<typename... Args>
+    std::shared_ptr<rapidjson::Document> Query(const std::string& sql, Args... args)
+    {
+        std::string key;
+        if (query_cache_.Enabled()) {
+            key = QueryCache::MakeKey('Q', sql, args...);
+            util::Any* hit = query_cache_.Find(key);
+            if (hit != nullptr) {
+                err_code_ = SQLITE_DONE;
+                return CopyDocument(*hit->AnyCast<std::shared_ptr<const rapidjson::Document>>());
+            }
+        }
+
+        if (!Prepare(sql)) {
+            return nullptr;
+        }
+
+        if (BindParams(sql_stmt_, 1, std::forward<Args>(args)...) != SQLITE_OK) {
+            return nullptr;
+        }
+
+        // 查询DB，通过SAX事件直接构造Document，不经过json字符串
+        auto doc = std::make_shared<rapidjson::Document>();
+        JsonArrayGenerator generator(*this);
+        doc->Populate(generator);
+        if (err_code_ != SQLITE_DONE) {
+            return nullptr;
+        }
+
+        // 缓存保存原结果，返回副本，避免调用者修改缓存的内容
+        if (query_cache_.Enabled() && doc->Size() <= query_cache_.MaxRows()) {
+            std::shared_ptr<const rapidjson::Document> cached = doc;
+            query_cache_.Insert(key, sql, cached);
+            return CopyDocument(*cached);
+        }
+        return doc;
+    }
+
+    /**
+     * @brief: 执行SQL查询语句，查询结果以SAX事件逐行输出给handler，不在内存中保存整个结果集
+     * @param[in] handler: rapidjson的SAX handler，例如Writer<FileWriteStream>、PrettyWriter
+     * @param[in] sql: SQL语句
+     * @param[in] args: SQL语句参数
+     * @return: 成功返回true; 失败返回false
+     */
+    template<typename Handler, typename... Args>
+    bool QueryToHandler(Handler& handler, const std::string& sql, Args... args)
+    {
+        if (!Prepare(sql)) {
+            return false;
+        }
+
+        if (BindParams(sql_stmt_, 1, std::forward<Args>(args)...) != SQLITE_OK) {
+            return false;
+        }
+
+        return BuildJsonArray(handler);
+    }
+
+    /**
+     * @brief: 执行SQL查询语句，查询结果以json数组写入输出流，例如FileWriteStream或者socket缓冲区
+     * @param[in] os: rapidjson的输出流
+     * @param[in] sql: SQL语句
+     * @param[in] args: SQL语句参数
+     * @return: 成功返回true; 失败返回false
+     */
+    template<typename OutputStream, typename... Args>
+    bool QueryToStream(OutputStream& os, const std::string& sql, Args... args)
+    {
+        rapidjson::Writer<OutputStream> writer(os);
+        bool ret = QueryToHandler(writer, sql, std::forward<Args>(args)...);
+        os.Flush();
         return ret;
     }
 
     /**
-     * @brief: 执行SQL语句
-     * @param[in] sql: SQL语句
-     * @param[in] json: SQL语句参数，位于json数组中，格式如下
-     *      [{"ID" : 1, "Name" : "name1"}, {"ID" : 1, "Name" : "name1"}]
+     * @brief: 批量插入。行数据逐行从source读取，按多行VALUES语句批量执行，按rows_per_txn行分事务提交
+     *         每条语句的行数由SQLITE_LIMIT_VARIABLE_NUMBER和max_rows_per_stmt决定，值缓冲区在批次之间复用
+     *         失败时回滚当前事务，之前已提交的事务保留
+     * @param[in] table: 表名
+     * @param[in] columns: 列名
+     * @param[in] source: 行数据源，bool(BulkRow&)，填充一行返回true，没有数据时返回false
+     * @param[in] rows_per_txn: 每个事务的行数
+     * @param[in] max_rows_per_stmt: 每条语句最多的行数
      * @return: 成功返回true; 失败返回false
      */
-    bool ExcecuteJson(const std::string& sql, const char* json)
+    template<typename RowSource>
+    bool BulkInsert(const std::string& table, const std::vector<std::string>& columns, RowSource&& source,
+        size_t rows_per_txn = 100000, size_t max_rows_per_stmt = 256)
     {
-        // 解析json串
-        rapidjson::Document doc;
-        //doc.Parse<0>(json);
-        doc.Parse(json);
-        if (doc.HasParseError()) {
-            throw std::logic_error("json parse error: " + std::to_string(doc.GetParseError()));
+        if (columns.empty()) {
+            throw std::invalid_argument("bulk insert needs at least one column");
         }
 
-        if (!doc.IsArray()) {
-            throw std::logic_error("json error: json is not the array");
+        size_t max_vars = static_cast<size_t>(sqlite3_limit(db_handle_, SQLITE_LIMIT_VARIABLE_NUMBER, -1));
+        size_t rows_per_stmt = std::max<size_t>(1, std::min(max_vars / columns.size(), max_rows_per_stmt));
+        if (rows_per_txn < rows_per_stmt) {
+            rows_per_stmt = std::max<size_t>(1, rows_per_txn);
         }
 
-        // 解析SQL语句
-        if (!Prepare(sql)) {
-            return false;
+        const std::string sql = BulkSql(table, columns, rows_per_stmt);
+        bulk_values_.resize(rows_per_stmt * columns.size());
+        size_t rows = 0;        // 当前语句已缓存的行数
+        size_t txn_rows = 0;    // 当前事务已插入的行数
+
+        Begin();
+        try {
+            while (true) {
+                BulkRow row(&bulk_values_[rows * columns.size()], columns.size());
+                bool more = source(row);
+                if (more) {
+                    if (row.count_ != columns.size()) {
+                        throw std::invalid_argument("bulk insert row has too few values");
+                    }
+                    rows++;
+                }
+
+                // 缓冲区满或者数据结束时执行，最后不满一批的数据使用单独的语句
+                if (rows == rows_per_stmt || (!more && rows > 0)) {
+                    bool ok = (rows == rows_per_stmt) ? BulkExcecute(sql, rows * columns.size())
+                        : BulkExcecute(BulkSql(table, columns, rows), rows * columns.size());
+                    if (!ok) {
+                        int err_code = err_code_;
+                        RollBack();
+                        err_code_ = err_code;
+                        return false;
+                    }
+                    txn_rows += rows;
+                    rows = 0;
+
+                    if (txn_rows >= rows_per_txn && more) {
+                        Commit();
+                        Begin();
+                        txn_rows = 0;
+                    }
+                }
+
+                if (!more) {
+                    break;
+                }
+            }
+        } catch (...) {
+            sqlite3_exec(db_handle_, SMARTDB_ROLLBACK, nullptr, nullptr, nullptr);
+            throw;
         }
-
-        // 启动事务写数据
-        return JosnTransaction(doc);
+        Commit();
+        return true;
     }
 
     /**
-     * @brief: 执行SQL查询语句
+     * @brief: 执行SQL查询语句，返回只能前进的游标，逐行读取为Row（std::tuple或特化了RowReader的结构体）
+     *         游标遍历期间可以执行其他语句
      * @param[in] sql: SQL语句
      * @param[in] args: SQL语句参数
-     * @return: 返回查询结果，封装到json数组中，格式如下
-     *      [{"ID" : 1, "Name" : "name1"}, {"ID" : 1, "Name" : "name1"}]
+     * @return: 返回游标，编译或绑定参数失败时游标无效（Valid返回false）
      */
-    template<typename... Args>
-    std::shared_ptr<rapidjson::Document> Query(const std::string& sql, Args... args)
+    template<typename Row, typename... Args>
+    Cursor<Row> QueryCursor(const std::string& sql, Args&&... args)
     {
-        if (!Prepare(sql)) {
-            return nullptr;
-        }
+        StatementCache::Handle handle;
+        err_code_ = stmt_cache_.Acquire(db_handle_, sql, handle);
 
-        if (BindParams(sql_stmt_, 1, std::forward<Args>(args)...) != SQLITE_OK) {
-            return nullptr;
+        // 游标在本函数返回后才执行，参数可能已经析构，需要复制（视图类型除外）
+        bind_destructor_ = SQLITE_TRANSIENT;
+        if (err_code_ == SQLITE_OK && BindParams(handle.Get(), 1, std::forward<Args>(args)...) != SQLITE_OK) {
+            stmt_cache_.Release(handle);
         }
+        bind_destructor_ = SQLITE_STATIC;
+        return Cursor<Row>(&stmt_cache_, handle, err_code_);
+    }
 
-        json_sbuf_.Clear();
-        json_builder_.Reset(json_sbuf_);
-        auto doc = std::make_shared<rapidjson::Document>();
+    /**
+     * @brief: 按SMARTDB_REFLECT注册的结构体建表，第一个成员为主键，表已存在时不做任何事
+     * @return: 成功返回true; 失败返回false
+     */
+    template<typename T>
+    bool CreateTable()
+    {
+        std::string sql = std::string("CREATE TABLE IF NOT EXISTS ") + Reflection<T>::Table() + " (";
+        T t = T();
+        Reflection<T>::Visit(t, ColumnDefiner{sql, Reflection<T>::Columns()});
+        sql += ");";
+        return Excecute(sql);
+    }
 
-        // 查询DB，构造json数组
-        BuildJsonArray();
-        doc->Parse<0>(json_sbuf_.GetString());
+    /**
+     * @brief: 插入一个结构体，成员按注册的顺序绑定到同名的列
+     * @return: 成功返回true; 失败返回false
+     */
+    template<typename T>
+    bool Insert(const T& t)
+    {
+        static const std::string sql = InsertSql<T>();
+        return ExcecuteMembers(sql, t, 0);
+    }
 
-        return doc;
+    /**
+     * @brief: 按主键（第一个成员）更新结构体的其他成员
+     * @return: 成功返回true; 失败返回false
+     */
+    template<typename T>
+    bool Update(const T& t)
+    {
+        static_assert(Reflection<T>::kSize > 1, "update needs at least one column besides the primary key");
+        static const std::string sql = UpdateSql<T>();
+        return ExcecuteMembers(sql, t, Reflection<T>::kSize);
+    }
+
+    /**
+     * @brief: 批量插入结构体，按BulkInsert多行VALUES和分事务提交
+     * @param[in] rows: 结构体的容器
+     * @param[in] rows_per_txn: 每个事务的行数
+     * @return: 成功返回true; 失败返回false
+     */
+    template<typename Container>
+    bool BulkInsert(const Container& rows, size_t rows_per_txn = 100000)
+    {
+        using T = typename std::decay<decltype(*std::begin(rows))>::type;
+        std::vector<std::string> columns(Reflection<T>::Columns(), Reflection<T>::Columns() + Reflection<T>::kSize);
+        auto it = std::begin(rows);
+        auto end = std::end(rows);
+        return BulkInsert(Reflection<T>::Table(), columns, [&](BulkRow& row) {
+            if (it == end) {
+                return false;
+            }
+            Reflection<T>::Visit(*it, BulkAdder{row});
+            ++it;
+            return true;
+        }, rows_per_txn);
+    }
+
+    /**
+     * @brief: 查询结构体，列值直接读到成员中，不经过json
+     * @param[in] where: 查询条件，不含WHERE关键字，为空时查询全部行，例如"ID > ? ORDER BY ID"
+     * @param[in] args: 查询条件的参数
+     * @return: 返回查询结果，出错时通过GetLastErrCode获取错误码
+     */
+    template<typename T, typename... Args>
+    std::vector<T> Select(const std::string& where = "", Args&&... args)
+    {
+        static const std::string sql = SelectSql<T>();
+        std::vector<T> rows;
+        if (!Prepare(where.empty() ? sql : sql + " WHERE " + where)
+            || BindParams(sql_stmt_, 1, std::forward<Args>(args)...) != SQLITE_OK) {
+            return rows;
+        }
+
+        // 直接读到vector的元素中，不经过游标的临时对象
+        while ((err_code_ = sqlite3_step(sql_stmt_)) == SQLITE_ROW) {
+            rows.emplace_back();
+            RowReader<T>::Read(sql_stmt_, rows.back());
+        }
+        sqlite3_reset(sql_stmt_);
+        return rows;
+    }
+
+    /**
+     * @brief: 查询结构体，返回游标逐行读取
+     * @param[in] where: 查询条件，不含WHERE关键字，为空时查询全部行
+     * @param[in] args: 查询条件的参数
+     * @return: 返回游标
+     */
+    template<typename T, typename... Args>
+    Cursor<T> SelectCursor(const std::string& where = "", Args&&... args)
+    {
+        static const std::string sql = SelectSql<T>();
+        return QueryCursor<T>(where.empty() ? sql : sql + " WHERE " + where, std::forward<Args>(args)...);
     }
 
     /**
@@ -228,6 +1318,98 @@ public:
         }
     }
 
+    /**
+     * @brief: 设置预编译语句缓存的容量，0表示不缓存
+     */
+    void SetStatementCacheSize(size_t capacity)
+    {
+        ReleaseStmt();
+        stmt_cache_.SetCapacity(capacity);
+    }
+
+    /**
+     * @brief: 获取预编译语句缓存的统计
+     */
+    StatementCacheStats GetStatementCacheStats() const
+    {
+        return stmt_cache_.Stats();
+    }
+
+    /**
+     * @brief: 设置Query和ExcecuteScalar的结果缓存，命中时直接返回结果，不再执行SQL
+     *         通过本连接写入时按表失效（sqlite3_update_hook），其他连接的写入只能等结果过期
+     * @param[in] capacity: 最多缓存的结果数，0表示关闭缓存
+     * @param[in] ttl: 结果的有效期
+     * @param[in] max_rows: Query结果超过max_rows行时不缓存
+     */
+    void SetQueryCache(size_t capacity, std::chrono::milliseconds ttl, size_t max_rows = 10000)
+    {
+        if (capacity == 0) {
+            query_cache_.Disable();
+        } else {
+            query_cache_.Enable(db_handle_, capacity, ttl, max_rows);
+        }
+    }
+
+    /**
+     * @brief: 获取查询结果缓存的统计
+     */
+    QueryCacheStats GetQueryCacheStats() const
+    {
+        return query_cache_.Stats();
+    }
+
+    // 清空查询结果缓存，例如其他连接修改了数据之后
+    void ClearQueryCache()
+    {
+        query_cache_.Clear();
+    }
+
+    // 使读取了table的缓存结果失效
+    void InvalidateQueryCache(const std::string& table)
+    {
+        query_cache_.Invalidate(table);
+    }
+
+    /**
+     * @brief: 打开blob增量读写
+     * @param[in] table: 表名
+     * @param[in] column: blob列名
+     * @param[in] rowid: 行的rowid（INTEGER PRIMARY KEY）
+     * @param[in] writable: 是否可写
+     * @return: 返回BlobStream，失败时无效（Valid返回false）
+     */
+    BlobStream OpenBlob(const std::string& table, const std::string& column, sqlite3_int64 rowid,
+        bool writable = false)
+    {
+        sqlite3_blob* blob = nullptr;
+        err_code_ = sqlite3_blob_open(db_handle_, "main", table.c_str(), column.c_str(), rowid,
+            writable ? 1 : 0, &blob);
+        if (err_code_ != SQLITE_OK) {
+            sqlite3_blob_close(blob);
+            blob = nullptr;
+        }
+        return BlobStream(blob, err_code_);
+    }
+
+    /**
+     * @brief: 最近一次插入的rowid
+     */
+    sqlite3_int64 LastInsertRowId()
+    {
+        return sqlite3_last_insert_rowid(db_handle_);
+    }
+
+    /**
+     * @brief: 设置锁等待超时，数据库被其他连接锁住时最多重试ms毫秒，而不是立即返回SQLITE_BUSY
+     * @return: 成功返回true; 失败返回false
+     */
+    bool SetBusyTimeout(int ms)
+    {
+        err_code_ = sqlite3_busy_timeout(db_handle_, ms);
+        return (err_code_ == SQLITE_OK);
+    }
+
     /**
      * @brief: 获取最近一次错误代码
      * @return: 返回最近一次错误代码
@@ -262,18 +1444,49 @@ private:
     }
 
     /**
-     * @brief: 解析和保存SQL语句
+     * @brief: 解析和保存SQL语句，优先从缓存中获取已编译的语句
      * @param[in] sql: SQL语句，可能带有占位符
      * @return: 成功返回true; 失败返回false
      */
-    int Prepare(const std::string& sql)
+    bool Prepare(const std::string& sql)
     {
-        // 编译SQL语句
-        err_code_ = sqlite3_prepare_v2(db_handle_, sql.c_str(), -1, &sql_stmt_, nullptr);
-        if (err_code_ != SQLITE_OK) {
-            return false;
+        ReleaseStmt();
+        err_code_ = stmt_cache_.Acquire(db_handle_, sql, stmt_handle_);
+        sql_stmt_ = stmt_handle_.Get();
+        return (err_code_ == SQLITE_OK);
+    }
+
+    // 复制查询结果，用于返回缓存中的Document
+    static std::shared_ptr<rapidjson::Document> CopyDocument(const rapidjson::Document& src)
+    {
+        auto doc = std::make_shared<rapidjson::Document>();
+        doc->CopyFrom(src, doc->GetAllocator());
+        return doc;
+    }
+
+    // 是否为事务控制语句，这些语句不修改数据，不需要清空查询结果缓存
+    static bool IsTransactionControl(const std::string& sql)
+    {
+        static const char* const keywords[] = { "BEGIN", "COMMIT", "END", "ROLLBACK", "SAVEPOINT", "RELEASE" };
+        size_t pos = sql.find_first_not_of(" \t\r\n");
+        if (pos == std::string::npos) {
+            return true;
         }
-        return true;
+        for (const char* keyword : keywords) {
+            size_t len = strlen(keyword);
+            if (strncasecmp(sql.c_str() + pos, keyword, len) == 0
+                && !isalnum(static_cast<unsigned char>(sql.c_str()[pos + len]))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 归还当前语句
+    void ReleaseStmt()
+    {
+        stmt_cache_.Release(stmt_handle_);
+        sql_stmt_ = nullptr;
     }
 
     /**
@@ -293,6 +1506,168 @@ private:
         return (err_code_ == SQLITE_DONE);
     }
 
+    // 生成多行插入语句：INSERT INTO table(c1,c2) VALUES(?,?),(?,?)...
+    static std::string BulkSql(const std::string& table, const std::vector<std::string>& columns, size_t rows)
+    {
+        std::string sql = "INSERT INTO " + table + "(";
+        std::string values = "(";
+        for (size_t i = 0; i < columns.size(); i++) {
+            sql += (i == 0 ? "" : ",") + columns[i];
+            values += (i == 0 ? "?" : ",?");
+        }
+        values += ")";
+
+        sql += ") VALUES";
+        sql.reserve(sql.size() + rows * (values.size() + 1));
+        for (size_t i = 0; i < rows; i++) {
+            sql += (i == 0 ? "" : ",");
+            sql += values;
+        }
+        return sql;
+    }
+
+    // 绑定缓存的count个值并执行。缓冲区在执行完成前不变，字符串使用SQLITE_STATIC绑定，不复制
+    bool BulkExcecute(const std::string& sql, size_t values)
+    {
+        if (!Prepare(sql)) {
+            return false;
+        }
+
+        int count = static_cast<int>(values);
+        for (int i = 0; i < count && err_code_ == SQLITE_OK; i++) {
+            const BulkValue& v = bulk_values_[i];
+            switch (v.type) {
+            case SQLITE_INTEGER:
+                err_code_ = sqlite3_bind_int64(sql_stmt_, i + 1, v.i);
+                break;
+            case SQLITE_FLOAT:
+                err_code_ = sqlite3_bind_double(sql_stmt_, i + 1, v.d);
+                break;
+            case SQLITE_TEXT:
+                err_code_ = sqlite3_bind_text(sql_stmt_, i + 1, v.str.data(), static_cast<int>(v.str.size()), SQLITE_STATIC);
+                break;
+            case SQLITE_BLOB:
+                err_code_ = sqlite3_bind_blob(sql_stmt_, i + 1, v.str.data(), static_cast<int>(v.str.size()), SQLITE_STATIC);
+                break;
+            default:
+                err_code_ = sqlite3_bind_null(sql_stmt_, i + 1);
+                break;
+            }
+        }
+        if (err_code_ != SQLITE_OK) {
+            return false;
+        }
+
+        err_code_ = sqlite3_step(sql_stmt_);
+        sqlite3_reset(sql_stmt_);
+        return (err_code_ == SQLITE_DONE);
+    }
+
+    // INSERT INTO Table(c1,c2,c3) VALUES(?,?,?)
+    template<typename T>
+    static std::string InsertSql()
+    {
+        const char* const* columns = Reflection<T>::Columns();
+        std::string sql = std::string("INSERT INTO ") + Reflection<T>::Table() + "(";
+        std::string values;
+        for (size_t i = 0; i < Reflection<T>::kSize; i++) {
+            sql += (i == 0 ? "" : ",");
+            sql += columns[i];
+            values += (i == 0 ? "?" : ",?");
+        }
+        return sql + ") VALUES(" + values + ");";
+    }
+
+    // UPDATE Table SET c2=?,c3=? WHERE c1=?
+    template<typename T>
+    static std::string UpdateSql()
+    {
+        const char* const* columns = Reflection<T>::Columns();
+        std::string sql = std::string("UPDATE ") + Reflection<T>::Table() + " SET ";
+        for (size_t i = 1; i < Reflection<T>::kSize; i++) {
+            sql += (i == 1 ? "" : ",");
+            sql += columns[i];
+            sql += "=?";
+        }
+        return sql + " WHERE " + columns[0] + "=?;";
+    }
+
+    // SELECT c1,c2,c3 FROM Table
+    template<typename T>
+    static std::string SelectSql()
+    {
+        const char* const* columns = Reflection<T>::Columns();
+        std::string sql = "SELECT ";
+        for (size_t i = 0; i < Reflection<T>::kSize; i++) {
+            sql += (i == 0 ? "" : ",");
+            sql += columns[i];
+        }
+        return sql + " FROM " + Reflection<T>::Table();
+    }
+
+    // 绑定结构体的成员并执行。key_pos为0时按顺序绑定，否则第一个成员（主键）绑定到key_pos，其他成员前移
+    template<typename T>
+    bool ExcecuteMembers(const std::string& sql, const T& t, int key_pos)
+    {
+        if (!Prepare(sql)) {
+            return false;
+        }
+
+        Reflection<T>::Visit(t, MemberBinder{*this, key_pos});
+        if (err_code_ != SQLITE_OK) {
+            return false;
+        }
+
+        err_code_ = sqlite3_step(sql_stmt_);
+        sqlite3_reset(sql_stmt_);
+        return (err_code_ == SQLITE_DONE);
+    }
+
+    // 按成员绑定参数，每个成员的绑定函数在编译期确定
+    struct MemberBinder
+    {
+        template<typename M>
+        void operator()(const M& m, int index) const
+        {
+            if (db.err_code_ == SQLITE_OK) {
+                int pos = (key_pos == 0) ? index + 1 : (index == 0 ? key_pos : index);
+                db.BindValue(db.sql_stmt_, pos, m);
+            }
+        }
+
+        SmartDBSqlite& db;
+        int key_pos;
+    };
+
+    // 按成员填充批量插入的一行
+    struct BulkAdder
+    {
+        template<typename M>
+        void operator()(const M& m, int) const
+        {
+            row.Add(m);
+        }
+
+        BulkRow& row;
+    };
+
+    // 生成建表语句的列定义
+    struct ColumnDefiner
+    {
+        template<typename M>
+        void operator()(const M&, int index) const
+        {
+            sql += (index == 0 ? "" : ", ");
+            sql += columns[index];
+            sql += " ";
+            sql += ColumnType<M>::Name();
+            sql += (index == 0 ? " PRIMARY KEY" : "");
+        }
+
+        std::string& sql;
+        const char* const* columns;
+    };
+
     // 统一绑定参数，解析带占位符的SQL语句。终止函数
     int BindParams(sqlite3_stmt* stmt, int current)
     {
@@ -328,36 +1703,42 @@ private:
         BindIntValue(stmt, current, t);
     }
 
+    // int放不下的整数（64位整数、long long、uint32_t等）按int64绑定
+    template<typename T>
+    struct NeedInt64 : std::integral_constant<bool, (sizeof(T) > sizeof(int))
+        || (sizeof(T) == sizeof(int) && std::is_unsigned<T>::value)> {};
+
     // bind int64
     template<typename T>
-    typename std::enable_if<std::is_same<T, int64_t>::value || std::is_same<T, uint64_t>::value>::type
+    typename std::enable_if<NeedInt64<T>::value>::type
     BindIntValue(sqlite3_stmt* stmt, int current, T t)
     {
-        err_code_ = sqlite3_bind_int64(stmt, current, std::forward<T>(t));
+        err_code_ = sqlite3_bind_int64(stmt, current, static_cast<sqlite3_int64>(t));
     }
 
     // bind other int value
     template<typename T>
-    typename std::enable_if<!std::is_same<T, int64_t>::value && !std::is_same<T, uint64_t>::value>::type
+    typename std::enable_if<!NeedInt64<T>::value>::type
     BindIntValue(sqlite3_stmt* stmt, int current, T t)
     {
         err_code_ = sqlite3_bind_int(stmt, current, std::forward<T>(t));
     }
 
+    // 字符串和blob参数在执行语句的函数返回前一直有效，默认以SQLITE_STATIC绑定，不复制
     // bind string
     template<typename T>
     typename std::enable_if<std::is_same<T, std::string>::value>::type
     BindValue(sqlite3_stmt* stmt, int current, const T& t)
     {
-        err_code_ = sqlite3_bind_text(stmt, current, t.c_str(), t.length(), SQLITE_TRANSIENT);
+        err_code_ = sqlite3_bind_text(stmt, current, t.data(), static_cast<int>(t.size()), bind_destructor_);
     }
 
-    // bind char*
+    // bind char*，长度由sqlite计算，不包含结尾的'\0'
     template<typename T>
     typename std::enable_if<std::is_same<T, char*>::value || std::is_same<T, const char*>::value>::type
     BindValue(sqlite3_stmt* stmt, int current, T t)
     {
-        err_code_ = sqlite3_bind_text(stmt, current, t, std::strlen(t) + 1, SQLITE_TRANSIENT);
+        err_code_ = sqlite3_bind_text(stmt, current, t, -1, bind_destructor_);
     }
 
     // bind blob
@@ -365,7 +1746,27 @@ private:
     typename std::enable_if<std::is_same<T, SqliteBlob>::value>::type
     BindValue(sqlite3_stmt* stmt, int current, const T& t)
     {
-        err_code_ = sqlite3_bind_blob(stmt, current, t.buf, t.size, SQLITE_TRANSIENT);
+        err_code_ = sqlite3_bind_blob(stmt, current, t.buf, t.size, bind_destructor_);
+    }
+
+    // bind text view，总是SQLITE_STATIC
+    template<typename T>
+    typename std::enable_if<std::is_same<T, SqliteTextView>::value>::type
+    BindValue(sqlite3_stmt* stmt, int current, const T& t)
+    {
+        err_code_ = sqlite3_bind_text(stmt, current, t.data, t.size, SQLITE_STATIC);
+    }
+
+    // bind blob view，总是SQLITE_STATIC。空指针会被绑定为NULL，长度为0时绑定空blob
+    template<typename T>
+    typename std::enable_if<std::is_same<T, SqliteBlobView>::value>::type
+    BindValue(sqlite3_stmt* stmt, int current, const T& t)
+    {
+        if (t.data == nullptr && t.size == 0) {
+            err_code_ = sqlite3_bind_zeroblob(stmt, current, 0);
+        } else {
+            err_code_ = sqlite3_bind_blob(stmt, current, t.data, t.size, SQLITE_STATIC);
+        }
     }
 
     // bind null
@@ -398,17 +1799,28 @@ private:
         return {nullptr, 0};
     }
 
-    // 取列的值
-    SqliteValue GetValue(sqlite3_stmt *stmt, const int& index)
+    // 取列的值。text和blob按sqlite3_column_bytes的长度复制，blob中可以有'\0'
+    SqliteValue GetValue(sqlite3_stmt *stmt, int index)
     {
-        int type = sqlite3_column_type(stmt, index);
-
-        // 根据列的类型调用对应的函数
-        auto it = valmap_.find(type);
-        if (it == valmap_.end()) {
-            throw std::logic_error("can not find this type: " + std::to_string(type));
+        switch (sqlite3_column_type(stmt, index)) {
+        case SQLITE_INTEGER:
+            return sqlite3_column_int64(stmt, index);
+        case SQLITE_FLOAT:
+            return sqlite3_column_double(stmt, index);
+        case SQLITE_TEXT: {
+            const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, index));
+            return std::string(text, sqlite3_column_bytes(stmt, index));
+        }
+        case SQLITE_BLOB: {
+            // 先取指针再取长度，空blob的指针为nullptr
+            const char* blob = static_cast<const char*>(sqlite3_column_blob(stmt, index));
+            return blob != nullptr ? std::string(blob, sqlite3_column_bytes(stmt, index)) : std::string();
+        }
+        case SQLITE_NULL:
+            return nullptr;
+        default:
+            throw std::logic_error("can not find this type: " + std::to_string(sqlite3_column_type(stmt, index)));
         }
-        return it->second(stmt, index);
     }
 
     // 启动事务写数据
@@ -468,42 +1880,113 @@ private:
         }
     }
 
-    // 根据查询结果构造json数组
-    void BuildJsonArray()
+    // Document::Populate使用的生成器，把查询结果作为SAX事件输出
+    struct JsonArrayGenerator
     {
-        // 获取查询结果列数
-        int col_count = sqlite3_column_count(sql_stmt_);
+        explicit JsonArrayGenerator(SmartDBSqlite& db) : db_(db) {}
 
-        json_builder_.StartArray();
-        while (true) {
-            err_code_ = sqlite3_step(sql_stmt_);
-            if (err_code_ == SQLITE_DONE) {
-                break;
-            }
+        template<typename Handler>
+        bool operator()(Handler& handler)
+        {
+            return db_.BuildJsonArray(handler);
+        }
+
+        SmartDBSqlite& db_;
+    };
 
-            // 构造一行查询结果的json对象
-            json_builder_.StartObject();
-            for (int i = 0; i < col_count; i++) {
-                // 构造key值
-                json_builder_.Key(sqlite3_column_name(sql_stmt_, i));
-                BuildJsonValue(sql_stmt_, i);
+    // 一条语句的列名，第一行读出后解析一次，逐行输出时不再查询列名、计算长度
+    // 列名复制到names中：sqlite在第一次step时可能重新编译语句，之前取得的列名指针会失效
+    struct ColumnNames
+    {
+        explicit ColumnNames(sqlite3_stmt* stmt)
+        {
+            int count = sqlite3_column_count(stmt);
+            offsets.reserve(count + 1);
+            for (int i = 0; i < count; i++) {
+                offsets.push_back(names.size());
+                names += sqlite3_column_name(stmt, i);
+                names += '\0';
             }
-            json_builder_.EndObject();
+            offsets.push_back(names.size());
+        }
+
+        int Count() const
+        {
+            return static_cast<int>(offsets.size()) - 1;
+        }
+
+        const char* Name(int i) const
+        {
+            return names.data() + offsets[i];
+        }
+
+        rapidjson::SizeType Length(int i) const
+        {
+            return static_cast<rapidjson::SizeType>(offsets[i + 1] - offsets[i] - 1);
+        }
+
+        std::string         names;
+        std::vector<size_t> offsets;
+    };
+
+    // 根据查询结果产生json数组的SAX事件，handler可以是Writer，也可以是Document
+    // 字符串都以copy方式输出，sqlite的内存在下一次step后失效
+    template<typename Handler>
+    bool BuildJsonArray(Handler& handler)
+    {
+        rapidjson::SizeType rows = 0;
+
+        handler.StartArray();
+        err_code_ = sqlite3_step(sql_stmt_);
+        if (err_code_ == SQLITE_ROW) {
+            const ColumnNames columns(sql_stmt_);
+            const int col_count = columns.Count();
+            do {
+                // 构造一行查询结果的json对象
+                handler.StartObject();
+                for (int i = 0; i < col_count; i++) {
+                    handler.Key(columns.Name(i), columns.Length(i), true);
+                    BuildJsonValue(sql_stmt_, i, handler);
+                }
+                handler.EndObject(static_cast<rapidjson::SizeType>(col_count));
+                rows++;
+            } while ((err_code_ = sqlite3_step(sql_stmt_)) == SQLITE_ROW);
         }
 
-        json_builder_.EndArray();
+        handler.EndArray(rows);
         sqlite3_reset(sql_stmt_);
+        return (err_code_ == SQLITE_DONE);
     }
 
     // 构造jsonvalue值
-    void BuildJsonValue(sqlite3_stmt* stmt, int index)
+    template<typename Handler>
+    void BuildJsonValue(sqlite3_stmt* stmt, int index, Handler& handler)
     {
-        int type = sqlite3_column_type(stmt, index);
-        auto it = buildmap_.find(type);
-        if (it == buildmap_.end()) {
+        switch (sqlite3_column_type(stmt, index)) {
+        case SQLITE_INTEGER:
+            handler.Int64(sqlite3_column_int64(stmt, index));
+            break;
+        case SQLITE_FLOAT:
+            handler.Double(sqlite3_column_double(stmt, index));
+            break;
+        case SQLITE_TEXT: {
+            const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, index));
+            handler.String(text, static_cast<rapidjson::SizeType>(sqlite3_column_bytes(stmt, index)), true);
+            break;
+        }
+        case SQLITE_BLOB: {
+            // blob字段要注意获取实际的流长度，先取指针再取长度
+            const char* blob = static_cast<const char*>(sqlite3_column_blob(stmt, index));
+            rapidjson::SizeType size = static_cast<rapidjson::SizeType>(sqlite3_column_bytes(stmt, index));
+            handler.String(blob != nullptr ? blob : "", size, true);    // 空blob的指针为nullptr
+            break;
+        }
+        case SQLITE_NULL:
+            handler.Null();
+            break;
+        default:
             throw std::invalid_argument("sqlite3 query can not find this type.");
         }
-        it->second(stmt, index, json_builder_);
     }
 
 private:
@@ -511,48 +1994,13 @@ private:
     int err_code_;
 
     // sqlite3句柄
-    sqlite3*      db_handle_;
-    sqlite3_stmt* sql_stmt_;
-
-    rapidjson::StringBuffer json_sbuf_;     // json字符串的buf
-    JsonBuilder json_builder_;
-
-    static std::unordered_map<int, std::function<SqliteValue(sqlite3_stmt*, int)>> valmap_;
-    static std::unordered_map<int, std::function<void(sqlite3_stmt*, int, JsonBuilder&)>> buildmap_;
-};
-
-std::unordered_map<int, std::function<SmartDBSqlite::SqliteValue(sqlite3_stmt*, int)>> 
-SmartDBSqlite::valmap_ = {
-    { std::make_pair(SQLITE_INTEGER, [](sqlite3_stmt* stmt, int index) {
-        return sqlite3_column_int64(stmt, index); }) },
-    { std::make_pair(SQLITE_FLOAT, [](sqlite3_stmt* stmt, int index) {
-        return sqlite3_column_double(stmt, index); }) },
-    { std::make_pair(SQLITE_TEXT, [](sqlite3_stmt* stmt, int index) {
-        return std::string((const char*)sqlite3_column_text(stmt, index)); }) },
-    { std::make_pair(SQLITE_BLOB, [](sqlite3_stmt* stmt, int index) {
-        return std::string((const char*)sqlite3_column_blob(stmt, index)); }) },
-    { std::make_pair(SQLITE_NULL, [](sqlite3_stmt* stmt, int index) {
-        return nullptr; }) }
-};
-
-std::unordered_map<int, std::function<void(sqlite3_stmt*, int, SmartDBSqlite::JsonBuilder&)>>
-SmartDBSqlite::buildmap_ = {
-    { std::make_pair(SQLITE_INTEGER, 
-        [](sqlite3_stmt* stmt, int index, SmartDBSqlite::JsonBuilder& builder) {
-            builder.Int64(sqlite3_column_int64(stmt, index)); }) },
-    { std::make_pair(SQLITE_FLOAT, 
-        [](sqlite3_stmt* stmt, int index, SmartDBSqlite::JsonBuilder& builder) {
-            builder.Double(sqlite3_column_double(stmt, index)); }) },
-    { std::make_pair(SQLITE_TEXT, 
-        [](sqlite3_stmt* stmt, int index, SmartDBSqlite::JsonBuilder& builder) {
-            builder.String((const char*)sqlite3_column_text(stmt, index)); }) },
-    { std::make_pair(SQLITE_BLOB, 
-        [](sqlite3_stmt* stmt, int index, SmartDBSqlite::JsonBuilder& builder) {
-            // blob字段要注意获取实际的流长度
-            builder.String((const char*)sqlite3_column_blob(stmt, index), sqlite3_column_bytes(stmt, index)); }) },
-    { std::make_pair(SQLITE_NULL, 
-        [](sqlite3_stmt* stmt, int index, SmartDBSqlite::JsonBuilder& builder) {
-            builder.Null(); }) }
+    sqlite3*       db_handle_;
+    sqlite3_stmt*  sql_stmt_;       // 当前语句，从stmt_cache_借出
+    StatementCache stmt_cache_;
+    StatementCache::Handle stmt_handle_;
+    QueryCache     query_cache_;    // 查询结果缓存，默认关闭
+    std::vector<BulkValue> bulk_values_;    // 批量插入的值缓冲区
+    sqlite3_destructor_type bind_destructor_;   // 字符串和blob参数的绑定方式
 };
 
 }
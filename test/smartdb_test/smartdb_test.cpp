@@ -13,11 +13,25 @@
 #include <cassert>
 #include <cstdlib>
 #include <cassert>
+#include <tuple>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <algorithm>
 
 #include "smartdb_sqlite.h"
+#include "smartdb_pool.h"
+#include "smartdb_writer.h"
+#include "smartdb_scan.h"
+#include "smartdb_column.h"
 #include "util.h"
 
 #include "rapidjson/filereadstream.h"
+#include "rapidjson/filewritestream.h"
 
 //////////////////////////////////////////////////////////////
 // 创建表
@@ -190,6 +204,206 @@ void SmartDBTransactionTest(int count)
     }
 }
 
+//////////////////////////////////////////////////////////////
+// 批量插入，与SmartDBTransactionTest插入相同的行数
+void SmartDBBulkInsertTest(int count, size_t rows_per_stmt)
+{
+    std::shared_ptr<smartdb::SmartDBSqlite> db = std::make_shared<smartdb::SmartDBSqlite>();
+    assert(db != nullptr);
+
+    if (!db->Open(g_dbname, nullptr)) {
+        std::cerr << "create db[" << g_dbname << "] failed, error code: "
+                  << db ->GetLastErrCode() << std::endl;
+        return;
+    }
+
+    // 行数据源，逐行生成数据，不需要先把全部数据放到内存中
+    int i = 1;
+    std::string name, addr;
+    auto source = [&](smartdb::SmartDBSqlite::BulkRow& row) {
+        if (i >= count) {
+            return false;
+        }
+        name = "Peter" + std::to_string(i);
+        addr = "address - " + std::to_string(i);
+        row.Bind(i, name, addr);
+        i++;
+        return true;
+    };
+
+    try {
+        util::TimeSpan ts;
+        if (!db->BulkInsert("Person", {"ID", "Name", "Address"}, source, 100000, rows_per_stmt)) {
+            std::cerr << "bulk insert failed, error code: " << db ->GetLastErrCode() << std::endl;
+            return;
+        }
+        auto span = ts.Span();
+        std::cout << rows_per_stmt << " rows per statement: " << span << " ms, count = " << count
+                  << ", table count = " << db->ExcecuteScalar<sqlite3_int64>("select count(1) from Person;")
+                  << std::endl;
+    } catch (const std::logic_error& e) {
+        std::cerr << "logic_error: " << e.what() << std::endl;
+    }
+}
+
+//////////////////////////////////////////////////////////////
+// 预编译语句缓存，对比关闭缓存（每次重新编译）和打开缓存的耗时
+void SmartDBStatementCacheTest(int count)
+{
+    const std::string sql_insert = "INSERT INTO Person(ID, Name, Address) VALUES(?, ?, ?);";
+    const std::string sql_scalar = "select changes();";
+
+    for (size_t capacity : {size_t(0), size_t(64)}) {
+        std::shared_ptr<smartdb::SmartDBSqlite> db = std::make_shared<smartdb::SmartDBSqlite>();
+        if (!db->Open(g_dbname, nullptr)) {
+            std::cerr << "create db[" << g_dbname << "] failed, error code: "
+                      << db ->GetLastErrCode() << std::endl;
+            return;
+        }
+        db->SetStatementCacheSize(capacity);
+
+        util::TimeSpan ts;
+        try {
+            db->Begin();
+            for (int i = 0; i < count; i++) {
+                std::string name = "Peter" + std::to_string(i);
+                std::string addr = "address - " + std::to_string(i);
+                if (!db->Excecute(sql_insert, i, name, addr)) {
+                    std::cerr << "insert table failed, error code: " << db ->GetLastErrCode() << std::endl;
+                    db->RollBack();
+                    return;
+                }
+                db->ExcecuteScalar<sqlite3_int64>(sql_scalar);
+            }
+            db->RollBack();     // 只测量耗时，不保留数据
+        } catch (const std::logic_error& e) {
+            std::cerr << "logic_error: " << e.what() << std::endl;
+        }
+
+        auto stats = db->GetStatementCacheStats();
+        std::cout << "cache capacity " << capacity << ": " << ts.Span() << " ms, size = " << stats.size
+                  << ", hits = " << stats.hits << ", misses = " << stats.misses
+                  << ", evictions = " << stats.evictions << std::endl;
+    }
+
+    // 游标未关闭时不能关闭连接，缓存的语句和同一SQL额外编译的语句都算借出
+    smartdb::SmartDBSqlite db;
+    db.Open(":memory:", nullptr);
+    db.Excecute("CREATE TABLE Numbers (ID INTEGER PRIMARY KEY);");
+    for (int i = 1; i <= 3; i++) {
+        db.Excecute("INSERT INTO Numbers(ID) VALUES(?);", i);
+    }
+    const std::string sql_select = "SELECT ID FROM Numbers ORDER BY ID;";
+    sqlite3_int64 total = 0;
+    {
+        auto cached = db.QueryCursor<std::tuple<sqlite3_int64>>(sql_select);
+        auto extra = db.QueryCursor<std::tuple<sqlite3_int64>>(sql_select);
+        bool closed = db.Close();
+        std::cout << "close with open cursors: " << std::boolalpha << closed
+                  << ", error code = " << db.GetLastErrCode() << std::endl;
+        assert(!closed && db.GetLastErrCode() == SQLITE_BUSY);
+        for (auto& row : cached) {
+            total += std::get<0>(row);
+        }
+        for (auto& row : extra) {
+            total += std::get<0>(row);
+        }
+    }
+    bool closed = db.Close();
+    std::cout << "close after cursors finished: " << closed << ", sum = " << total << std::endl;
+    assert(closed && total == 12);
+}
+
+//////////////////////////////////////////////////////////////
+// 游标查询，与sqlite3原生的step循环以及Query（构造json）对比
+struct Person
+{
+    int64_t     id;
+    std::string name;
+    std::string address;
+};
+
+namespace smartdb {
+template<>
+struct RowReader<Person>
+{
+    static void Read(sqlite3_stmt* stmt, Person& p)
+    {
+        ColumnReader<int64_t>::Read(stmt, 0, p.id);
+        ColumnReader<std::string>::Read(stmt, 1, p.name);
+        ColumnReader<std::string>::Read(stmt, 2, p.address);
+    }
+};
+}
+
+void SmartDBCursorTest()
+{
+    const std::string sql_query = "SELECT ID, Name, Address FROM Person;";
+
+    std::shared_ptr<smartdb::SmartDBSqlite> db = std::make_shared<smartdb::SmartDBSqlite>();
+    if (!db->Open(g_dbname, nullptr)) {
+        std::cerr << "create db[" << g_dbname << "] failed, error code: "
+                  << db ->GetLastErrCode() << std::endl;
+        return;
+    }
+
+    // sqlite3原生接口
+    util::TimeSpan ts;
+    sqlite3* handle = nullptr;
+    sqlite3_open(g_dbname.c_str(), &handle);
+    sqlite3_stmt* stmt = nullptr;
+    sqlite3_prepare_v2(handle, sql_query.c_str(), -1, &stmt, nullptr);
+    int64_t sum = 0;
+    size_t bytes = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        sum += sqlite3_column_int64(stmt, 0);
+        bytes += sqlite3_column_bytes(stmt, 1) + sqlite3_column_bytes(stmt, 2);
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(handle);
+    std::cout << "raw step loop: " << ts.Span() << " ms, sum = " << sum << ", bytes = " << bytes << std::endl;
+
+    // 游标，tuple
+    ts.Reset();
+    sum = 0;
+    bytes = 0;
+    auto cursor = db->QueryCursor<std::tuple<int64_t, std::string, std::string>>(sql_query);
+    for (auto& row : cursor) {
+        sum += std::get<0>(row);
+        bytes += std::get<1>(row).size() + std::get<2>(row).size();
+    }
+    std::cout << "tuple cursor : " << ts.Span() << " ms, sum = " << sum << ", bytes = " << bytes
+              << ", done = " << std::boolalpha << (cursor.GetLastErrCode() == SQLITE_DONE) << std::endl;
+
+    // 游标，结构体
+    ts.Reset();
+    sum = 0;
+    bytes = 0;
+    auto person_cursor = db->QueryCursor<Person>(sql_query);
+    while (person_cursor.Next()) {
+        const Person& p = person_cursor.Get();
+        sum += p.id;
+        bytes += p.name.size() + p.address.size();
+    }
+    std::cout << "struct cursor: " << ts.Span() << " ms, sum = " << sum << ", bytes = " << bytes << std::endl;
+
+    // Query构造json
+    ts.Reset();
+    sum = 0;
+    auto doc = db->Query(sql_query);
+    for (auto& v : doc->GetArray()) {
+        sum += v["ID"].GetInt64();
+    }
+    std::cout << "json query   : " << ts.Span() << " ms, sum = " << sum << std::endl;
+
+    // 游标遍历时执行其他语句
+    auto id_cursor = db->QueryCursor<std::tuple<int, const char*>>("SELECT ID, Name FROM Person WHERE ID < ?;", 3);
+    for (auto& row : id_cursor) {
+        auto count = db->ExcecuteScalar<sqlite3_int64>("select count(1) from Person where ID=?;", std::get<0>(row));
+        std::cout << "ID = " << std::get<0>(row) << ", Name = " << std::get<1>(row) << ", count = " << count << std::endl;
+    }
+}
+
 //////////////////////////////////////////////////////////////
 // 查询数据库
 
@@ -228,6 +442,950 @@ void SmartDBQueryTest()
     }
 }
 
+//////////////////////////////////////////////////////////////
+// 查询结果直接构造Document，以及流式写入文件
+void SmartDBQueryStreamTest()
+{
+    const std::string sql_query = "SELECT * FROM Person;";
+
+    std::shared_ptr<smartdb::SmartDBSqlite> db = std::make_shared<smartdb::SmartDBSqlite>();
+    if (!db->Open(g_dbname, nullptr)) {
+        std::cerr << "create db[" << g_dbname << "] failed, error code: "
+                  << db ->GetLastErrCode() << std::endl;
+        return;
+    }
+
+    util::TimeSpan ts;
+    auto doc = db->Query(sql_query);
+    std::cout << "query document: " << ts.Span() << " ms, rows = " << doc->Size() << std::endl;
+
+    // 每次写满缓冲区就写入文件，内存占用只有缓冲区大小
+    ts.Reset();
+    FILE* fp = fopen("person_query.json", "w");
+    assert(fp != NULL);
+    char buf[65536];
+    rapidjson::FileWriteStream os(fp, buf, sizeof(buf));
+    bool ok = db->QueryToStream(os, sql_query);
+    long size = ftell(fp);
+    fclose(fp);
+    std::cout << "query to file: " << ts.Span() << " ms, ok = " << std::boolalpha << ok
+              << ", file size = " << size << std::endl;
+
+    rapidjson::StringBuffer buffer;
+    db->QueryToStream(buffer, "SELECT * FROM Person WHERE ID=?;", 5000);
+    std::cout << "query to buffer: " << buffer.GetString() << std::endl;
+}
+
+//////////////////////////////////////////////////////////////
+// 连接参数，对比默认参数和各个预设的逐行插入（每行一个事务）、批量插入和查询的耗时，以及运行时切换
+const std::string g_options_dbname = "options_test.db";
+
+void RemoveDB(const std::string& db_name)
+{
+    std::remove(db_name.c_str());
+    std::remove((db_name + "-wal").c_str());
+    std::remove((db_name + "-shm").c_str());
+    std::remove((db_name + "-journal").c_str());
+}
+
+void SmartDBOptionsBench(const char* name, const smartdb::SmartDBOptions& options, int count)
+{
+    RemoveDB(g_options_dbname);
+    smartdb::SmartDBSqlite db;
+    if (!db.Open(g_options_dbname, options)) {
+        std::cerr << "open db[" << g_options_dbname << "] with " << name << " failed, error code: "
+                  << db.GetLastErrCode() << std::endl;
+        return;
+    }
+    db.Excecute("CREATE TABLE OptionsTest (ID INTEGER PRIMARY KEY, Name TEXT);");
+
+    util::TimeSpan ts;
+    for (int i = 1; i <= count; i++) {
+        db.Excecute("INSERT INTO OptionsTest(ID, Name) VALUES(?, ?);", i, "name" + std::to_string(i));
+    }
+    auto single = ts.Span();
+
+    ts.Reset();
+    int id = count;
+    db.BulkInsert("OptionsTest", {"ID", "Name"}, [&](smartdb::SmartDBSqlite::BulkRow& row) {
+        if (id >= count * 100) {
+            return false;
+        }
+        id++;
+        row.Bind(id, "name" + std::to_string(id));
+        return true;
+    });
+    auto bulk = ts.Span();
+
+    ts.Reset();
+    sqlite3_int64 sum = 0;
+    for (int n = 0; n < 10; n++) {
+        for (auto& row : db.QueryCursor<std::tuple<sqlite3_int64>>("SELECT ID FROM OptionsTest;")) {
+            sum += std::get<0>(row);
+        }
+    }
+    auto scan = ts.Span();
+
+    std::cout << name << ": journal_mode = " << db.ExcecuteScalar<std::string>("PRAGMA journal_mode;")
+              << ", synchronous = " << db.ExcecuteScalar<sqlite3_int64>("PRAGMA synchronous;")
+              << ", " << count << " single inserts " << single << " ms, "
+              << count * 99 << " bulk inserts " << bulk << " ms, 10 scans " << scan << " ms, sum = " << sum
+              << std::endl;
+}
+
+void SmartDBOptionsTest(int count)
+{
+    SmartDBOptionsBench("default  ", smartdb::SmartDBOptions(), count);
+    SmartDBOptionsBench("durable  ", smartdb::SmartDBOptions::Durable(), count);
+    SmartDBOptionsBench("balanced ", smartdb::SmartDBOptions::Balanced(), count);
+    SmartDBOptionsBench("bulk load", smartdb::SmartDBOptions::BulkLoad(), count);
+
+    // 运行时切换：导入前切换到BulkLoad，导入后切换回Balanced
+    RemoveDB(g_options_dbname);
+    smartdb::SmartDBSqlite db;
+    smartdb::SmartDBOptions balanced = smartdb::SmartDBOptions::Balanced();
+    bool ok = db.Open(g_options_dbname, balanced);
+    assert(ok);
+    ok = db.ApplyOptions(smartdb::SmartDBOptions::BulkLoad());
+    std::cout << "switch to bulk load: " << std::boolalpha << ok << ", journal_mode = "
+              << db.ExcecuteScalar<std::string>("PRAGMA journal_mode;") << std::endl;
+    ok = db.ApplyOptions(balanced);
+    std::cout << "switch to balanced: " << ok << ", journal_mode = "
+              << db.ExcecuteScalar<std::string>("PRAGMA journal_mode;") << std::endl;
+
+    // 还有其他连接时不能离开WAL，切换失败
+    smartdb::SmartDBSqlite other;
+    other.Open(g_options_dbname, balanced);
+    other.Excecute("CREATE TABLE IF NOT EXISTS OptionsTest (ID INTEGER PRIMARY KEY, Name TEXT);");
+    ok = db.ApplyOptions(smartdb::SmartDBOptions::BulkLoad());
+    std::cout << "switch to bulk load with another connection: " << ok << ", error code = "
+              << db.GetLastErrCode() << ", journal_mode = "
+              << db.ExcecuteScalar<std::string>("PRAGMA journal_mode;") << std::endl;
+    assert(!ok);
+}
+
+//////////////////////////////////////////////////////////////
+// 连接池，多线程按主键读取，对比多个线程共享一个加锁的连接；再加入一个写线程，测试读写并发
+const std::string g_pool_dbname = "pool_test.db";
+
+using PoolRow = std::tuple<int, std::string, double>;
+
+// 按主键读取lookups次，返回读到的行数
+template<typename GetDB>
+int PoolLookup(GetDB&& get_db, int rows, int lookups, unsigned seed)
+{
+    int found = 0;
+    for (int i = 0; i < lookups; i++) {
+        seed = seed * 1103515245 + 12345;
+        int id = static_cast<int>(seed % rows) + 1;
+        found += get_db([id](smartdb::SmartDBSqlite& db) {
+            auto cursor = db.QueryCursor<PoolRow>("SELECT ID, Name, Value FROM PoolTest WHERE ID = ?;", id);
+            return (cursor.Next() && std::get<0>(cursor.Get()) == id) ? 1 : 0;
+        });
+    }
+    return found;
+}
+
+// 启动threads个读线程，返回每秒读取次数
+template<typename GetDB>
+int64_t PoolReadBench(GetDB get_db, int threads, int rows, int lookups)
+{
+    std::atomic<int> found(0);
+    std::vector<std::thread> workers;
+    util::TimeSpan ts;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            found += PoolLookup(get_db, rows, lookups, static_cast<unsigned>(t + 1));
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    auto span = ts.SpanMicro();
+    assert(found == threads * lookups);
+    return static_cast<int64_t>(threads) * lookups * 1000000 / (span > 0 ? span : 1);
+}
+
+void SmartDBPoolTest(int rows, int lookups)
+{
+    RemoveDB(g_pool_dbname);
+
+    size_t pool_size = std::max(4u, std::thread::hardware_concurrency());
+    smartdb::SmartDBPool pool;
+    if (!pool.Open(g_pool_dbname, pool_size)) {
+        std::cerr << "open pool[" << g_pool_dbname << "] failed, error code: "
+                  << pool.GetLastErrCode() << std::endl;
+        return;
+    }
+
+    {
+        auto conn = pool.Acquire();
+        conn->Excecute("CREATE TABLE PoolTest (ID INTEGER PRIMARY KEY, Name TEXT, Value REAL);");
+        int i = 0;
+        conn->BulkInsert("PoolTest", {"ID", "Name", "Value"}, [&](smartdb::SmartDBSqlite::BulkRow& row) {
+            if (i >= rows) {
+                return false;
+            }
+            i++;
+            row.Bind(i, "name" + std::to_string(i), i * 0.5);
+            return true;
+        });
+        std::cout << "pool size = " << pool_size << ", journal mode = "
+                  << conn->ExcecuteScalar<std::string>("PRAGMA journal_mode;") << ", rows = "
+                  << conn->ExcecuteScalar<sqlite3_int64>("SELECT count(1) FROM PoolTest;") << std::endl;
+    }
+
+    // 对照：一个连接，所有线程加锁使用
+    smartdb::SmartDBSqlite shared_db;
+    shared_db.Open(g_pool_dbname, nullptr);
+    std::mutex shared_mtx;
+    auto locked = [&](const std::function<int(smartdb::SmartDBSqlite&)>& func) {
+        std::lock_guard<std::mutex> locker(shared_mtx);
+        return func(shared_db);
+    };
+    auto pooled = [&](const std::function<int(smartdb::SmartDBSqlite&)>& func) {
+        auto conn = pool.Acquire();
+        return func(*conn);
+    };
+
+    for (int threads : {1, 2, 4, 8}) {
+        std::cout << threads << " reader threads: shared connection "
+                  << PoolReadBench(locked, threads, rows, lookups) << " reads/s, pool "
+                  << PoolReadBench(pooled, threads, rows, lookups) << " reads/s" << std::endl;
+    }
+    shared_db.Close();
+
+    // 读写并发：一个写线程逐行更新，WAL模式下读线程不被阻塞
+    std::atomic<bool> stop(false);
+    std::atomic<int> writes(0);
+    std::thread writer([&] {
+        while (!stop) {
+            auto conn = pool.Acquire();
+            int id = writes % rows + 1;
+            if (!conn->Excecute("UPDATE PoolTest SET Value = Value + 1 WHERE ID = ?;", id)) {
+                std::cerr << "pool update failed, error code: " << conn->GetLastErrCode() << std::endl;
+                return;
+            }
+            writes++;
+        }
+    });
+    util::TimeSpan ts;
+    int64_t reads = PoolReadBench(pooled, 4, rows, lookups);
+    stop = true;
+    writer.join();
+    auto span = ts.Span();
+    std::cout << "4 readers + 1 writer: " << reads << " reads/s, "
+              << writes * 1000 / (span > 0 ? span : 1) << " writes/s" << std::endl;
+}
+
+//////////////////////////////////////////////////////////////
+// 异步写入，对比调用线程同步写入（每次调用一个事务）和写线程合并提交的吞吐量和调用延迟
+const std::string g_writer_dbname = "writer_test.db";
+const std::string sql_writer_insert = "INSERT INTO WriterTest(ID, Name) VALUES(?, ?);";
+
+// 输出延迟的中位数和p99，单位微秒
+void PrintLatency(const char* name, std::vector<int64_t>& latency, int64_t span)
+{
+    std::sort(latency.begin(), latency.end());
+    std::cout << name << ": " << latency.size() * 1000 / (span > 0 ? span : 1) << " writes/s, latency p50 = "
+              << latency[latency.size() / 2] << " us, p99 = " << latency[latency.size() * 99 / 100] << " us"
+              << std::endl;
+}
+
+// threads个线程各执行count次write(id)，记录每次调用的耗时
+template<typename Write>
+void WriterBench(const char* name, int threads, int count, Write write)
+{
+    std::vector<std::vector<int64_t>> latency(threads);
+    std::vector<std::thread> workers;
+    util::TimeSpan ts;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            latency[t].reserve(count);
+            for (int i = 0; i < count; i++) {
+                util::TimeSpan call;
+                write(t * count + i + 1);
+                latency[t].push_back(call.SpanMicro());
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    auto span = ts.Span();
+
+    std::vector<int64_t> all;
+    for (auto& l : latency) {
+        all.insert(all.end(), l.begin(), l.end());
+    }
+    PrintLatency(name, all, span);
+}
+
+void SmartDBWriterTest(int threads, int count)
+{
+    const smartdb::SmartDBOptions durable = smartdb::SmartDBOptions::Durable();
+    const std::string sql_create = "CREATE TABLE WriterTest (ID INTEGER PRIMARY KEY, Name TEXT);";
+
+    // 同步写入：一个连接加锁使用，每次调用在调用线程中提交一个事务
+    {
+        RemoveDB(g_writer_dbname);
+        smartdb::SmartDBSqlite db;
+        db.Open(g_writer_dbname, durable);
+        db.Excecute(sql_create);
+        std::mutex mtx;
+        WriterBench("sync per call        ", threads, count, [&](int id) {
+            std::lock_guard<std::mutex> locker(mtx);
+            bool ok = db.Excecute(sql_writer_insert, id, "name" + std::to_string(id));
+            assert(ok);
+            (void)ok;
+        });
+    }
+
+    // 异步写入，提交后等待结果：多个线程的写操作合并到一个事务中
+    {
+        RemoveDB(g_writer_dbname);
+        smartdb::SmartDBWriter writer;
+        writer.Open(g_writer_dbname, durable);
+        writer.Submit([&](smartdb::SmartDBSqlite& db) { return db.Excecute(sql_create); }).get();
+        WriterBench("async submit + wait  ", threads, count, [&](int id) {
+            bool ok = writer.Excecute(sql_writer_insert, id, "name" + std::to_string(id)).get();
+            assert(ok);
+            (void)ok;
+        });
+        auto stats = writer.GetStats();
+        std::cout << "    batches = " << stats.batches << ", max batch = " << stats.max_batch << std::endl;
+    }
+
+    // 异步写入，只提交不等待：调用者不等待fsync，最后统一检查结果
+    {
+        RemoveDB(g_writer_dbname);
+        smartdb::SmartDBWriter writer;
+        writer.Open(g_writer_dbname, durable);
+        writer.Submit([&](smartdb::SmartDBSqlite& db) { return db.Excecute(sql_create); }).get();
+        std::vector<std::vector<std::future<bool>>> futures(threads);
+        util::TimeSpan ts;
+        WriterBench("async submit (enqueue)", threads, count, [&](int id) {
+            futures[(id - 1) / count].push_back(writer.Excecute(sql_writer_insert, id, "name" + std::to_string(id)));
+        });
+        writer.Flush();
+        auto span = ts.Span();
+
+        int ok = 0;
+        for (auto& f : futures) {
+            for (auto& future : f) {
+                ok += future.get() ? 1 : 0;
+            }
+        }
+        auto stats = writer.GetStats();
+        std::cout << "    committed " << ok << " writes in " << span << " ms, batches = " << stats.batches
+                  << ", max batch = " << stats.max_batch << std::endl;
+        assert(ok == threads * count);
+
+        // 失败的写操作只回滚自己：主键冲突
+        auto dup = writer.Excecute(sql_writer_insert, 1, "dup");
+        auto next = writer.Excecute(sql_writer_insert, threads * count + 1, "next");
+        bool dup_ok = dup.get();
+        bool next_ok = next.get();
+        std::cout << "    duplicate key: " << std::boolalpha << dup_ok << ", next write: " << next_ok << std::endl;
+        assert(!dup_ok && next_ok);
+
+        // 指针和视图参数在提交时复制内容，原来的内存提交后立即释放
+        std::future<bool> owned;
+        {
+            std::string name = "owned" + std::to_string(threads * count + 2);
+            owned = writer.Excecute(sql_writer_insert, threads * count + 2,
+                smartdb::SqliteTextView{name.data(), static_cast<int>(name.size())});
+            name.assign(name.size(), 'x');
+        }
+        auto null_name = writer.Excecute(sql_writer_insert, threads * count + 3, static_cast<const char*>(nullptr));
+        assert(owned.get() && null_name.get());
+        writer.Flush();
+
+        smartdb::SmartDBSqlite db;
+        db.Open(g_writer_dbname, durable);
+        auto owned_name = db.ExcecuteScalar<std::string>("SELECT Name FROM WriterTest WHERE ID = ?;", threads * count + 2);
+        auto null_count = db.ExcecuteScalar<sqlite3_int64>("SELECT count(1) FROM WriterTest WHERE Name IS NULL;");
+        std::cout << "    copied view argument: " << owned_name << ", null names: " << null_count << std::endl;
+        assert(owned_name == "owned" + std::to_string(threads * count + 2) && null_count == 1);
+    }
+}
+
+//////////////////////////////////////////////////////////////
+// 结构体映射，SMARTDB_REFLECT生成的Insert/Update/Select，与Query构造json后再转换为结构体对比
+struct Employee
+{
+    int64_t     ID;
+    std::string Name;
+    double      Salary;
+    int         Age;
+};
+
+SMARTDB_REFLECT(Employee, ID, Name, Salary, Age)
+
+const std::string g_reflect_dbname = "reflect_test.db";
+
+void SmartDBReflectTest(int count)
+{
+    RemoveDB(g_reflect_dbname);
+    smartdb::SmartDBSqlite db;
+    if (!db.Open(g_reflect_dbname, smartdb::SmartDBOptions::Balanced()) || !db.CreateTable<Employee>()) {
+        std::cerr << "create db[" << g_reflect_dbname << "] failed, error code: "
+                  << db.GetLastErrCode() << std::endl;
+        return;
+    }
+
+    // 单行插入、更新、查询
+    Employee e{1, "Peter", 1000.5, 30};
+    bool ok = db.Insert(e);
+    e.Salary = 2000.25;
+    e.Age = 31;
+    ok = ok && db.Update(e);
+    auto found = db.Select<Employee>("ID = ?", 1);
+    assert(ok && found.size() == 1 && found[0].Name == "Peter" && found[0].Salary == 2000.25 && found[0].Age == 31);
+    std::cout << "insert and update: ID = " << found[0].ID << ", Name = " << found[0].Name
+              << ", Salary = " << found[0].Salary << ", Age = " << found[0].Age << std::endl;
+
+    // 批量插入
+    std::vector<Employee> employees;
+    employees.reserve(count);
+    for (int i = 2; i <= count; i++) {
+        employees.push_back(Employee{i, "name" + std::to_string(i), i * 1.5, 20 + i % 40});
+    }
+    util::TimeSpan ts;
+    ok = db.BulkInsert(employees);
+    std::cout << "bulk insert " << employees.size() << " rows: " << ts.Span() << " ms, ok = "
+              << std::boolalpha << ok << std::endl;
+    employees.clear();
+    employees.shrink_to_fit();
+
+    // 直接映射到结构体
+    ts.Reset();
+    auto rows = db.Select<Employee>();
+    auto span = ts.Span();
+    double sum = 0;
+    for (auto& row : rows) {
+        sum += row.Salary;
+    }
+    std::cout << "select " << rows.size() << " rows: " << span << " ms, salary sum = " << sum << std::endl;
+    assert(static_cast<int>(rows.size()) == count);
+    rows.clear();
+    rows.shrink_to_fit();
+
+    // 原来的方式：Query构造json，再逐个字段转换
+    ts.Reset();
+    auto doc = db.Query("SELECT ID, Name, Salary, Age FROM Employee;");
+    std::vector<Employee> converted;
+    converted.reserve(doc->Size());
+    for (auto& v : doc->GetArray()) {
+        converted.push_back(Employee{v["ID"].GetInt64(), v["Name"].GetString(),
+            v["Salary"].GetDouble(), v["Age"].GetInt()});
+    }
+    span = ts.Span();
+    sum = 0;
+    for (auto& row : converted) {
+        sum += row.Salary;
+    }
+    std::cout << "json query + convert " << converted.size() << " rows: " << span << " ms, salary sum = "
+              << sum << std::endl;
+}
+
+//////////////////////////////////////////////////////////////
+// 分区并行聚合，与单连接执行同样的聚合SQL对比
+const std::string g_scan_dbname = "scan_test.db";
+
+void SmartDBScanTest(int rows)
+{
+    RemoveDB(g_scan_dbname);
+    {
+        smartdb::SmartDBSqlite db;
+        if (!db.Open(g_scan_dbname, smartdb::SmartDBOptions::Balanced()) || !db.CreateTable<Employee>()) {
+            std::cerr << "create db[" << g_scan_dbname << "] failed, error code: " << db.GetLastErrCode() << std::endl;
+            return;
+        }
+        std::vector<Employee> employees;
+        employees.reserve(rows);
+        for (int i = 1; i <= rows; i++) {
+            employees.push_back(Employee{i, "name" + std::to_string(i % 1000), i * 1.5, 20 + i % 40});
+        }
+        db.BulkInsert(employees);
+    }
+
+    const std::string sql = "SELECT Age, count(*), sum(Salary), min(Name), max(ID) FROM Employee "
+                            "WHERE Age <> 30 GROUP BY Age;";
+    const std::vector<smartdb::ScanAggregate> aggregates = {
+        {smartdb::AggregateFunc::Count, "*"}, {smartdb::AggregateFunc::Sum, "Salary"},
+        {smartdb::AggregateFunc::Min, "Name"}, {smartdb::AggregateFunc::Max, "ID"}
+    };
+
+    // 单连接
+    smartdb::SmartDBSqlite db;
+    db.Open(g_scan_dbname, smartdb::SmartDBScanner::ScanOptions(), SQLITE_OPEN_READONLY);
+    util::TimeSpan ts;
+    std::vector<smartdb::ScanRow> expected;
+    for (auto& row : db.QueryCursor<smartdb::ScanRow>(sql)) {
+        expected.push_back(row);
+    }
+    std::cout << "single connection: " << ts.Span() << " ms, groups = " << expected.size() << std::endl;
+
+    for (size_t connections : {1, 2, 4, 8}) {
+        smartdb::SmartDBScanner scanner;
+        if (!scanner.Open(g_scan_dbname, connections)) {
+            std::cerr << "open scanner failed, error code: " << scanner.GetLastErrCode() << std::endl;
+            return;
+        }
+
+        ts.Reset();
+        auto result = scanner.Aggregate("Employee", aggregates, "Age", "Age <> 30");
+        auto span = ts.Span();
+
+        bool same = result.size() == expected.size();
+        for (size_t r = 0; same && r < result.size(); r++) {
+            auto& a = result[r].values;
+            auto& b = expected[r].values;
+            same = a[0].i == b[0].i && a[1].i == b[1].i && a[2].d == b[2].d && a[3].str == b[3].str && a[4].i == b[4].i;
+        }
+        std::cout << "scanner " << connections << " connections: " << span << " ms, groups = " << result.size()
+                  << ", same = " << std::boolalpha << same << std::endl;
+        assert(same);
+    }
+
+    // 不分组，空结果，以及自定义的分区函数
+    smartdb::SmartDBScanner scanner;
+    scanner.Open(g_scan_dbname, 4);
+    auto total = scanner.Aggregate("Employee", {{smartdb::AggregateFunc::Count, "*"},
+        {smartdb::AggregateFunc::Max, "Salary"}});
+    auto none = scanner.Aggregate("Employee", {{smartdb::AggregateFunc::Count, "*"},
+        {smartdb::AggregateFunc::Min, "ID"}}, "", "ID < 0");
+    assert(total.size() == 1 && total[0].values[0].i == rows && total[0].values[1].d == rows * 1.5);
+    assert(none.size() == 1 && none[0].values[0].i == 0 && none[0].values[1].IsNull());
+
+    auto counts = scanner.ScanPartitions("Employee", [](smartdb::SmartDBSqlite& db, sqlite3_int64 first, sqlite3_int64 last) {
+        return db.ExcecuteScalar<sqlite3_int64>("SELECT count(*) FROM Employee WHERE rowid BETWEEN ? AND ?;", first, last);
+    });
+    sqlite3_int64 sum = 0;
+    for (auto n : counts) {
+        sum += n;
+    }
+    std::cout << "partitions = " << counts.size() << ", rows = " << sum << std::endl;
+    assert(sum == rows);
+
+    // 第一行和最后一行在不同区间，各区间的sum不溢出，合并时溢出，与单条sqlite查询一样报错
+    const std::string big = "CASE WHEN ID = 1 OR ID = " + std::to_string(rows) + " THEN 9000000000000000000 ELSE 0 END";
+    bool overflow = false;
+    try {
+        scanner.Aggregate("Employee", {{smartdb::AggregateFunc::Sum, big}});
+    } catch (const std::logic_error& e) {
+        overflow = true;
+        std::cout << "merge sum: " << e.what() << std::endl;
+    }
+    assert(overflow);
+}
+
+//////////////////////////////////////////////////////////////
+// 列式导出：NULL、类型推断和分块的正确性；大表导出与json导出对比，mmap打开后直接遍历列
+void SmartDBColumnRoundTrip()
+{
+    smartdb::SmartDBSqlite db;
+    db.Open(":memory:", nullptr);
+    db.Excecute("CREATE TABLE Mixed (ID INTEGER, Name TEXT, Score REAL, Data BLOB, Extra);");
+    for (int i = 0; i < 10; i++) {
+        char data[] = {'x', '\0', static_cast<char>('0' + i)};
+        smartdb::SqliteBlob blob{data, i % 3 == 0 ? 0 : 3};
+        if (i % 4 == 1) {
+            db.Excecute("INSERT INTO Mixed VALUES(?, NULL, NULL, NULL, NULL);", i);
+        } else {
+            db.Excecute("INSERT INTO Mixed VALUES(?, ?, ?, ?, ?);", i, "name" + std::to_string(i % 2), i * 0.5, blob, i);
+        }
+    }
+
+    // 每块4行，Extra没有声明类型，第一块中间才出现非NULL值
+    smartdb::ColumnExporter exporter(4);
+    const std::string path = "mixed.sdbc";
+    bool ok = exporter.Export(db, path, "SELECT ID, Name, Score, Data, Extra, Score * 2 AS Twice FROM Mixed WHERE ID >= ?;", 1);
+    smartdb::ColumnFile file;
+    ok = ok && file.Open(path);
+    assert(ok && file.Rows() == 9 && file.Chunks() == 3 && file.Columns() == 6);
+    assert(file.Kind(1) == smartdb::ColumnKind::String && file.Kind(3) == smartdb::ColumnKind::Blob);
+    assert(file.Kind(4) == smartdb::ColumnKind::Int64 && file.Kind(5) == smartdb::ColumnKind::Double);
+    assert(file.FindColumn("Twice") == 5 && file.FindColumn("none") == -1);
+
+    size_t row = 0;
+    for (size_t chunk = 0; chunk < file.Chunks(); chunk++) {
+        auto ids = file.Int64Column(chunk, 0);
+        auto names = file.StringColumn(chunk, 1);
+        auto scores = file.DoubleColumn(chunk, 2);
+        auto blobs = file.BlobColumn(chunk, 3);
+        auto extras = file.Int64Column(chunk, 4);
+        for (size_t i = 0; i < ids.size; i++, row++) {
+            int id = static_cast<int>(row + 1);
+            bool null = id % 4 == 1;
+            assert(ids[i] == id && names.IsNull(i) == null && scores.IsNull(i) == null && extras.IsNull(i) == null);
+            if (!null) {
+                smartdb::SqliteTextView name = names[i];
+                assert(name.ToString() == "name" + std::to_string(id % 2) && scores[i] == id * 0.5 && extras[i] == id);
+                assert(blobs[i].size == (id % 3 == 0 ? 0 : 3));
+            }
+        }
+        assert(names.dict_size <= 2);   // 每块的字典只保存不同的值
+    }
+    std::cout << "round trip: rows = " << row << ", chunks = " << file.Chunks() << ", columns = "
+              << file.Columns() << std::endl;
+    file.Close();
+
+    // 损坏每行的字典编码和blob偏移：打开时不检查，访问时抛出异常，不会读到映射之外
+    std::string content;
+    FILE* in = std::fopen(path.c_str(), "rb");
+    char buf[4096];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), in)) > 0) {
+        content.append(buf, n);
+    }
+    std::fclose(in);
+    smartdb::ColumnFileHeader head;
+    std::memcpy(&head, content.data(), sizeof(head));
+    auto chunk_desc = [&](size_t column) {
+        smartdb::ColumnFileChunk c;
+        std::memcpy(&c, content.data() + head.footer + head.columns * sizeof(smartdb::ColumnFileColumn)
+            + column * sizeof(smartdb::ColumnFileChunk), sizeof(c));
+        return c;
+    };
+    uint32_t bad_code = 0xffffffff;
+    uint64_t bad_offset = 1ULL << 40;
+    std::memcpy(&content[chunk_desc(1).values + sizeof(uint32_t)], &bad_code, sizeof(bad_code));  // 第1块第2行
+    std::memcpy(&content[chunk_desc(3).offsets + 2 * sizeof(uint64_t)], &bad_offset, sizeof(bad_offset));
+    FILE* out = std::fopen(path.c_str(), "wb");
+    std::fwrite(content.data(), 1, content.size(), out);
+    std::fclose(out);
+
+    ok = file.Open(path);
+    int caught = 0;
+    try {
+        file.StringColumn(0, 1)[1];
+    } catch (const std::out_of_range&) {
+        caught++;
+    }
+    try {
+        file.BlobColumn(0, 3)[1];
+    } catch (const std::out_of_range&) {
+        caught++;
+    }
+    std::cout << "corrupt code and offset: open = " << ok << ", rejected on access = " << caught << std::endl;
+    assert(ok && caught == 2);
+    file.Close();
+
+    // 损坏的文件头：没有列时块数也必须与行数一致
+    smartdb::ColumnFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "SDBC", 4);
+    header.version = smartdb::kColumnFileVersion;
+    header.chunk_rows = 4;
+    header.rows = 1ULL << 40;
+    header.chunks = header.rows / header.chunk_rows;
+    header.footer = sizeof(header);
+    FILE* fp = std::fopen(path.c_str(), "wb");
+    std::fwrite(&header, sizeof(header), 1, fp);
+    std::fclose(fp);
+    ok = file.Open(path);
+    std::cout << "corrupt header without columns: open = " << ok << ", error code = " << file.GetLastErrCode() << std::endl;
+    assert(!ok && file.GetLastErrCode() == SQLITE_CORRUPT);
+    std::remove(path.c_str());
+}
+
+void SmartDBColumnExportTest()
+{
+    SmartDBColumnRoundTrip();
+
+    smartdb::SmartDBSqlite db;
+    if (!db.Open(g_scan_dbname, smartdb::SmartDBScanner::ScanOptions(), SQLITE_OPEN_READONLY)) {
+        std::cerr << "open db[" << g_scan_dbname << "] failed, error code: " << db.GetLastErrCode() << std::endl;
+        return;
+    }
+
+    // 原来的方式：Query的SAX流直接写json文件，读取时再解析
+    const std::string json_path = "employee.json";
+    const std::string column_path = "employee.sdbc";
+    util::TimeSpan ts;
+    FILE* fp = fopen(json_path.c_str(), "w");
+    char buf[65536];
+    {
+        rapidjson::FileWriteStream os(fp, buf, sizeof(buf));
+        db.QueryToStream(os, "SELECT * FROM Employee;");
+    }
+    long json_size = ftell(fp);
+    fclose(fp);
+    std::cout << "json export: " << ts.Span() << " ms, size = " << json_size << std::endl;
+
+    ts.Reset();
+    fp = fopen(json_path.c_str(), "r");
+    rapidjson::Document doc;
+    {
+        rapidjson::FileReadStream is(fp, buf, sizeof(buf));
+        doc.ParseStream(is);
+    }
+    fclose(fp);
+    double json_sum = 0;
+    for (auto& v : doc.GetArray()) {
+        json_sum += v["Salary"].GetDouble();
+    }
+    std::cout << "json load + sum: " << ts.Span() << " ms, rows = " << doc.Size() << ", salary sum = "
+              << json_sum << std::endl;
+    doc.SetNull();
+    doc.GetAllocator().Clear();
+
+    // 列式导出
+    ts.Reset();
+    smartdb::ColumnExporter exporter;
+    bool ok = exporter.ExportTable(db, column_path, "Employee");
+    auto span = ts.Span();
+    fp = fopen(column_path.c_str(), "r");
+    fseek(fp, 0, SEEK_END);
+    long column_size = ftell(fp);
+    fclose(fp);
+    std::cout << "column export: " << span << " ms, size = " << column_size << ", rows = " << exporter.Rows()
+              << ", ok = " << std::boolalpha << ok << std::endl;
+
+    // mmap打开，直接遍历列
+    ts.Reset();
+    smartdb::ColumnFile file;
+    ok = file.Open(column_path);
+    std::cout << "column open: " << ts.Span() << " ms, ok = " << ok << std::endl;
+
+    ts.Reset();
+    double column_sum = 0;
+    size_t name7 = 0;
+    int salary = file.FindColumn("Salary");
+    int name = file.FindColumn("Name");
+    for (size_t chunk = 0; chunk < file.Chunks(); chunk++) {
+        for (double v : file.DoubleColumn(chunk, salary)) {
+            column_sum += v;
+        }
+
+        // 字典编码：先在字典中找到编码，再比较整数
+        auto names = file.StringColumn(chunk, name);
+        for (uint32_t code = 0; code < names.dict_size; code++) {
+            if (names.Dict(code).ToString() == "name7") {
+                name7 += std::count(names.codes.begin(), names.codes.end(), code);
+            }
+        }
+    }
+    std::cout << "column sum: " << ts.Span() << " ms, rows = " << file.Rows() << ", salary sum = " << column_sum
+              << ", name7 = " << name7 << std::endl;
+    assert(ok && column_sum == json_sum && file.Rows() == exporter.Rows());
+
+    file.Close();
+    std::remove(json_path.c_str());
+    std::remove(column_path.c_str());
+}
+
+//////////////////////////////////////////////////////////////
+// blob读取，内容中含有'\0'时按实际长度读取
+void SmartDBBlobTest()
+{
+    smartdb::SmartDBSqlite db;
+    if (!db.Open(":memory:", nullptr)) {
+        std::cerr << "open memory db failed, error code: " << db.GetLastErrCode() << std::endl;
+        return;
+    }
+    db.Excecute("CREATE TABLE BlobTest (ID INTEGER, Data BLOB);");
+
+    char data[] = {'a', '\0', 'b', '\0', 'c'};
+    smartdb::SqliteBlob blob{data, sizeof(data)};
+    bool ok = db.Excecute("INSERT INTO BlobTest(ID, Data) VALUES(?, ?);", 1, blob);
+    ok = ok && db.Excecute("INSERT INTO BlobTest(ID, Data) VALUES(2, zeroblob(0));");
+    assert(ok);
+
+    std::string scalar = db.ExcecuteScalar<std::string>("SELECT Data FROM BlobTest WHERE ID = 1;");
+    auto doc = db.Query("SELECT Data FROM BlobTest ORDER BY ID;");
+    assert(doc != nullptr && doc->Size() == 2);
+    const rapidjson::Value& v = (*doc)[0]["Data"];
+    std::cout << "blob size = " << sizeof(data) << ", scalar size = " << scalar.size()
+              << ", json size = " << v.GetStringLength() << ", empty blob json size = "
+              << (*doc)[1]["Data"].GetStringLength() << std::endl;
+    assert(scalar == std::string(data, sizeof(data)));
+    assert(std::string(v.GetString(), v.GetStringLength()) == scalar);
+
+    // 视图读取，不复制
+    for (auto& row : db.QueryCursor<std::tuple<int, smartdb::SqliteBlobView>>("SELECT ID, Data FROM BlobTest;")) {
+        const smartdb::SqliteBlobView& view = std::get<1>(row);
+        std::cout << "blob view: ID = " << std::get<0>(row) << ", size = " << view.size << std::endl;
+    }
+
+    // const char*参数不再包含结尾的'\0'
+    db.Excecute("CREATE TABLE TextTest (Name TEXT);");
+    db.Excecute("INSERT INTO TextTest(Name) VALUES(?);", "Peter");
+    sqlite3_int64 length = db.ExcecuteScalar<sqlite3_int64>("SELECT length(CAST(Name AS BLOB)) FROM TextTest;");
+    std::cout << "const char* text length = " << length << std::endl;
+    assert(length == 5);
+}
+
+//////////////////////////////////////////////////////////////
+// 大blob：视图参数SQLITE_STATIC绑定写入，增量blob按块写入和读取，与整体读取对比
+const std::string g_blob_dbname = "blob_test.db";
+
+// 简单的校验和
+struct BlobChecksum
+{
+    BlobChecksum() : sum(0) {}
+
+    void operator()(const char* data, int size)
+    {
+        for (int i = 0; i < size; i++) {
+            sum = sum * 31 + static_cast<unsigned char>(data[i]);
+        }
+    }
+
+    uint64_t sum;
+};
+
+void SmartDBBlobStreamTest(int size_mb)
+{
+    RemoveDB(g_blob_dbname);
+    smartdb::SmartDBSqlite db;
+    if (!db.Open(g_blob_dbname, smartdb::SmartDBOptions::Balanced())) {
+        std::cerr << "open db[" << g_blob_dbname << "] failed, error code: " << db.GetLastErrCode() << std::endl;
+        return;
+    }
+    db.Excecute("CREATE TABLE BigBlob (ID INTEGER PRIMARY KEY, Data BLOB);");
+
+    const int size = size_mb * 1024 * 1024;
+    std::vector<char> buffer(size);
+    for (int i = 0; i < size; i++) {
+        buffer[i] = static_cast<char>(i * 7 + i / 4096);
+    }
+    BlobChecksum expected;
+    expected(buffer.data(), size);
+
+    // 视图参数，sqlite不复制缓冲区
+    util::TimeSpan ts;
+    bool ok = db.Excecute("INSERT INTO BigBlob(ID, Data) VALUES(1, ?);", smartdb::SqliteBlobView{buffer.data(), size});
+    std::cout << "insert " << size_mb << " MB by blob view: " << ts.Span() << " ms, ok = " << std::boolalpha << ok
+              << std::endl;
+
+    // 增量写入：先插入指定长度的zeroblob，再按1MB分块写入
+    ts.Reset();
+    ok = db.Excecute("INSERT INTO BigBlob(ID, Data) VALUES(2, zeroblob(?));", size);
+    {
+        smartdb::BlobStream stream = db.OpenBlob("BigBlob", "Data", db.LastInsertRowId(), true);
+        const int chunk = 1024 * 1024;
+        for (int offset = 0; ok && offset < size; offset += chunk) {
+            ok = stream.Write(buffer.data() + offset, std::min(chunk, size - offset), offset);
+        }
+    }
+    std::cout << "insert " << size_mb << " MB by blob stream: " << ts.Span() << " ms, ok = " << ok << std::endl;
+    buffer.clear();
+    buffer.shrink_to_fit();
+
+    // 整体读取：复制到std::string
+    ts.Reset();
+    std::string whole = db.ExcecuteScalar<std::string>("SELECT Data FROM BigBlob WHERE ID = 1;");
+    BlobChecksum copied;
+    copied(whole.data(), static_cast<int>(whole.size()));
+    std::cout << "read whole blob: " << ts.Span() << " ms, size = " << whole.size() << ", checksum ok = "
+              << (copied.sum == expected.sum) << std::endl;
+    whole.clear();
+    whole.shrink_to_fit();
+
+    // 增量读取：每次64KB，依次读两行
+    ts.Reset();
+    smartdb::BlobStream stream = db.OpenBlob("BigBlob", "Data", 1);
+    for (sqlite3_int64 id = 1; id <= 2; id++) {
+        BlobChecksum streamed;
+        ok = (id == 1 || stream.Reopen(id)) && stream.ReadAll(std::ref(streamed));
+        std::cout << "stream blob " << id << ": size = " << stream.Size() << ", ok = " << ok
+                  << ", checksum ok = " << (streamed.sum == expected.sum) << std::endl;
+        assert(ok && streamed.sum == expected.sum);
+    }
+    std::cout << "stream read 2 blobs: " << ts.Span() << " ms" << std::endl;
+}
+
+//////////////////////////////////////////////////////////////
+// 查询结果缓存：重复查询命中时不执行SQL，同一连接写入后按表失效，过期后重新查询
+void SmartDBQueryCacheBench(smartdb::SmartDBSqlite& db, int repeat)
+{
+    util::TimeSpan ts;
+    sqlite3_int64 total = 0;
+    for (int i = 0; i < repeat; i++) {
+        total += db.ExcecuteScalar<sqlite3_int64>("SELECT count(1) FROM Cached;");
+        total += db.ExcecuteScalar<sqlite3_int64>("select max(ID)  from Cached\n WHERE ID > ?", 0);
+        auto doc = db.Query("SELECT ID, Name FROM Cached WHERE ID % 1000 = ?;", i % 10);
+        total += doc->Size();
+    }
+    auto stats = db.GetQueryCacheStats();
+    std::cout << "repeat " << repeat << ": " << ts.Span() << " ms, total = " << total << ", size = " << stats.size
+              << ", hits = " << stats.hits << ", misses = " << stats.misses << std::endl;
+}
+
+void SmartDBQueryCacheTest(int rows, int repeat)
+{
+    smartdb::SmartDBSqlite db;
+    if (!db.Open(":memory:", nullptr)) {
+        std::cerr << "open memory db failed, error code: " << db.GetLastErrCode() << std::endl;
+        return;
+    }
+    db.Excecute("CREATE TABLE Cached (ID INTEGER PRIMARY KEY, Name TEXT);");
+    db.Excecute("CREATE TABLE Other (ID INTEGER);");
+    db.Begin();
+    for (int i = 1; i <= rows; i++) {
+        db.Excecute("INSERT INTO Cached(ID, Name) VALUES(?, ?);", i, "name" + std::to_string(i));
+    }
+    db.Commit();
+
+    std::cout << "query cache off, ";
+    SmartDBQueryCacheBench(db, repeat);
+    db.SetQueryCache(128, std::chrono::milliseconds(200));
+    std::cout << "query cache on,  ";
+    SmartDBQueryCacheBench(db, repeat);
+
+    // 每次返回缓存结果的副本，修改返回的Document不影响缓存
+    const std::string sql_rows = "SELECT ID FROM Cached WHERE ID <= ?;";
+    auto first = db.Query(sql_rows, 10);
+    first->Clear();
+    auto second = db.Query(sql_rows, 10);
+    std::cout << "cached result after caller modified its copy: " << second->Size() << " rows" << std::endl;
+    assert(second->Size() == 10);
+
+    // 写入其他表不影响，写入读取的表后失效
+    const std::string sql_count = "SELECT count(1) FROM Cached;";
+    db.Excecute("INSERT INTO Other(ID) VALUES(?);", 1);
+    auto before = db.GetQueryCacheStats();
+    assert(db.ExcecuteScalar<sqlite3_int64>(sql_count) == rows);
+    assert(db.GetQueryCacheStats().hits == before.hits + 1);
+
+    db.Excecute("INSERT INTO Cached(ID, Name) VALUES(?, ?);", rows + 1, "new");
+    assert(db.ExcecuteScalar<sqlite3_int64>(sql_count) == rows + 1);
+    auto after = db.GetQueryCacheStats();
+    std::cout << "after insert: count = " << rows + 1 << ", invalidations = " << after.invalidations << std::endl;
+    assert(after.invalidations == before.invalidations + 1);
+
+    // 不带where的delete不触发update hook，由Excecute清空缓存
+    db.Excecute("DELETE FROM Cached;");
+    assert(db.ExcecuteScalar<sqlite3_int64>(sql_count) == 0);
+
+    // 随机数不缓存，结果过期后重新查询
+    db.ExcecuteScalar<sqlite3_int64>("SELECT random() FROM Other;");
+    size_t size = db.GetQueryCacheStats().size;
+    db.ExcecuteScalar<sqlite3_int64>("SELECT random() FROM Other;");
+    assert(db.GetQueryCacheStats().size == size);
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    before = db.GetQueryCacheStats();
+    db.ExcecuteScalar<sqlite3_int64>(sql_count);
+    after = db.GetQueryCacheStats();
+    std::cout << "after ttl: hits = " << after.hits - before.hits << ", invalidations = "
+              << after.invalidations - before.invalidations << std::endl;
+    assert(after.hits == before.hits && after.invalidations == before.invalidations + 1);
+
+    // WITHOUT ROWID表的修改不触发update hook，读取它的查询不缓存，带参数的写入后不会读到旧结果
+    db.Excecute("CREATE TABLE NoRowid (Name TEXT PRIMARY KEY, Value INTEGER) WITHOUT ROWID;");
+    const std::string sql_sum = "SELECT coalesce(sum(Value), 0) FROM NoRowid;";
+    assert(db.ExcecuteScalar<sqlite3_int64>(sql_sum) == 0);
+    size = db.GetQueryCacheStats().size;
+    db.Excecute("INSERT INTO NoRowid(Name, Value) VALUES(?, ?);", "a", 5);
+    sqlite3_int64 sum = db.ExcecuteScalar<sqlite3_int64>(sql_sum);
+    std::cout << "without rowid table: sum after insert = " << sum << ", cached = "
+              << (db.GetQueryCacheStats().size != size) << std::endl;
+    assert(sum == 5 && db.GetQueryCacheStats().size == size);
+}
+
 //////////////////////////////////////////////////////////////
 int main(int argc, char const *argv[])
 {
@@ -250,6 +1408,21 @@ int main(int argc, char const *argv[])
     SmartDBScalarTest();
     std::cout << "run time: " << ts.Span() << " ms" << std::endl;
 
+    std::cout << "\n*** SmartDBBlobTest ***" << std::endl;
+    ts.Reset();
+    SmartDBBlobTest();
+    std::cout << "run time: " << ts.Span() << " ms" << std::endl;
+
+    std::cout << "\n*** SmartDBBlobStreamTest ***" << std::endl;
+    ts.Reset();
+    SmartDBBlobStreamTest(32);
+    std::cout << "run time: " << ts.Span() << " ms" << std::endl;
+
+    std::cout << "\n*** SmartDBQueryCacheTest ***" << std::endl;
+    ts.Reset();
+    SmartDBQueryCacheTest(100000, count * 20);
+    std::cout << "run time: " << ts.Span() << " ms" << std::endl;
+
     std::cout << "\n*** SmartDBInsertJsonTest ***" << std::endl;
     ts.Reset();
     SmartDBInsertJsonTest();
@@ -260,6 +1433,58 @@ int main(int argc, char const *argv[])
     SmartDBTransactionTest(count * 10000);
     std::cout << "run time: " << ts.Span() << " ms" << std::endl;
 
+    std::cout << "\n*** SmartDBBulkInsertTest ***" << std::endl;
+    ts.Reset();
+    for (size_t rows_per_stmt : {1, 16, 256, 1024}) {
+        SmartDBBulkInsertTest(count * 10000, rows_per_stmt);
+    }
+    std::cout << "run time: " << ts.Span() << " ms" << std::endl;
+
+    std::cout << "\n*** SmartDBStatementCacheTest ***" << std::endl;
+    ts.Reset();
+    SmartDBStatementCacheTest(count * 1000);
+    std::cout << "run time: " << ts.Span() << " ms" << std::endl;
+
+    std::cout << "\n*** SmartDBOptionsTest ***" << std::endl;
+    ts.Reset();
+    SmartDBOptionsTest(count * 100);
+    std::cout << "run time: " << ts.Span() << " ms" << std::endl;
+
+    std::cout << "\n*** SmartDBPoolTest ***" << std::endl;
+    ts.Reset();
+    SmartDBPoolTest(100000, count * 1000);
+    std::cout << "run time: " << ts.Span() << " ms" << std::endl;
+
+    std::cout << "\n*** SmartDBWriterTest ***" << std::endl;
+    ts.Reset();
+    SmartDBWriterTest(4, count * 200);
+    std::cout << "run time: " << ts.Span() << " ms" << std::endl;
+
+    std::cout << "\n*** SmartDBReflectTest ***" << std::endl;
+    ts.Reset();
+    SmartDBReflectTest(count * 100000);
+    std::cout << "run time: " << ts.Span() << " ms" << std::endl;
+
+    std::cout << "\n*** SmartDBScanTest ***" << std::endl;
+    ts.Reset();
+    SmartDBScanTest(count * 100000);
+    std::cout << "run time: " << ts.Span() << " ms" << std::endl;
+
+    std::cout << "\n*** SmartDBColumnExportTest ***" << std::endl;
+    ts.Reset();
+    SmartDBColumnExportTest();
+    std::cout << "run time: " << ts.Span() << " ms" << std::endl;
+
+    std::cout << "\n*** SmartDBCursorTest ***" << std::endl;
+    ts.Reset();
+    SmartDBCursorTest();
+    std::cout << "run time: " << ts.Span() << " ms" << std::endl;
+
+    std::cout << "\n*** SmartDBQueryStreamTest ***" << std::endl;
+    ts.Reset();
+    SmartDBQueryStreamTest();
+    std::cout << "run time: " << ts.Span() << " ms" << std::endl;
+
     std::cout << "\n*** SmartDBQueryTest ***" << std::endl;
     ts.Reset();
     SmartDBQueryTest();
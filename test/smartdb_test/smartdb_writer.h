@@ -0,0 +1,355 @@
+/**
+ * desc: smartdb sqlite 异步写入队列，单独的写线程合并提交
+ * file: smartdb_writer.h
+ *
+ * author:  myw31415926
+ * date:    20190426
+ * version: V0.1
+ *
+ * the closer you look, the less you see
+ */
+
+#ifndef SMART_DB_WRITER_H_
+#define SMART_DB_WRITER_H_
+
+#include "smartdb_sqlite.h"
+
+#include <chrono>
+#include <deque>
+#include <algorithm>
+#include <vector>
+#include <future>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+
+namespace smartdb {
+
+// 异步写入统计
+struct WriterStats
+{
+    size_t writes;      // 已执行的写操作数
+    size_t failures;    // 失败的写操作数
+    size_t batches;     // 已提交的事务数
+    size_t max_batch;   // 最大的一次提交包含的写操作数
+};
+
+// 异步写入队列。sqlite同一时刻只允许一个写者，由一个写线程独占连接，调用者只把写操作放入队列，立即返回future
+// 写线程每次取出队列中的全部写操作（最多max_batch个），放在一个事务中执行后统一提交（group commit），
+// 多个写操作共用一次fsync。max_delay大于0时，队列不满一批时最多再等待max_delay，以增大批次
+// 每个写操作在独立的savepoint中执行，失败时只回滚自己，不影响同一批次中的其他写操作
+// future在事务提交之后才就绪，就绪即表示数据已经持久化（持久程度由SmartDBOptions::synchronous决定）
+class SmartDBWriter
+{
+public:
+    // 写操作，在写线程中执行，返回false表示失败。不能自己开始或提交事务
+    using WriteFunc = std::function<bool(SmartDBSqlite&)>;
+
+    SmartDBWriter() : max_batch_(0), max_pending_(0), max_delay_(0), stop_(true), stats_{0, 0, 0, 0} {}
+
+    virtual ~SmartDBWriter()
+    {
+        Close();
+    }
+
+    /**
+     * @brief: 打开数据库，启动写线程
+     * @param[in] db_name: 数据库名称
+     * @param[in] options: 连接参数
+     * @param[in] max_batch: 一次提交最多包含的写操作数
+     * @param[in] max_delay: 不满一批时等待更多写操作的最长时间，0表示不等待
+     * @param[in] max_pending: 队列中最多的写操作数，队列满时Submit阻塞，避免写入跟不上时内存无限增长
+     * @return: 成功返回true; 失败返回false
+     */
+    bool Open(const std::string& db_name, const SmartDBOptions& options = SmartDBOptions::Balanced(),
+        size_t max_batch = 1000, std::chrono::microseconds max_delay = std::chrono::microseconds(0),
+        size_t max_pending = 100000)
+    {
+        if (max_batch == 0 || max_pending == 0) {
+            throw std::invalid_argument("writer batch size and queue size must be greater than 0");
+        }
+        Close();
+
+        // 在调用者线程中打开，错误可以直接返回；之后连接只在写线程中使用
+        if (!db_.Open(db_name, options)) {
+            return false;
+        }
+
+        max_batch_ = max_batch;
+        max_pending_ = max_pending;
+        max_delay_ = max_delay;
+        stop_ = false;
+        stats_ = WriterStats{0, 0, 0, 0};
+        thread_ = std::thread(&SmartDBWriter::RunInThread, this);
+        return true;
+    }
+
+    /**
+     * @brief: 执行完队列中剩余的写操作，停止写线程，关闭数据库
+     */
+    void Close()
+    {
+        if (!thread_.joinable()) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> locker(mtx_);
+            stop_ = true;
+        }
+        not_empty_.notify_one();
+        not_full_.notify_all();
+        thread_.join();
+        db_.Close();
+    }
+
+    /**
+     * @brief: 提交写操作
+     * @param[in] func: 写操作，在写线程中执行
+     * @return: 写操作所在的事务提交后就绪，值为写操作的结果；写操作抛出的异常通过future重新抛出
+     */
+    std::future<bool> Submit(WriteFunc func)
+    {
+        Request request{std::move(func), std::promise<bool>()};
+        std::future<bool> future = request.promise.get_future();
+
+        std::unique_lock<std::mutex> locker(mtx_);
+        not_full_.wait(locker, [this] { return stop_ || queue_.size() < max_pending_; });
+        if (stop_) {
+            throw std::logic_error("writer is not opened");
+        }
+        queue_.push_back(std::move(request));
+        locker.unlock();
+        not_empty_.notify_one();
+        return future;
+    }
+
+    /**
+     * @brief: 提交带占位符的SQL语句，参数被复制，在写线程中绑定执行
+     *         const char*、SqliteBlob和视图参数复制其指向的内容，调用返回后原来的内存即可释放
+     * @param[in] sql: SQL语句
+     * @param[in] args: SQL语句参数
+     * @return: 事务提交后就绪，值为语句执行的结果
+     */
+    template<typename... Args>
+    std::future<bool> Excecute(const std::string& sql, Args&&... args)
+    {
+        return Submit(std::bind(&SmartDBWriter::ExcecuteBound<typename OwnedArg<Args>::type...>,
+            std::placeholders::_1, sql, OwnedArg<Args>::Copy(std::forward<Args>(args))...));
+    }
+
+    /**
+     * @brief: 等待之前提交的全部写操作提交
+     */
+    void Flush()
+    {
+        Submit([](SmartDBSqlite&) { return true; }).wait();
+    }
+
+    WriterStats GetStats()
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        return stats_;
+    }
+
+private:
+    // 复制后的字符串和blob参数，执行时以视图绑定，空指针仍然绑定为NULL
+    struct OwnedText
+    {
+        std::string data;
+        bool        is_null;
+    };
+
+    struct OwnedBlob
+    {
+        std::string data;
+        bool        is_null;
+    };
+
+    // 参数在队列中保存的类型：值类型原样保存，不持有内存的指针、blob和视图复制为OwnedText或OwnedBlob
+    template<typename T, typename U = typename std::decay<T>::type>
+    struct OwnedArg
+    {
+        using type = U;
+        template<typename A>
+        static A&& Copy(A&& t) { return std::forward<A>(t); }
+    };
+
+    template<typename T>
+    struct OwnedArg<T, const char*>
+    {
+        using type = OwnedText;
+        static OwnedText Copy(const char* t)
+        {
+            return t != nullptr ? OwnedText{std::string(t), false} : OwnedText{std::string(), true};
+        }
+    };
+
+    template<typename T>
+    struct OwnedArg<T, char*> : OwnedArg<T, const char*> {};
+
+    template<typename T>
+    struct OwnedArg<T, SqliteTextView>
+    {
+        using type = OwnedText;
+        static OwnedText Copy(const SqliteTextView& t)
+        {
+            return t.data != nullptr ? OwnedText{t.ToString(), false} : OwnedText{std::string(), true};
+        }
+    };
+
+    template<typename T>
+    struct OwnedArg<T, SqliteBlob>
+    {
+        using type = OwnedBlob;
+        static OwnedBlob Copy(const SqliteBlob& t)
+        {
+            return t.buf != nullptr ? OwnedBlob{std::string(t.buf, t.size), false} : OwnedBlob{std::string(), true};
+        }
+    };
+
+    // 与SqliteBlobView的绑定一致：空指针且长度为0时是空blob，否则空指针绑定为NULL
+    template<typename T>
+    struct OwnedArg<T, SqliteBlobView>
+    {
+        using type = OwnedBlob;
+        static OwnedBlob Copy(const SqliteBlobView& t)
+        {
+            if (t.data != nullptr) {
+                return OwnedBlob{std::string(static_cast<const char*>(t.data), t.size), false};
+            }
+            return OwnedBlob{std::string(), t.size != 0};
+        }
+    };
+
+    struct Request
+    {
+        WriteFunc          func;
+        std::promise<bool> promise;
+    };
+
+    // 禁止复制和赋值
+    SmartDBWriter(const SmartDBWriter&) = delete;
+    SmartDBWriter& operator=(const SmartDBWriter&) = delete;
+
+    template<typename... Args>
+    static bool ExcecuteBound(SmartDBSqlite& db, const std::string& sql, const Args&... args)
+    {
+        return db.Excecute(sql, Bindable(args)...);
+    }
+
+    template<typename T>
+    static const T& Bindable(const T& t)
+    {
+        return t;
+    }
+
+    static SqliteTextView Bindable(const OwnedText& t)
+    {
+        return SqliteTextView{t.is_null ? nullptr : t.data.data(), static_cast<int>(t.data.size())};
+    }
+
+    static SqliteBlob Bindable(const OwnedBlob& t)
+    {
+        return SqliteBlob{t.is_null ? nullptr : const_cast<char*>(t.data.data()), static_cast<int>(t.data.size())};
+    }
+
+    // 写线程：取出一批写操作，在一个事务中执行。停止后执行完队列中剩余的写操作再退出
+    void RunInThread()
+    {
+        std::vector<Request> batch;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> locker(mtx_);
+                not_empty_.wait(locker, [this] { return stop_ || !queue_.empty(); });
+                if (queue_.empty()) {
+                    return;     // 已停止并且队列为空
+                }
+
+                if (max_delay_.count() > 0 && queue_.size() < max_batch_ && !stop_) {
+                    not_empty_.wait_for(locker, max_delay_,
+                        [this] { return stop_ || queue_.size() >= max_batch_; });
+                }
+
+                size_t n = std::min(queue_.size(), max_batch_);
+                for (size_t i = 0; i < n; i++) {
+                    batch.push_back(std::move(queue_.front()));
+                    queue_.pop_front();
+                }
+            }
+            not_full_.notify_all();
+
+            RunBatch(batch);
+            batch.clear();
+        }
+    }
+
+    // 执行一批写操作并提交，提交之后再设置结果
+    void RunBatch(std::vector<Request>& batch)
+    {
+        std::vector<char> results(batch.size(), 0);
+        std::vector<std::exception_ptr> errors(batch.size());
+
+        // 开始事务时就获取写锁，避免提交时才发现有其他写者
+        bool committed = db_.Excecute("BEGIN IMMEDIATE;");
+        if (committed) {
+            for (size_t i = 0; i < batch.size(); i++) {
+                db_.Excecute("SAVEPOINT smartdb_writer;");
+                try {
+                    results[i] = batch[i].func(db_) ? 1 : 0;
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+                if (results[i] == 0) {
+                    db_.Excecute("ROLLBACK TO smartdb_writer;");
+                }
+                db_.Excecute("RELEASE smartdb_writer;");
+            }
+
+            committed = db_.Excecute(SMARTDB_COMMIT);
+            if (!committed) {
+                db_.Excecute(SMARTDB_ROLLBACK);
+            }
+        }
+
+        size_t failures = 0;
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (errors[i] != nullptr) {
+                batch[i].promise.set_exception(errors[i]);
+                failures++;
+            } else {
+                bool ok = committed && results[i] != 0;
+                batch[i].promise.set_value(ok);
+                failures += ok ? 0 : 1;
+            }
+        }
+
+        std::lock_guard<std::mutex> locker(mtx_);
+        stats_.writes += batch.size();
+        stats_.failures += failures;
+        stats_.batches++;
+        stats_.max_batch = std::max(stats_.max_batch, batch.size());
+    }
+
+private:
+    SmartDBSqlite db_;      // 只在写线程中使用
+    std::thread   thread_;
+
+    size_t max_batch_;
+    size_t max_pending_;
+    std::chrono::microseconds max_delay_;
+
+    std::deque<Request>     queue_;
+    bool                    stop_;      // 未打开或者已关闭，不再接受写操作
+    std::mutex              mtx_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+
+    WriterStats stats_;
+};
+
+}
+#endif // SMART_DB_WRITER_H_
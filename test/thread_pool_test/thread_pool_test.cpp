@@ -14,6 +14,8 @@
 #include <iostream>
 #include <ctime>
 #include <string>
+#include <future>
+#include <array>
 
 void ThreadPoolTest1()
 {
@@ -82,9 +84,44 @@ void ThreadPoolTest2()
     thd.join();
 }
 
+///////////////////////////////////////////////////////////////////////
+// 任务类型：复制添加的std::function、只能移动的packaged_task、超过内部缓冲区的大对象
+void ThreadPoolTaskTest()
+{
+    util::ThreadPool pool(2);
+    std::atomic<int> count(0);
+
+    util::ThreadPool::Task task = [&count] { count++; };
+    pool.AddTask(task);     // 复制，task仍然可用
+    pool.AddTask(task);
+
+    std::packaged_task<int()> packaged([] { return 42; });
+    auto future = packaged.get_future();
+    pool.AddTask(std::move(packaged));
+
+    std::array<int, 32> big;
+    big.fill(1);
+    std::promise<int> sum;
+    pool.AddTask([big, &sum] {
+        int total = 0;
+        for (int v : big) {
+            total += v;
+        }
+        sum.set_value(total);
+    });
+
+    std::cout << "packaged task result = " << future.get()
+              << ", big task result = " << sum.get_future().get() << std::endl;
+    pool.Stop();
+    std::cout << "copied task run " << count << " times" << std::endl;
+}
+
 //////////////////////////////////////////////////////////////
 int main(int argc, char const *argv[])
 {
+    std::cout << "*** ThreadPoolTaskTest ***" << std::endl;
+    ThreadPoolTaskTest();
+
     std::cout << "*** ThreadPoolTest1 ***" << std::endl;
     ThreadPoolTest1();
 
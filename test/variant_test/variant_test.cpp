@@ -1,6 +1,6 @@
 /**
- * desc: chrono time 测试
- * file: time_test.cpp
+ * desc: variant 测试
+ * file: variant_test.cpp
  *
  * author:  myw31415926
  * date:    20190306
@@ -13,6 +13,7 @@
 
 #include <iostream>
 #include <string>
+#include <cstdint>
 
 void VariantTest()
 {
@@ -43,11 +44,107 @@ void VariantTest()
     try {
         std::cout << "v.Get<int>()=" << v.Get<int>() << std::endl;
         std::cout << "v.Get<double>()=" << v.Get<double>() << std::endl;
-    } catch (const std::bad_cast& e) {
-        std::cerr << "bad_cast: " << e.what() << std::endl;
+    } catch (const std::logic_error& e) {
+        std::cerr << "logic_error: " << e.what() << std::endl;
     }
 }
 
+//////////////////////////////////////////////////////////////
+// 访问者测试
+struct PrintVisitor
+{
+    void operator()(int i) const { std::cout << "int: " << i << std::endl; }
+    void operator()(double d) const { std::cout << "double: " << d << std::endl; }
+    void operator()(const std::string& s) const { std::cout << "string: " << s << std::endl; }
+};
+
+// 多个Variant同时访问
+struct AddVisitor
+{
+    template<typename T, typename U>
+    double operator()(const T& t, const U& u) const { return t + u; }
+
+    template<typename T>
+    double operator()(const T&, const std::string& s) const { return s.size(); }
+
+    template<typename U>
+    double operator()(const std::string& s, const U&) const { return s.size(); }
+
+    double operator()(const std::string& s1, const std::string& s2) const { return s1.size() + s2.size(); }
+};
+
+void VariantVisitTest()
+{
+    using Var = util::Variant<int, double, std::string>;
+
+    Var v1 = 10;
+    Var v2 = 3.14;
+    Var v3 = std::string("variant");
+
+    v1.Visit(PrintVisitor());
+    v2.Visit(PrintVisitor());
+    util::Visit(PrintVisitor(), v3);
+
+    std::cout << "v1 + v2 = " << util::Visit(AddVisitor(), v1, v2) << std::endl;
+    std::cout << "v2 + v3 = " << util::Visit(AddVisitor(), v2, v3) << std::endl;
+    std::cout << "v3 + v3 = " << util::Visit(AddVisitor(), v3, v3) << std::endl;
+
+    // 复制和移动
+    Var v4 = v3;
+    Var v5 = std::move(v4);
+    v1 = v5;
+    std::cout << "v1.Index() = " << int(v1.Index()) << ", v1 = " << v1.Get<std::string>() << std::endl;
+
+    // 全部是trivial类型时，复制和移动直接memcpy
+    using TrivialVar = util::Variant<int, double, char>;
+    TrivialVar t1 = 'c';
+    TrivialVar t2 = t1;
+    std::cout << "t2 = " << t2.Get<char>() << std::endl;
+
+    const Var c = 100;
+    util::Visit(PrintVisitor(), c);
+    try {
+        Var empty;
+        empty.Visit(PrintVisitor());
+    } catch (const std::logic_error& e) {
+        std::cerr << "logic_error: " << e.what() << std::endl;
+    }
+}
+
+//////////////////////////////////////////////////////////////
+// 内存布局回归测试：数据在前，1字节类型索引在后，没有虚函数表指针
+// 与SmartDBSqlite::SqliteValue相同的类型列表
+struct Blob
+{
+    char *buf;
+    int  size;
+};
+using SqliteValue = util::Variant<int, uint32_t, int64_t, uint64_t,
+    double, char*, const char*, std::string, Blob, std::nullptr_t>;
+
+static_assert(sizeof(util::Variant<char, bool>) == 2, "Variant<char, bool> layout grows");
+static_assert(sizeof(util::Variant<int, float>) == 8, "Variant<int, float> layout grows");
+static_assert(sizeof(util::Variant<int, double>) == 2 * sizeof(double), "Variant<int, double> layout grows");
+static_assert(sizeof(SqliteValue) == sizeof(std::string) + alignof(std::string), "SqliteValue layout grows");
+static_assert(alignof(SqliteValue) == alignof(std::string), "SqliteValue align changes");
+static_assert(std::is_standard_layout<SqliteValue>::value, "Variant must be standard layout");
+static_assert(std::is_trivially_destructible<util::Variant<int, double, Blob>>::value,
+    "Variant of trivial types must be trivially destructible");
+static_assert(!std::is_trivially_destructible<SqliteValue>::value, "Variant with string must destroy it");
+static_assert(!std::is_polymorphic<SqliteValue>::value, "Variant must not have vptr");
+
+void VariantLayoutTest()
+{
+    std::cout << "sizeof(Variant<int, double>) = " << sizeof(util::Variant<int, double>)
+              << ", sizeof(SqliteValue) = " << sizeof(SqliteValue) << std::endl;
+
+    SqliteValue v1 = std::string("sqlite value");
+    SqliteValue v2 = v1;
+    SqliteValue v3 = nullptr;
+    v3 = v2;
+    std::cout << "v3 = " << v3.Get<std::string>() << std::endl;
+}
+
 //////////////////////////////////////////////////////////////
 // linux需要"c++filt -t "进行过滤： ./variant_test 2>&1 | c++filt -t
 int main(int argc, char const *argv[])
@@ -55,5 +152,11 @@ int main(int argc, char const *argv[])
     std::cout << "\n*** VariantTest ***" << std::endl;
     VariantTest();
 
+    std::cout << "\n*** VariantVisitTest ***" << std::endl;
+    VariantVisitTest();
+
+    std::cout << "\n*** VariantLayoutTest ***" << std::endl;
+    VariantLayoutTest();
+
     return 0;
 }
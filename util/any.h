@@ -12,100 +12,166 @@
 #ifndef UTIL_ANY_H_
 #define UTIL_ANY_H_
 
+#include "small_buffer.h"
+
 #include <iostream>
-#include <memory>       // std::unique_ptr
+#include <typeinfo>     // std::bad_cast
 #include <typeindex>    // std::type_index
 #include <type_traits>
+#include <utility>
 
 namespace util {
 
 // Any类，只能容纳一个元素的容器，可以擦除类型，给它赋任何值
+// 元素存放在SmallBuffer中，小对象不分配堆内存。通过手写的函数表（VTable）完成析构、复制和移动，
+// 不依赖虚函数和RTTI转换
 struct Any
 {
-    Any(void) : tp_index_(std::type_index(typeid(void))) {}
-    Any(const Any& other) : base_ptr_(other.Clone()), tp_index_(other.tp_index_) {}
-    Any(Any&& other) : base_ptr_(std::move(other.base_ptr_)), tp_index_(other.tp_index_) {}
+    static const size_t kSmallSize  = SmallBuffer::kSmallSize;
+    static const size_t kSmallAlign = SmallBuffer::kSmallAlign;
+
+    Any(void) : vtable_(nullptr) {}
+
+    Any(const Any& other) : vtable_(other.vtable_)
+    {
+        if (vtable_ != nullptr) {
+            vtable_->copy(other.storage_, storage_);
+        }
+    }
 
-    // 创建智能指针时，对于一般的类型，通过std::decay来移除引用和cv符，从而获取原始类型
+    Any(Any&& other) noexcept : vtable_(other.vtable_)
+    {
+        if (vtable_ != nullptr) {
+            vtable_->move(other.storage_, storage_);
+            other.vtable_ = nullptr;
+        }
+    }
+
+    // 对于一般的类型，通过std::decay来移除引用和cv符，从而获取原始类型
     template<typename U, class = typename 
         std::enable_if<!std::is_same<typename std::decay<U>::type, Any>::value, U>::type>
-    Any(U&& value) : 
-        base_ptr_(new Derived<typename std::decay<U>::type>(std::forward<U>(value))),
-        tp_index_(std::type_index(typeid(typename std::decay<U>::type))) {}
+    Any(U&& value) : vtable_(&VTableFor<typename std::decay<U>::type>::value)
+    {
+        Handler<typename std::decay<U>::type>::Create(storage_, std::forward<U>(value));
+    }
+
+    ~Any()
+    {
+        Reset();
+    }
 
     bool IsNull() const
     {
-        return !bool(base_ptr_);
+        return vtable_ == nullptr;
     }
 
     template<class U>
     bool Is() const
     {
-        return tp_index_ == std::type_index(typeid(U));
+        return vtable_ != nullptr && vtable_->type() == typeid(U);
+    }
+
+    // 当前保存的类型，为空时返回void
+    std::type_index Type() const
+    {
+        return vtable_ != nullptr ? std::type_index(vtable_->type()) : std::type_index(typeid(void));
     }
 
-    // 将Any转换为实际的类型
+    // 将Any转换为实际的类型，类型检查通过后直接转换，不再需要dynamic_cast
     template<class U>
     U& AnyCast()
     {
         if (!Is<U>()) {
-            std::cout << "can not cast " << typeid(U).name() << " to " << tp_index_.name() << std::endl;
+            std::cout << "can not cast " << typeid(U).name() << " to " << Type().name() << std::endl;
             throw std::bad_cast();
         }
 
-        auto derived = dynamic_cast<Derived<U>*>(base_ptr_.get());
-        return derived->value_;
+        return *Handler<U>::Get(storage_);
+    }
+
+    template<class U>
+    const U& AnyCast() const
+    {
+        return const_cast<Any*>(this)->AnyCast<U>();
     }
 
     Any& operator=(const Any& other)
     {
-        if (base_ptr_ == other.base_ptr_) {
-            return *this;
+        if (this != &other) {
+            Any(other).Swap(*this);
         }
+        return *this;
+    }
 
-        base_ptr_ = other.Clone();
-        tp_index_ = other.tp_index_;
+    Any& operator=(Any&& other) noexcept
+    {
+        if (this != &other) {
+            Reset();
+            vtable_ = other.vtable_;
+            if (vtable_ != nullptr) {
+                vtable_->move(other.storage_, storage_);
+                other.vtable_ = nullptr;
+            }
+        }
         return *this;
     }
 
-private:
-    // 内部维护一个基类指针，通过基类指针擦除具体类型，通过多态在运行时获取类型
-    struct Base
+    void Reset()
     {
-        virtual ~Base() {}
-        virtual std::unique_ptr<Base> Clone() const = 0;
-    };
+        if (vtable_ != nullptr) {
+            vtable_->destroy(storage_);
+            vtable_ = nullptr;
+        }
+    }
 
-    template<typename T>
-    struct Derived : Base
+    void Swap(Any& other) noexcept
     {
-        template<typename U>
-        Derived(U&& value) : value_(std::forward<U>(value)) {}
+        Any tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+    }
 
-        std::unique_ptr<Base> Clone() const
-        {
-            return std::unique_ptr<Base>(new Derived(value_));
-        }
+private:
+    using Storage = SmallBuffer::Storage;
 
-        T value_;
-    };
+    template<typename T>
+    using Handler = SmallBuffer::Handler<T>;
 
-    std::unique_ptr<Base> Clone() const
+    // 手写函数表，替代虚函数
+    struct VTable
     {
-        if (base_ptr_ != nullptr) {
-            return base_ptr_->Clone();
-        }
+        const std::type_info& (*type)();
+        void (*destroy)(Storage& s);
+        void (*copy)(const Storage& src, Storage& dst);
+        void (*move)(Storage& src, Storage& dst);   // 移动后src视为已析构
+    };
 
-        return nullptr;
+    template<typename T>
+    static const std::type_info& TypeOf()
+    {
+        return typeid(T);
     }
 
+    // 每个类型一张静态函数表
+    template<typename T>
+    struct VTableFor
+    {
+        static const VTable value;
+    };
+
 private:
-    std::unique_ptr<Base> base_ptr_;
-    // type_index是type_info对象的一个封装类
-    // 可以用作关联容器（比如map）和无序关联容器（比如unordered_map）的索引
-    std::type_index tp_index_;
+    const VTable* vtable_;  // 为空表示没有保存元素
+    Storage       storage_;
 }; // class Any
 
+template<typename T>
+const Any::VTable Any::VTableFor<T>::value = {
+    &Any::TypeOf<T>,
+    &Any::Handler<T>::Destroy,
+    &Any::Handler<T>::Copy,
+    &Any::Handler<T>::Move
+};
+
 } // namespace util
 
 #endif // UTIL_ANY_H_
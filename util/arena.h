@@ -0,0 +1,391 @@
+/**
+ * desc: 内存池：单调分配器Arena、定长块分配器FixedPool、STL分配器适配
+ * file: arena.h
+ *
+ * author:  myw31415926
+ * date:    20190412
+ * version: V0.1
+ *
+ * the closer you look, the less you see
+ */
+
+#ifndef UTIL_ARENA_H_
+#define UTIL_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+namespace util {
+
+// 单调分配器（bump pointer），只分配不单独释放，Reset时一次性回收全部内存
+// 适合生命周期相同的一批对象，例如一次请求中的所有临时对象。非线程安全，每个请求使用一个Arena
+// 接口同时满足rapidjson的Allocator概念（Malloc/Realloc/Free），可以作为rapidjson::Document的分配器
+class Arena
+{
+    // 内存块头部，块内存紧跟在头部之后
+    struct Block
+    {
+        Block* next;
+        size_t capacity;
+        bool   owned;       // 是否由Arena申请，外部缓冲区不释放
+    };
+
+public:
+    static const bool kNeedFree = false;    // rapidjson: 不需要调用Free
+
+    static const size_t kDefaultBlockSize = 4096;
+    static const size_t kMaxBlockSize     = 1024 * 1024;
+
+    explicit Arena(size_t block_size = kDefaultBlockSize)
+        : head_(nullptr), current_(nullptr), ptr_(nullptr), end_(nullptr),
+          block_size_(block_size), used_(0) {}
+
+    // 先使用外部缓冲区（例如栈上的数组），用完后再申请新的内存块，缓冲区不会被释放
+    Arena(void* buffer, size_t size, size_t block_size = kDefaultBlockSize)
+        : head_(nullptr), current_(nullptr), ptr_(nullptr), end_(nullptr),
+          block_size_(block_size), used_(0)
+    {
+        if (buffer != nullptr && size > sizeof(Block)) {
+            Block* block = static_cast<Block*>(buffer);
+            block->next = nullptr;
+            block->capacity = size - sizeof(Block);
+            block->owned = false;
+            head_ = current_ = block;
+            ptr_ = Begin(block);
+            end_ = ptr_ + block->capacity;
+        }
+    }
+
+    ~Arena()
+    {
+        Release();
+    }
+
+    // 分配size字节，按align对齐，align必须是2的幂
+    void* Allocate(size_t size, size_t align = alignof(std::max_align_t))
+    {
+        char* p = AlignUp(ptr_, align);
+        if (p == nullptr || p + size > end_) {
+            p = AllocateSlow(size, align);
+        }
+        ptr_ = p + size;
+        used_ += size;
+        return p;
+    }
+
+    // 单调分配器不单独释放；最后一次分配的内存可以退回
+    void Deallocate(void* p, size_t size)
+    {
+        if (static_cast<char*>(p) + size == ptr_) {
+            ptr_ = static_cast<char*>(p);
+            used_ -= size;
+        }
+    }
+
+    // 在Arena上构造对象，Arena不会调用析构函数，适合可平凡析构的对象
+    template<typename T, typename... Args>
+    T* Create(Args&&... args)
+    {
+        return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template<typename T>
+    T* CreateArray(size_t n)
+    {
+        return new (Allocate(sizeof(T) * n, alignof(T))) T[n]();
+    }
+
+    // 复制字符串，返回以'\0'结尾的副本
+    char* Strdup(const char* str, size_t len)
+    {
+        char* p = static_cast<char*>(Allocate(len + 1, 1));
+        std::memcpy(p, str, len);
+        p[len] = '\0';
+        return p;
+    }
+
+    // 回收全部内存，O(1)。已申请的内存块保留下来供下次使用
+    void Reset()
+    {
+        current_ = head_;
+        if (current_ != nullptr) {
+            ptr_ = Begin(current_);
+            end_ = ptr_ + current_->capacity;
+        } else {
+            ptr_ = end_ = nullptr;
+        }
+        used_ = 0;
+    }
+
+    // 释放所有申请的内存块
+    void Release()
+    {
+        Block* block = head_;
+        head_ = nullptr;
+        while (block != nullptr) {
+            Block* next = block->next;
+            if (block->owned) {
+                std::free(block);
+            } else {
+                block->next = nullptr;
+                head_ = block;  // 保留外部缓冲区
+            }
+            block = next;
+        }
+        Reset();
+    }
+
+    // 已分配的字节数
+    size_t Used() const
+    {
+        return used_;
+    }
+
+    // 已持有的内存总量
+    size_t Capacity() const
+    {
+        size_t capacity = 0;
+        for (Block* block = head_; block != nullptr; block = block->next) {
+            capacity += block->capacity;
+        }
+        return capacity;
+    }
+
+    // rapidjson Allocator接口
+    void* Malloc(size_t size)
+    {
+        return size != 0 ? Allocate(size) : nullptr;
+    }
+
+    void* Realloc(void* original, size_t original_size, size_t new_size)
+    {
+        if (original == nullptr) {
+            return Malloc(new_size);
+        }
+        if (new_size <= original_size) {
+            return original;
+        }
+
+        // 最后一次分配的内存，空间足够时原地扩展
+        char* p = static_cast<char*>(original);
+        if (p + original_size == ptr_ && p + new_size <= end_) {
+            ptr_ = p + new_size;
+            used_ += new_size - original_size;
+            return original;
+        }
+
+        void* q = Malloc(new_size);
+        std::memcpy(q, original, original_size);
+        return q;
+    }
+
+    static void Free(void*) {}
+
+private:
+    // 禁止复制和赋值
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    static char* Begin(Block* block)
+    {
+        return reinterpret_cast<char*>(block + 1);
+    }
+
+    static char* AlignUp(char* p, size_t align)
+    {
+        uintptr_t addr = reinterpret_cast<uintptr_t>(p);
+        return reinterpret_cast<char*>((addr + align - 1) & ~uintptr_t(align - 1));
+    }
+
+    // 当前块空间不足：使用下一个保留的块，或者申请新块
+    char* AllocateSlow(size_t size, size_t align)
+    {
+        size_t need = size + align;
+        Block* next = current_ != nullptr ? current_->next : head_;
+        if (next == nullptr || next->capacity < need) {
+            // 块大小按2倍增长，大对象单独申请
+            size_t capacity = block_size_;
+            if (block_size_ < kMaxBlockSize) {
+                block_size_ *= 2;
+            }
+            if (capacity < need) {
+                capacity = need;
+            }
+
+            Block* block = static_cast<Block*>(std::malloc(sizeof(Block) + capacity));
+            if (block == nullptr) {
+                throw std::bad_alloc();
+            }
+            block->capacity = capacity;
+            block->owned = true;
+            block->next = next;
+            if (current_ != nullptr) {
+                current_->next = block;
+            } else {
+                head_ = block;
+            }
+            next = block;
+        }
+
+        current_ = next;
+        ptr_ = Begin(current_);
+        end_ = ptr_ + current_->capacity;
+        return AlignUp(ptr_, align);
+    }
+
+private:
+    Block* head_;
+    Block* current_;
+    char*  ptr_;        // 当前块中下一个可分配的位置
+    char*  end_;        // 当前块的结束位置
+    size_t block_size_; // 下一次申请的块大小
+    size_t used_;
+};
+
+
+// 定长块分配器，每次分配固定大小的内存，释放后放入空闲链表，分配和释放都是O(1)
+// 内存按slab批量申请，析构或Release时一次性释放。非线程安全
+class FixedPool
+{
+    struct FreeNode
+    {
+        FreeNode* next;
+    };
+
+public:
+    explicit FixedPool(size_t block_size, size_t blocks_per_slab = 64)
+        : block_size_(RoundUp(block_size < sizeof(FreeNode) ? sizeof(FreeNode) : block_size)),
+          blocks_per_slab_(blocks_per_slab > 0 ? blocks_per_slab : 1), free_(nullptr) {}
+
+    ~FixedPool()
+    {
+        Release();
+    }
+
+    void* Allocate()
+    {
+        if (free_ == nullptr) {
+            AddSlab();
+        }
+        FreeNode* node = free_;
+        free_ = node->next;
+        return node;
+    }
+
+    void Deallocate(void* p)
+    {
+        if (p != nullptr) {
+            FreeNode* node = static_cast<FreeNode*>(p);
+            node->next = free_;
+            free_ = node;
+        }
+    }
+
+    // 释放全部slab，之前分配的内存全部失效
+    void Release()
+    {
+        for (auto slab : slabs_) {
+            std::free(slab);
+        }
+        slabs_.clear();
+        free_ = nullptr;
+    }
+
+    size_t BlockSize() const
+    {
+        return block_size_;
+    }
+
+private:
+    // 禁止复制和赋值
+    FixedPool(const FixedPool&) = delete;
+    FixedPool& operator=(const FixedPool&) = delete;
+
+    static size_t RoundUp(size_t size)
+    {
+        const size_t align = alignof(std::max_align_t);
+        return (size + align - 1) / align * align;
+    }
+
+    void AddSlab()
+    {
+        char* slab = static_cast<char*>(std::malloc(block_size_ * blocks_per_slab_));
+        if (slab == nullptr) {
+            throw std::bad_alloc();
+        }
+        slabs_.push_back(slab);
+
+        // 倒序放入空闲链表，分配时按地址递增
+        for (size_t i = blocks_per_slab_; i > 0; i--) {
+            Deallocate(slab + (i - 1) * block_size_);
+        }
+    }
+
+private:
+    const size_t block_size_;
+    const size_t blocks_per_slab_;
+    FreeNode* free_;
+    std::vector<char*> slabs_;
+};
+
+
+// STL分配器适配，容器的内存从Arena中分配，Arena::Reset时一起回收
+// 容器析构时不会真正释放内存，容器的生命周期不能超过Arena
+template<typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(Arena* arena) : arena_(arena) {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.GetArena()) {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        arena_->Deallocate(p, n * sizeof(T));
+    }
+
+    Arena* GetArena() const
+    {
+        return arena_;
+    }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const
+    {
+        return arena_ == other.GetArena();
+    }
+
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const
+    {
+        return arena_ != other.GetArena();
+    }
+
+private:
+    Arena* arena_;
+};
+
+// 常用容器
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+} // namespace util
+
+#endif // UTIL_ARENA_H_
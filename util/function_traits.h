@@ -12,6 +12,7 @@
 #ifndef UTIL_FUNCTION_TRAITS_H_
 #define UTIL_FUNCTION_TRAITS_H_
 
+#include <cstddef>      // size_t
 #include <functional>
 #include <tuple>
 
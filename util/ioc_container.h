@@ -14,77 +14,171 @@
 
 #include "any.h"
 
+#include <cstdint>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <memory>
 #include <functional>
 #include <stdexcept>
+#include <atomic>
+#include <mutex>
 
 namespace util {
 
+// 对象的生命周期
+enum class Lifetime
+{
+    Transient,  // 每次Resolve创建新对象
+    Singleton,  // 容器内只创建一次
+    PerThread,  // 每个线程创建一次，线程退出时释放
+    PerScope,   // 每个Scope创建一次，Scope析构时释放
+};
+
 // Ioc(Inversion of Control)，控制翻转
 // IoC容器 让应用本身不依赖对象的创建和维护，而是交给IoC容器来负责，降低了对象之间直接依赖的耦合性
+// 使用方式：启动时注册全部构造器，然后调用Freeze冻结。冻结后不能再注册，构造器被搬到扁平的开放寻址表中，
+// 并尽量选取无冲突的哈希种子（完美哈希），Resolve通常只需一次哈希和一次比较，多线程并发Resolve是安全的
+// 注册时可以指定生命周期，非Transient的对象由容器（或线程、Scope）缓存并持有，首次Resolve时的参数用于构造，
+// 之后的参数被忽略；Resolve返回的指针不能由调用者释放，ResolveShared返回共享所有权的指针
 class IocContainer
 {
+    // 注册项，构造器和缓存的对象
+    struct Entry
+    {
+        Entry(util::Any&& c, Lifetime l, uint64_t i)
+            : creator(std::move(c)), lifetime(l), index(i), ready(false) {}
+
+        util::Any             creator;
+        Lifetime              lifetime;
+        uint64_t              index;        // 注册序号，线程缓存中的key
+        std::mutex            mtx;          // 保护Singleton对象的创建
+        std::atomic<bool>     ready;        // Singleton对象已创建
+        std::shared_ptr<void> instance;     // Singleton对象，创建后不再修改
+    };
+
+    using EntryPtr = std::unique_ptr<Entry>;
+
 public:
-    IocContainer() = default;
+    // 生命周期为PerScope的对象缓存在Scope中，Scope析构时一次性释放，例如每个请求一个Scope
+    // 其他生命周期的对象转交给容器处理。多个线程可以共享同一个Scope
+    class Scope
+    {
+    public:
+        explicit Scope(IocContainer& ioc) : ioc_(ioc) {}
+
+        template<class T, typename... Args>
+        T* Resolve(const std::string& key, Args... args)
+        {
+            return ioc_.ResolveIn<T>(this, key, args...);
+        }
+
+        template<class T, typename... Args>
+        std::shared_ptr<T> ResolveShared(const std::string& key, Args... args)
+        {
+            return ioc_.ResolveSharedIn<T>(this, key, args...);
+        }
+
+        // 释放缓存的全部对象
+        void Clear()
+        {
+            std::lock_guard<std::mutex> locker(mtx_);
+            instances_.clear();
+        }
+
+    private:
+        friend class IocContainer;
+
+        // 禁止复制和赋值
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        IocContainer& ioc_;
+        std::mutex    mtx_;
+        std::unordered_map<const Entry*, std::shared_ptr<void>> instances_;
+    };
+
+    IocContainer() : id_(NextId()) {}
     virtual ~IocContainer() = default;
 
     // 注册需要创建对象的key和构造器
     // 传入一个唯一标识key，以便创造对象时查找对应的构造函数
     template<class T, typename... Args>  // 单独的类
-    void RegisterSimple(const std::string& key)
+    void RegisterSimple(const std::string& key, Lifetime lifetime = Lifetime::Transient)
     {
         // 通过闭包擦除参数类型，即通过lambda来实现
         std::function<T*(Args...)> func = [] (Args... args) {
             return new T(args...);
         };
-        RegisterType(key, func);
+        RegisterType(key, func, lifetime);
     }
 
     // Derived 派生类
     template<class T, typename Derived, typename... Args>
     typename std::enable_if<std::is_base_of<T, Derived>::value>::type
-    Register(const std::string& key)
+    Register(const std::string& key, Lifetime lifetime = Lifetime::Transient)
     {
         // 通过闭包擦除参数类型，即通过lambda来实现
         std::function<T*(Args...)> func = [] (Args... args) {
             return new Derived(args...);
         };
-        RegisterType(key, func);
+        RegisterType(key, func, lifetime);
     }
 
     // Depend 依赖类
     template<class T, typename Depend, typename... Args>
     typename std::enable_if<!std::is_base_of<T, Depend>::value>::type
-    Register(const std::string& key)
+    Register(const std::string& key, Lifetime lifetime = Lifetime::Transient)
     {
         // 通过闭包擦除参数类型，即通过lambda来实现
         std::function<T*(Args...)> func = [] (Args... args) {
             return new T(new Depend(args...));
         };
-        RegisterType(key, func);
+        RegisterType(key, func, lifetime);
     }
 
-    // 根据标识查找对应的构造器，并创建对象指针
+    // 根据标识查找对应的构造器，并创建对象指针。构造器按引用使用，不复制Any
+    // Transient返回新对象，由调用者释放；其他生命周期返回缓存的对象
     template<class T, typename... Args>
     T* Resolve(const std::string& key, Args... args)
     {
-        if (creator_map_.find(key) == creator_map_.end()) {
-            return nullptr;
+        return ResolveIn<T>(nullptr, key, args...);
+    }
+
+    // 冻结容器，之后不能再注册
+    void Freeze()
+    {
+        if (frozen_) {
+            return;
         }
 
-        util::Any resolver = creator_map_[key];
-        std::function<T*(Args...)> func = resolver.AnyCast<std::function<T*(Args...)>>();
-        return func(args...);
+        // 从2倍容量开始寻找没有冲突的种子，找不到则扩大容量；最终仍有冲突时依靠线性探测
+        size_t capacity = 2;
+        while (capacity < creator_map_.size() * 2) {
+            capacity *= 2;
+        }
+        for (; capacity <= creator_map_.size() * 8 + 8; capacity *= 2) {
+            for (uint64_t seed = 0; seed < kMaxSeedTry; seed++) {
+                if (CollisionFree(seed, capacity - 1)) {
+                    Build(seed, capacity);
+                    return;
+                }
+            }
+        }
+        Build(0, capacity / 2);
+    }
+
+    bool Frozen() const
+    {
+        return frozen_;
     }
 
     // 根据标识查找对应的构造器，并创建智能对象指针
     template<class T, typename... Args>
     std::shared_ptr<T> ResolveShared(const std::string& key, Args... args)
     {
-        T* ptr = Resolve<T>(key, args...);
-        return std::shared_ptr<T>(ptr);
+        return ResolveSharedIn<T>(nullptr, key, args...);
     }
 
 private:
@@ -92,19 +186,330 @@ private:
     IocContainer(const IocContainer&) = delete;
     IocContainer& operator=(const IocContainer&) = delete;
 
+    static const uint64_t kMaxSeedTry = 64;
+
+    template<class T, typename... Args>
+    T* ResolveIn(Scope* scope, const std::string& key, Args... args)
+    {
+        Entry* entry = Find(key);
+        if (entry == nullptr) {
+            return nullptr;
+        }
+
+        auto& func = entry->creator.AnyCast<std::function<T*(Args...)>>();
+        if (entry->lifetime == Lifetime::Transient) {
+            return func(args...);
+        }
+        return static_cast<T*>(Cached(*entry, scope, func, args...).get());
+    }
+
+    template<class T, typename... Args>
+    std::shared_ptr<T> ResolveSharedIn(Scope* scope, const std::string& key, Args... args)
+    {
+        Entry* entry = Find(key);
+        if (entry == nullptr) {
+            return nullptr;
+        }
+
+        auto& func = entry->creator.AnyCast<std::function<T*(Args...)>>();
+        if (entry->lifetime == Lifetime::Transient) {
+            return std::shared_ptr<T>(func(args...));
+        }
+        return std::static_pointer_cast<T>(Cached(*entry, scope, func, args...));
+    }
+
+    // 按生命周期查找缓存的对象，不存在时创建。返回的引用在对应的缓存释放前有效
+    template<class T, typename... Args>
+    const std::shared_ptr<void>& Cached(Entry& entry, Scope* scope,
+        const std::function<T*(Args...)>& func, Args... args)
+    {
+        switch (entry.lifetime) {
+        case Lifetime::Singleton:
+            if (!entry.ready.load(std::memory_order_acquire)) {
+                std::lock_guard<std::mutex> locker(entry.mtx);
+                if (!entry.ready.load(std::memory_order_relaxed)) {
+                    entry.instance = std::shared_ptr<T>(func(args...));
+                    entry.ready.store(true, std::memory_order_release);
+                }
+            }
+            return entry.instance;
+
+        case Lifetime::PerThread: {
+            auto& cache = ThreadCache();
+            uint64_t key = (id_ << 32) | entry.index;
+            auto it = cache.find(key);
+            if (it == cache.end()) {
+                it = cache.emplace(key, std::shared_ptr<T>(func(args...))).first;
+            }
+            return it->second;
+        }
+
+        default: {
+            if (scope == nullptr) {
+                throw std::logic_error("the PerScope object must be resolved in a scope!");
+            }
+            // 在Scope的锁内创建，保证并发Resolve只创建一次
+            std::lock_guard<std::mutex> locker(scope->mtx_);
+            auto it = scope->instances_.find(&entry);
+            if (it == scope->instances_.end()) {
+                it = scope->instances_.emplace(&entry, std::shared_ptr<T>(func(args...))).first;
+            }
+            return it->second;
+        }
+        }
+    }
+
+    // 线程缓存，key为容器id和注册序号，线程退出时释放
+    static std::unordered_map<uint64_t, std::shared_ptr<void>>& ThreadCache()
+    {
+        static thread_local std::unordered_map<uint64_t, std::shared_ptr<void>> cache;
+        return cache;
+    }
+
+    // 容器的唯一id，避免容器析构后地址被复用导致线程缓存错乱
+    static uint64_t NextId()
+    {
+        static std::atomic<uint64_t> id{0};
+        return ++id;
+    }
+
+    // 冻结后的表项，hash为0表示空
+    struct Slot
+    {
+        Slot() : hash(0) {}
+
+        uint64_t    hash;
+        std::string key;
+        EntryPtr    entry;
+    };
+
+    // 带种子的哈希，混合函数取自MurmurHash3的finalizer
+    static uint64_t Hash(const std::string& key, uint64_t seed)
+    {
+        uint64_t h = std::hash<std::string>()(key) ^ (seed * 0x9E3779B97F4A7C15ULL);
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ULL;
+        h ^= h >> 33;
+        return h | 1;   // 保证非0
+    }
+
+    bool CollisionFree(uint64_t seed, size_t mask) const
+    {
+        std::vector<bool> used(mask + 1, false);
+        for (auto& item : creator_map_) {
+            size_t index = Hash(item.first, seed) & mask;
+            if (used[index]) {
+                return false;
+            }
+            used[index] = true;
+        }
+        return true;
+    }
+
+    void Build(uint64_t seed, size_t capacity)
+    {
+        std::vector<Slot> slots(capacity);
+        for (auto& item : creator_map_) {
+            uint64_t hash = Hash(item.first, seed);
+            size_t index = hash & (capacity - 1);
+            while (slots[index].hash != 0) {
+                index = (index + 1) & (capacity - 1);
+            }
+            slots[index].hash = hash;
+            slots[index].key = item.first;
+            slots[index].entry = std::move(item.second);
+        }
+
+        slots_.swap(slots);
+        seed_ = seed;
+        mask_ = capacity - 1;
+        creator_map_.clear();
+        frozen_ = true;
+    }
+
+    Entry* Find(const std::string& key) const
+    {
+        if (!frozen_) {
+            auto it = creator_map_.find(key);
+            return it != creator_map_.end() ? it->second.get() : nullptr;
+        }
+
+        uint64_t hash = Hash(key, seed_);
+        for (size_t index = hash & mask_; slots_[index].hash != 0; index = (index + 1) & mask_) {
+            if (slots_[index].hash == hash && slots_[index].key == key) {
+                return slots_[index].entry.get();
+            }
+        }
+        return nullptr;
+    }
+
     // 注册类型和构造器
-    void RegisterType(const std::string& key, util::Any creator)
+    void RegisterType(const std::string& key, util::Any creator, Lifetime lifetime)
     {
+        if (frozen_) {
+            throw std::logic_error("the container is frozen, can not register any more!");
+        }
         if (creator_map_.find(key) != creator_map_.end()) {
             throw std::invalid_argument("this key has already exist!");
         }
         // 通过Any擦除不同类型的构造器
-        creator_map_.emplace(key, creator);
+        creator_map_.emplace(key, EntryPtr(new Entry(std::move(creator), lifetime, creator_map_.size())));
     }
 
 private:
     // 对象构造器map：key -- creator。通过Any擦除不同类型的构造器
-    std::unordered_map<std::string, util::Any> creator_map_;
+    std::unordered_map<std::string, EntryPtr> creator_map_;
+    const uint64_t id_;
+
+    // 冻结后的查找表
+    bool              frozen_ = false;
+    uint64_t          seed_ = 0;
+    size_t            mask_ = 0;
+    std::vector<Slot> slots_;
+};
+
+
+// 编译期依赖注入：注册时给出类型之间的依赖关系，由模板生成直接的构造代码，没有类型擦除和运行期查找
+//   Bind<Interface, Impl, Deps...>  Interface由Impl实现，Impl的构造函数依次接收std::shared_ptr<Deps>...
+//   未给出Deps时，使用Impl::Inject（util::Inject<Deps...>）声明的依赖，都没有则默认构造
+//   未注册的具体类型自动绑定到自身，依赖递归自动装配；依赖成环、抽象类型未绑定都在编译期报错
+template<typename... Deps>
+struct Inject {};
+
+template<typename Interface, typename Impl, typename... Deps>
+struct Bind
+{
+    static_assert(std::is_base_of<Interface, Impl>::value, "Impl must be derived from Interface");
+
+    using interface_type = Interface;
+    using impl_type      = Impl;
+    using inject_type    = Inject<Deps...>;
+};
+
+namespace detail {
+
+// 解析路径上的类型，用于检测依赖环
+template<typename... Types>
+struct IocPath
+{
+    template<typename T>
+    struct Has : std::false_type {};
+
+    template<typename T>
+    using Push = IocPath<Types..., T>;
+};
+
+template<typename First, typename... Types>
+struct IocPath<First, Types...>
+{
+    template<typename T>
+    struct Has : std::integral_constant<bool,
+        std::is_same<T, First>::value || IocPath<Types...>::template Has<T>::value> {};
+
+    template<typename T>
+    using Push = IocPath<First, Types..., T>;
+};
+
+// Impl::Inject声明的依赖
+template<typename T, typename = void>
+struct IocInjectOf
+{
+    using type = Inject<>;
+};
+
+template<typename T>
+struct IocInjectOf<T, typename std::enable_if<!std::is_void<typename T::Inject*>::value>::type>
+{
+    using type = typename T::Inject;
+};
+
+// 查找Interface的绑定，找不到时绑定到自身
+template<typename Interface, typename... Bindings>
+struct IocFindBinding
+{
+    static_assert(!std::is_abstract<Interface>::value, "no binding for the abstract type");
+    using type = Bind<Interface, Interface>;
+};
+
+template<typename T>
+struct IocIdentity
+{
+    using type = T;
+};
+
+// 只实例化被选中的分支，避免未使用的分支触发static_assert
+template<typename Interface, typename First, typename... Bindings>
+struct IocFindBinding<Interface, First, Bindings...> : std::conditional<
+    std::is_same<Interface, typename First::interface_type>::value,
+    IocIdentity<First>, IocFindBinding<Interface, Bindings...>>::type {};
+
+// 依赖列表，显式给出的优先，否则取Impl::Inject
+template<typename Binding>
+struct IocDepsOf
+{
+    using type = typename std::conditional<
+        std::is_same<typename Binding::inject_type, Inject<>>::value,
+        typename IocInjectOf<typename Binding::impl_type>::type,
+        typename Binding::inject_type>::type;
+};
+
+template<typename Container, typename T, typename Path, bool Cycle = Path::template Has<T>::value>
+struct IocResolver;
+
+// 检测到依赖环
+template<typename Container, typename T, typename Path>
+struct IocResolver<Container, T, Path, true>
+{
+    static_assert(!Path::template Has<T>::value, "dependency cycle detected");
+
+    template<typename... Args>
+    static std::shared_ptr<T> Create(Args&&...)
+    {
+        return nullptr;
+    }
+};
+
+template<typename Container, typename T, typename Path>
+struct IocResolver<Container, T, Path, false>
+{
+    using Binding = typename Container::template BindingOf<T>;
+    using Impl    = typename Binding::impl_type;
+    using Next    = typename Path::template Push<T>;
+
+    template<typename... Args>
+    static std::shared_ptr<T> Create(Args&&... args)
+    {
+        return Construct(typename IocDepsOf<Binding>::type(), std::forward<Args>(args)...);
+    }
+
+private:
+    template<typename... Deps, typename... Args>
+    static std::shared_ptr<T> Construct(Inject<Deps...>, Args&&... args)
+    {
+        return std::make_shared<Impl>(IocResolver<Container, Deps, Next>::Create()...,
+                                      std::forward<Args>(args)...);
+    }
+};
+
+} // namespace detail
+
+// 编译期IoC容器，所有绑定在类型中给出，Resolve直接展开为嵌套的make_shared
+template<typename... Bindings>
+class StaticIocContainer
+{
+public:
+    template<typename T>
+    using BindingOf = typename detail::IocFindBinding<T, Bindings...>::type;
+
+    // 创建T及其全部依赖，args作为T的实现类构造函数的额外参数，放在依赖之后
+    template<typename T, typename... Args>
+    static std::shared_ptr<T> Resolve(Args&&... args)
+    {
+        return detail::IocResolver<StaticIocContainer, T, detail::IocPath<>>::Create(
+            std::forward<Args>(args)...);
+    }
 };
 
 } // namespace util
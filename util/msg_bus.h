@@ -14,29 +14,138 @@
 
 #include "function_traits.h"
 #include "any.h"
+#include "small_alloc.h"
 
+#include <atomic>
+#include <algorithm>
 #include <functional>
 #include <string>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 返回值被忽略时给出编译警告：Register返回的订阅句柄被丢弃会立即移除消息
+#if defined(__GNUC__) || defined(__clang__)
+#define UTIL_WARN_UNUSED_RESULT __attribute__((warn_unused_result))
+#else
+#define UTIL_WARN_UNUSED_RESULT
+#endif
 
 namespace util {
 
 class MsgBus
 {
-    using Iterator = std::multimap<std::string, util::Any>::iterator;
+    struct Handler;
+    using HandlerPtr = std::shared_ptr<Handler>;
+    using HandlerMap = std::multimap<std::string, HandlerPtr, std::less<std::string>,
+        SmallAllocator<std::pair<const std::string, HandlerPtr>>>;
+    using Iterator = HandlerMap::iterator;
+
+    // 已注册的消息处理函数，记录自身在map中的位置，移除时无需查找
+    struct Handler
+    {
+        explicit Handler(util::Any&& f) : func(std::move(f)), removed(false), running(0) {}
+
+        util::Any         func;
+        std::atomic<bool> removed;  // 已被移除，分发过程中跳过
+        std::atomic<int>  running;  // 正在执行的调用数，移除时等待归零
+        Iterator          pos;      // 在handlers中的位置，只在持有锁时访问
+    };
+
+    // 总线的内部状态，Subscription通过weak_ptr引用，总线析构后订阅句柄自动失效
+    struct Registry
+    {
+        std::mutex mtx;         // 只保护handlers，调用消息处理函数时不持有
+        HandlerMap handlers;
+    };
+
 public:
-    MsgBus() = default;
+    // 订阅句柄，析构时自动移除对应的消息处理函数
+    class Subscription
+    {
+    public:
+        Subscription() = default;
+
+        Subscription(Subscription&& other)
+            : registry_(std::move(other.registry_)), handler_(std::move(other.handler_)) {}
+
+        Subscription& operator=(Subscription&& other)
+        {
+            if (this != &other) {
+                Unsubscribe();
+                registry_ = std::move(other.registry_);
+                handler_  = std::move(other.handler_);
+            }
+            return *this;
+        }
+
+        ~Subscription()
+        {
+            Unsubscribe();
+        }
+
+        // 移除消息，O(1)
+        void Unsubscribe()
+        {
+            auto registry = registry_.lock();
+            auto handler  = handler_.lock();
+            Release();
+            if (registry && handler) {
+                MsgBus::Erase(*registry, handler);
+            }
+        }
+
+        // 放弃句柄，消息处理函数一直保留在总线中
+        void Release()
+        {
+            registry_.reset();
+            handler_.reset();
+        }
+
+        // 消息处理函数是否仍在总线中
+        bool Active() const
+        {
+            auto registry = registry_.lock();
+            auto handler  = handler_.lock();
+            if (!registry || !handler) {
+                return false;
+            }
+
+            return !handler->removed.load();
+        }
+
+    private:
+        friend class MsgBus;
+
+        Subscription(const std::shared_ptr<Registry>& registry, const HandlerPtr& handler)
+            : registry_(registry), handler_(handler) {}
+
+        // 禁止复制和赋值
+        Subscription(const Subscription&) = delete;
+        Subscription& operator=(const Subscription&) = delete;
+
+    private:
+        std::weak_ptr<Registry> registry_;
+        std::weak_ptr<Handler>  handler_;
+    };
+
+    MsgBus() : registry_(std::make_shared<Registry>()) {}
     virtual ~MsgBus() = default;
 
-    // 注册消息
+    // 注册消息，返回订阅句柄，句柄析构时移除该消息。不需要句柄时调用Release()保留消息
     template<typename F>
-    void Register(F&& f, const std::string& topic = "")
+    UTIL_WARN_UNUSED_RESULT Subscription Register(F&& f, const std::string& topic = "")
     {
         auto func = util::ToFucntion(std::forward<F>(f));
-        Add(topic, std::move(func));
+        return Add(topic, std::move(func));
     }
 
-    // 发送消息
+    // 发送消息。在锁内复制匹配的消息处理函数，释放锁后再逐个调用，
+    // 处理函数中可以再次Send/Register/Unsubscribe，也不会阻塞其他线程的Send。
+    // 分发开始后被移除的处理函数不再调用；移除时等待其他线程中已经开始的调用结束，
+    // 因此捕获this的处理函数在订阅句柄析构后不会再访问对象
     template<typename R>
     void Send(const std::string& topic = "")
     {
@@ -44,9 +153,12 @@ public:
 
         // topic + 函数名
         std::string msg_type = topic + typeid(FunctionType).name();
-        auto range = msg_map_.equal_range(msg_type);
-        for (Iterator it = range.first; it != range.second; ++it) {
-            auto func = it->second.AnyCast<FunctionType>();
+        for (auto& handler : Collect(msg_type)) {
+            CallGuard guard(*handler);
+            if (handler->removed.load()) {
+                continue;
+            }
+            auto& func = handler->func.AnyCast<FunctionType>();
             func();
         }
     }
@@ -58,23 +170,25 @@ public:
 
         // topic + 函数名
         std::string msg_type = topic + typeid(FunctionType).name();
-        auto range = msg_map_.equal_range(msg_type);
-        for (Iterator it = range.first; it != range.second; ++it) {
-            auto func = it->second.AnyCast<FunctionType>();
+        for (auto& handler : Collect(msg_type)) {
+            CallGuard guard(*handler);
+            if (handler->removed.load()) {
+                continue;
+            }
+            auto& func = handler->func.AnyCast<FunctionType>();
             func(std::forward<Args>(args)...);
         }
     }
 
-    // 移除消息，需要主题和消息类型
+    // 移除消息，需要主题和消息类型，该主题下的所有消息都会被移除
     template<typename R, typename... Args>
     void Remove(const std::string& topic = "")
     {
         using FunctionType = std::function<R(Args...)>;
 
         std::string msg_type = topic + typeid(FunctionType).name();
-        if (msg_map_.count(msg_type) > 0) {
-            auto range = msg_map_.equal_range(msg_type);
-            msg_map_.erase(range.first, range.second);
+        for (auto& handler : Collect(msg_type)) {
+            Erase(*registry_, handler);
         }
     }
 
@@ -83,16 +197,78 @@ private:
     MsgBus(const MsgBus&) = delete;
     MsgBus& operator=(const MsgBus&) = delete;
 
+    // 登记一次正在执行的调用。先登记再检查removed，与Erase中先标记再等待的顺序配合（均为seq_cst），
+    // Erase返回后不会再有新的调用开始
+    struct CallGuard
+    {
+        explicit CallGuard(Handler& handler) : handler_(handler)
+        {
+            handler_.running.fetch_add(1);
+            Running().push_back(&handler_);
+        }
+
+        ~CallGuard()
+        {
+            Running().pop_back();
+            handler_.running.fetch_sub(1);
+        }
+
+        Handler& handler_;
+    };
+
+    // 本线程中正在执行的消息处理函数，处理函数中移除自身时不等待自己
+    static std::vector<const Handler*>& Running()
+    {
+        static thread_local std::vector<const Handler*> running;
+        return running;
+    }
+
+    // 在锁内复制匹配的消息处理函数，调用期间由shared_ptr保持有效
+    std::vector<HandlerPtr> Collect(const std::string& msg_type)
+    {
+        std::vector<HandlerPtr> handlers;
+        std::lock_guard<std::mutex> locker(registry_->mtx);
+
+        auto range = registry_->handlers.equal_range(msg_type);
+        for (Iterator it = range.first; it != range.second; ++it) {
+            handlers.push_back(it->second);
+        }
+        return handlers;
+    }
+
     // 将消息加入map中
     template<typename F>
-    void Add(const std::string& topic, F&& f)
+    Subscription Add(const std::string& topic, F&& f)
     {
         std::string msg_type = topic + typeid(F).name();
-        msg_map_.emplace(std::move(msg_type), std::forward<F>(f));
+        auto handler = MakeSmallShared<Handler>(util::Any(std::forward<F>(f)));
+
+        std::lock_guard<std::mutex> locker(registry_->mtx);
+        handler->pos = registry_->handlers.emplace(std::move(msg_type), handler);
+        return Subscription(registry_, handler);
+    }
+
+    // 移除一个消息。正在进行的Send持有处理函数的副本，可以直接删除map节点；
+    // 然后在锁外等待其他线程中正在执行的调用结束，已被移除时也要等待
+    // 两个线程中的处理函数互相移除对方会互相等待，不能这样使用
+    static void Erase(Registry& registry, const HandlerPtr& handler)
+    {
+        {
+            std::lock_guard<std::mutex> locker(registry.mtx);
+            if (!handler->removed.exchange(true)) {
+                registry.handlers.erase(handler->pos);
+            }
+        }
+
+        auto& running = Running();
+        int self = static_cast<int>(std::count(running.begin(), running.end(), handler.get()));
+        while (handler->running.load() > self) {
+            std::this_thread::yield();
+        }
     }
 
 private:
-    std::multimap<std::string, util::Any> msg_map_;
+    std::shared_ptr<Registry> registry_;
 };
 
 } // namespace util
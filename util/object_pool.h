@@ -12,68 +12,797 @@
 #ifndef UTIL_OBJECT_POOL_H_
 #define UTIL_OBJECT_POOL_H_
 
+#include "small_alloc.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
 #include <string>
+#include <stdexcept>
 #include <functional>
 #include <memory>
-#include <map>
-#include <iostream>
+
+// AddressSanitizer下，调试模式会把池中空闲的内存标记为不可访问
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#define UTIL_POOL_POISON(addr, size)   ASAN_POISON_MEMORY_REGION(addr, size)
+#define UTIL_POOL_UNPOISON(addr, size) ASAN_UNPOISON_MEMORY_REGION(addr, size)
+#else
+#define UTIL_POOL_POISON(addr, size)   ((void)(addr), (void)(size))
+#define UTIL_POOL_UNPOISON(addr, size) ((void)(addr), (void)(size))
+#endif
 
 namespace util {
 
-// 对象池最大容量
-const int g_object_max = 10;
+// 构造签名的序号，按池中的对象类型Owner分别编号，不同类型的对象池互不占用序号
+// 只有Alloc分配序号（Init时调用），Find只读取已分配的序号，获取未初始化的签名不会占用序号
+template<typename Owner>
+struct PoolTypeIndex
+{
+    static const size_t kNone = static_cast<size_t>(-1);
+
+    // 已分配的序号，未分配时返回kNone
+    template<typename Sig>
+    static size_t Find()
+    {
+        return Slot<Sig>().load(std::memory_order_acquire);
+    }
+
+    template<typename Sig>
+    static size_t Alloc()
+    {
+        std::atomic<size_t>& slot = Slot<Sig>();
+        size_t index = slot.load(std::memory_order_acquire);
+        if (index == kNone) {
+            static std::mutex mtx;
+            static size_t next = 0;
+            std::lock_guard<std::mutex> locker(mtx);
+            index = slot.load(std::memory_order_relaxed);
+            if (index == kNone) {
+                index = next++;
+                slot.store(index, std::memory_order_release);
+            }
+        }
+        return index;
+    }
+
+private:
+    template<typename Sig>
+    static std::atomic<size_t>& Slot()
+    {
+        static std::atomic<size_t> index(kNone);
+        return index;
+    }
+};
+
+// 对象池统计信息
+struct ObjectPoolStats
+{
+    size_t   size     = 0;  // 当前对象总数（包括借出的）
+    uint64_t hits     = 0;  // 直接从池中取到对象的次数
+    uint64_t misses   = 0;  // 池为空，通过工厂新建对象的次数
+    uint64_t waits    = 0;  // AcquireFor需要等待的次数
+    uint64_t timeouts = 0;  // 等待超时的次数
+    uint64_t failures = 0;  // Get/AcquireFor返回nullptr的次数
+};
 
+// 线程安全的弹性对象池
+// 每种构造签名对应一个Core，Core中的空闲对象保存在无锁栈中；
+// 池为空时通过Init记录的构造参数新建对象，直到达到最大容量；空闲超时后通过Shrink收缩到最小容量。
+// 不限制容量时，每个线程另外缓存一部分空闲对象，Get/Put通常只访问线程本地缓存；
+// 限制容量时不使用线程缓存，避免对象滞留在其他线程中导致AcquireFor等待。
+// 对象归还时可以执行Reset/Validate钩子；调试模式下归还的对象被销毁并填充0xDD，下次使用时重新构造
 template<typename T>
 class ObjectPool
 {
-    // 定义带参数的函数，返回对象的智能指针
+    // 定义带参数的函数，返回对象的智能指针，用作构造签名的类型索引
     template<typename... Args>
     using Constructor = std::function<std::shared_ptr<T>(Args...)>;
+
+    using Clock = std::chrono::steady_clock;
+
+    enum
+    {
+        kMaxSignatures = 16,    // 每种对象类型最多支持的构造签名数
+        kLocalMax      = 32,    // 每个线程为每个Core缓存的最大对象数
+        kCacheSlots    = 4,     // 每个线程最多同时缓存的Core数
+    };
+
+    // 对象内存按8字节对齐取整，ASan只能标记完整的8字节
+    enum
+    {
+        kObjSize  = (sizeof(T) + 7) / 8 * 8,
+        kObjAlign = std::alignment_of<T>::value > 8 ? std::alignment_of<T>::value : 8,
+    };
+
+    // 对象节点，obj必须是第一个成员，这样可以由对象指针直接得到节点
+    struct Node
+    {
+        typename std::aligned_storage<kObjSize, kObjAlign>::type obj;
+        std::atomic<uint32_t> next;     // 栈中下一个节点的索引+1，0表示栈底
+        uint32_t index;                 // 节点自身的索引
+        uint32_t generation;            // 每次归还加1，用于检查句柄是否过期
+    };
+
+    // 节点栈，高32位为版本号（避免ABA问题），低32位为栈顶节点索引+1
+    using Stack = std::atomic<uint64_t>;
+
+    // 同一构造签名的对象集合，节点内存由Core统一持有，Core析构前节点不会被释放
+    // free_中的节点保存着已构造的空闲对象，vacant_中的节点是收缩后留下的空位
+    class Core : public std::enable_shared_from_this<Core>
+    {
+        enum
+        {
+            kFirstChunk = 16,   // 第k块内存包含 kFirstChunk << k 个节点
+            kMaxChunks  = 27,
+        };
+
+    public:
+        Core(size_t min_size, size_t max_size, std::function<void(void*)>&& factory,
+            const std::function<void(T&)>& reset, const std::function<bool(const T&)>& validate,
+            bool debug)
+            : min_size_(min_size), max_size_(max_size), factory_(std::move(factory)),
+              reset_(reset), validate_(validate), debug_(debug),
+              size_(0), free_(0), vacant_(0), live_(0), waiters_(0), pressure_(Now()),
+              hits_(0), misses_(0), waits_(0), timeouts_(0), failures_(0)
+        {
+            for (auto& chunk : chunks_) {
+                chunk.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        ~Core()
+        {
+            // Core析构时所有对象都已回到空闲栈
+            Node* node = nullptr;
+            while ((node = Pop(free_)) != nullptr) {
+                reinterpret_cast<T*>(&node->obj)->~T();
+            }
+
+            for (uint32_t k = 0; k < kMaxChunks; k++) {
+                Node* chunk = chunks_[k].load(std::memory_order_relaxed);
+                UTIL_POOL_UNPOISON(chunk, chunk != nullptr ? sizeof(Node) * (kFirstChunk << k) : 0);
+                delete[] chunk;
+            }
+        }
+
+        // 不限制容量时才使用线程缓存
+        bool Cached() const
+        {
+            return max_size_ == SIZE_MAX;
+        }
+
+        // 新建一个对象，超过最大容量返回nullptr
+        Node* Grow()
+        {
+            size_t live = live_.load(std::memory_order_relaxed);
+            do {
+                if (live >= max_size_) {
+                    return nullptr;
+                }
+            } while (!live_.compare_exchange_weak(live, live + 1, std::memory_order_relaxed));
+
+            Node* node = Pop(vacant_);
+            if (node == nullptr) {
+                node = NewNode();
+            }
+
+            UTIL_POOL_UNPOISON(&node->obj, sizeof(node->obj));
+            try {
+                factory_(&node->obj);
+            } catch (...) {
+                UTIL_POOL_POISON(&node->obj, sizeof(node->obj));
+                Push(vacant_, node, node);
+                live_.fetch_sub(1, std::memory_order_relaxed);
+                throw;
+            }
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return node;
+        }
+
+        // 从空闲栈取一个对象，栈为空时记录压力时间，尝试新建
+        Node* Take()
+        {
+            Node* node = Pop(free_);
+            if (node != nullptr) {
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return node;
+            }
+
+            pressure_.store(Now(), std::memory_order_relaxed);
+            return Grow();
+        }
+
+        // 归还一个或一串对象，有线程在等待时唤醒
+        void Give(Node* first, Node* last)
+        {
+            Push(free_, first, last);
+            Notify();
+        }
+
+        // 对象归还前执行钩子，返回false表示对象已被销毁，不再放回池中
+        // generation为句柄记录的代数，调试模式下检查重复归还
+        bool Recycle(Node* node, uint32_t generation)
+        {
+            if (debug_ && node->generation != generation) {
+                throw std::logic_error("object pool: object released twice");
+            }
+            node->generation++;
+
+            T& obj = *reinterpret_cast<T*>(&node->obj);
+            if (validate_ && !validate_(obj)) {
+                Discard(node);
+                return false;
+            }
+            if (debug_) {
+                Discard(node);  // 调试模式不复用对象，释放后再访问会读到0xDD或被ASan捕获
+                return false;
+            }
+            if (reset_) {
+                reset_(obj);
+            }
+            return true;
+        }
+
+        // 等待其他线程归还对象，超时返回nullptr
+        Node* Wait(std::chrono::milliseconds timeout)
+        {
+            waits_.fetch_add(1, std::memory_order_relaxed);
+            auto deadline = Clock::now() + timeout;
+
+            std::unique_lock<std::mutex> locker(mtx_);
+            waiters_.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            Node* node = nullptr;
+            while (true) {
+                node = Pop(free_);
+                if (node == nullptr) {
+                    node = Grow();
+                }
+                if (node != nullptr) {
+                    hits_.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+                if (cond_.wait_until(locker, deadline) == std::cv_status::timeout) {
+                    node = Pop(free_);
+                    if (node == nullptr) {
+                        timeouts_.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    break;
+                }
+            }
+
+            waiters_.fetch_sub(1, std::memory_order_relaxed);
+            return node;
+        }
+
+        // 空闲超过idle_timeout后，销毁多余的空闲对象，直到最小容量
+        size_t Shrink(Clock::duration idle_timeout)
+        {
+            if (Now() - pressure_.load(std::memory_order_relaxed) < idle_timeout.count()) {
+                return 0;
+            }
+
+            std::lock_guard<std::mutex> locker(mtx_);  // 串行化收缩，避免低于最小容量
+            size_t count = 0;
+            while (live_.load(std::memory_order_relaxed) > min_size_) {
+                Node* node = Pop(free_);
+                if (node == nullptr) {
+                    break;
+                }
+                reinterpret_cast<T*>(&node->obj)->~T();
+                UTIL_POOL_POISON(&node->obj, sizeof(node->obj));
+                Push(vacant_, node, node);
+                live_.fetch_sub(1, std::memory_order_relaxed);
+                count++;
+            }
+            return count;
+        }
+
+        void CollectStats(ObjectPoolStats& stats) const
+        {
+            stats.size     += live_.load(std::memory_order_relaxed);
+            stats.hits     += hits_.load(std::memory_order_relaxed);
+            stats.misses   += misses_.load(std::memory_order_relaxed);
+            stats.waits    += waits_.load(std::memory_order_relaxed);
+            stats.timeouts += timeouts_.load(std::memory_order_relaxed);
+            stats.failures += failures_.load(std::memory_order_relaxed);
+        }
+
+        bool Debug() const
+        {
+            return debug_;
+        }
+
+        void AddHits(uint64_t hits)
+        {
+            hits_.fetch_add(hits, std::memory_order_relaxed);
+        }
+
+        void AddFailure()
+        {
+            failures_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        static Node* NodeOf(T* p)
+        {
+            return reinterpret_cast<Node*>(p);
+        }
+
+    private:
+        // 销毁对象，空出的节点留给下次新建
+        void Discard(Node* node)
+        {
+            reinterpret_cast<T*>(&node->obj)->~T();
+            if (debug_) {
+                std::memset(&node->obj, 0xDD, sizeof(node->obj));
+            }
+            UTIL_POOL_POISON(&node->obj, sizeof(node->obj));
+            Push(vacant_, node, node);
+            live_.fetch_sub(1, std::memory_order_relaxed);
+            Notify();   // 等待的线程可以新建对象了
+        }
+
+        void Notify()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (waiters_.load(std::memory_order_relaxed) > 0) {
+                std::lock_guard<std::mutex> locker(mtx_);
+                cond_.notify_one();
+            }
+        }
+
+        static Clock::rep Now()
+        {
+            return Clock::now().time_since_epoch().count();
+        }
+
+        // 将first->...->last链表压栈，链表中的节点已经通过next连接
+        void Push(Stack& head, Node* first, Node* last)
+        {
+            uint64_t old_head = head.load(std::memory_order_relaxed);
+            uint64_t new_head = 0;
+            do {
+                last->next.store(uint32_t(old_head), std::memory_order_relaxed);
+                new_head = (((old_head >> 32) + 1) << 32) | (first->index + 1);
+            } while (!head.compare_exchange_weak(old_head, new_head,
+                std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        // 弹出一个节点，栈为空返回nullptr
+        // 节点内存在Core析构前不会释放，读取过期节点的next是安全的，版本号保证CAS失败
+        Node* Pop(Stack& head)
+        {
+            uint64_t old_head = head.load(std::memory_order_acquire);
+            while (uint32_t(old_head) != 0) {
+                Node* node = NodeAt(uint32_t(old_head) - 1);
+                uint32_t next = node->next.load(std::memory_order_relaxed);
+                uint64_t new_head = (((old_head >> 32) + 1) << 32) | next;
+                if (head.compare_exchange_weak(old_head, new_head,
+                    std::memory_order_acquire, std::memory_order_acquire)) {
+                    return node;
+                }
+            }
+            return nullptr;
+        }
+
+        // 根据索引找到节点，第k块内存的起始索引为 kFirstChunk * (2^k - 1)
+        Node* NodeAt(uint32_t index) const
+        {
+            uint32_t k = ChunkOf(index);
+            uint32_t offset = index - kFirstChunk * ((1u << k) - 1);
+            return chunks_[k].load(std::memory_order_acquire) + offset;
+        }
+
+        static uint32_t ChunkOf(uint32_t index)
+        {
+            return 31 - __builtin_clz(index / kFirstChunk + 1);
+        }
+
+        // 分配一个新节点，所在的内存块不存在时创建
+        Node* NewNode()
+        {
+            uint32_t index = size_.fetch_add(1, std::memory_order_relaxed);
+            uint32_t k = ChunkOf(index);
+            if (k >= kMaxChunks) {
+                throw std::length_error("object pool is too large");
+            }
+
+            Node* chunk = chunks_[k].load(std::memory_order_acquire);
+            if (chunk == nullptr) {
+                Node* fresh = new Node[kFirstChunk << k];
+                if (chunks_[k].compare_exchange_strong(chunk, fresh,
+                    std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    chunk = fresh;
+                } else {
+                    delete[] fresh;     // 其他线程已经创建
+                }
+            }
+
+            Node* node = chunk + (index - kFirstChunk * ((1u << k) - 1));
+            node->index = index;
+            node->generation = 0;
+            return node;
+        }
+
+    private:
+        const size_t min_size_;
+        const size_t max_size_;
+        const std::function<void(void*)> factory_;     // 在给定内存上构造对象
+        const std::function<void(T&)> reset_;           // 归还时重置对象
+        const std::function<bool(const T&)> validate_;  // 归还时检查对象，返回false则销毁
+        const bool debug_;
+
+        std::atomic<uint32_t> size_;        // 已分配的节点数
+        Stack                 free_;        // 空闲对象
+        Stack                 vacant_;      // 空位
+        std::atomic<Node*>    chunks_[kMaxChunks];
+
+        std::atomic<size_t>     live_;      // 已构造的对象数
+        std::atomic<int>        waiters_;   // 正在等待的线程数
+        std::atomic<Clock::rep> pressure_;  // 最近一次池为空的时间
+        std::mutex              mtx_;
+        std::condition_variable cond_;
+
+        std::atomic<uint64_t> hits_;
+        std::atomic<uint64_t> misses_;
+        std::atomic<uint64_t> waits_;
+        std::atomic<uint64_t> timeouts_;
+        std::atomic<uint64_t> failures_;
+    };
+
+    using CorePtr = std::shared_ptr<Core>;
+
+    // 线程本地缓存。缓存持有Core的引用，缓存被替换或线程退出时把对象还给Core
+    struct LocalCache
+    {
+        struct Slot
+        {
+            Slot() : count(0), hits(0) {}
+
+            CorePtr  core;
+            uint32_t count;
+            uint64_t hits;  // 本地命中数，归还时汇总到Core
+            Node*    nodes[kLocalMax];
+        };
+
+        LocalCache() : victim(0) {}
+
+        ~LocalCache()
+        {
+            for (auto& slot : slots) {
+                Release(slot);
+            }
+        }
+
+        Slot* Find(const Core* core)
+        {
+            for (auto& slot : slots) {
+                if (slot.core.get() == core) {
+                    return &slot;
+                }
+            }
+            return nullptr;
+        }
+
+        // 查找Core对应的缓存，没有则占用一个空位，没有空位则替换一个
+        Slot* Acquire(const CorePtr& core)
+        {
+            Slot* slot = Find(core.get());
+            if (slot != nullptr) {
+                return slot;
+            }
+
+            slot = Find(nullptr);
+            if (slot == nullptr) {
+                slot = &slots[victim++ % kCacheSlots];
+                Release(*slot);
+            }
+            slot->core = core;
+            return slot;
+        }
+
+        // 将缓存中下标[keep, count)的对象一次性还给Core
+        static void Flush(Slot& slot, uint32_t keep)
+        {
+            slot.core->AddHits(slot.hits);
+            slot.hits = 0;
+            if (slot.count <= keep) {
+                return;
+            }
+
+            for (uint32_t i = keep; i + 1 < slot.count; i++) {
+                slot.nodes[i]->next.store(slot.nodes[i + 1]->index + 1, std::memory_order_relaxed);
+            }
+            slot.core->Give(slot.nodes[keep], slot.nodes[slot.count - 1]);
+            slot.count = keep;
+        }
+
+        static void Release(Slot& slot)
+        {
+            if (slot.core) {
+                Flush(slot, 0);
+                slot.core.reset();
+            }
+        }
+
+        Slot     slots[kCacheSlots];
+        uint32_t victim;
+    };
+
 public:
-    ObjectPool() : clear_flag_(false) {};
+    // 不限制最大容量
+    static const size_t kUnlimited = SIZE_MAX;
 
-    virtual ~ObjectPool()
+    // 对象句柄，独占对象，析构时把对象还给对象池
+    // 与带删除器的shared_ptr相比，不需要额外分配控制块；句柄不能比对象池活得更久，
+    // 需要共享所有权或在对象池销毁后释放时，使用Share()转换为shared_ptr
+    class Ptr
     {
-        clear_flag_ = true;
-        object_map_.clear();
+    public:
+        Ptr() : node_(nullptr), core_(nullptr), generation_(0) {}
+        Ptr(std::nullptr_t) : Ptr() {}
+
+        Ptr(Ptr&& other) : node_(other.node_), core_(other.core_), generation_(other.generation_)
+        {
+            other.node_ = nullptr;
+            other.core_ = nullptr;
+        }
+
+        Ptr& operator=(Ptr&& other)
+        {
+            if (this != &other) {
+                Reset();
+                node_ = other.node_;
+                core_ = other.core_;
+                generation_ = other.generation_;
+                other.node_ = nullptr;
+                other.core_ = nullptr;
+            }
+            return *this;
+        }
+
+        ~Ptr()
+        {
+            Reset();
+        }
+
+        T* Get() const
+        {
+            return node_ != nullptr ? reinterpret_cast<T*>(&node_->obj) : nullptr;
+        }
+
+        T& operator*() const
+        {
+            return *Get();
+        }
+
+        T* operator->() const
+        {
+            return Get();
+        }
+
+        explicit operator bool() const
+        {
+            return node_ != nullptr;
+        }
+
+        bool operator==(std::nullptr_t) const
+        {
+            return node_ == nullptr;
+        }
+
+        bool operator!=(std::nullptr_t) const
+        {
+            return node_ != nullptr;
+        }
+
+        // 对象是否仍归当前句柄所有（对象归还后代数会变化）
+        bool Valid() const
+        {
+            return node_ != nullptr && node_->generation == generation_;
+        }
+
+        // 提前归还对象
+        void Reset()
+        {
+            if (node_ != nullptr) {
+                Node* node = node_;
+                node_ = nullptr;
+                ObjectPool::Put(core_, node, generation_);
+            }
+        }
+
+        // 转换为shared_ptr，删除器持有Core的引用，对象池销毁后释放也是安全的
+        std::shared_ptr<T> Share()
+        {
+            if (node_ == nullptr) {
+                return nullptr;
+            }
+
+            CorePtr holder = core_->shared_from_this();
+            Node* node = node_;
+            uint32_t generation = generation_;
+            node_ = nullptr;
+            return std::shared_ptr<T>(reinterpret_cast<T*>(&node->obj), [holder, generation](T* p) {
+                ObjectPool::Put(holder.get(), Core::NodeOf(p), generation);
+            }, SmallAllocator<T>());
+        }
+
+    private:
+        friend class ObjectPool;
+
+        Ptr(Node* node, Core* core) : node_(node), core_(core), generation_(node->generation) {}
+
+        // 禁止复制和赋值
+        Ptr(const Ptr&) = delete;
+        Ptr& operator=(const Ptr&) = delete;
+
+    private:
+        Node*    node_;
+        Core*    core_;
+        uint32_t generation_;
     };
 
-    // 初始化。num 默认创建多少个对象
+    // min_size: 收缩时保留的最小对象数；max_size: 每种构造签名的最大对象数
+    // idle_timeout: 池持续不为空超过此时间后，Shrink才会销毁多余的对象
+    explicit ObjectPool(size_t min_size = 0, size_t max_size = kUnlimited,
+        std::chrono::milliseconds idle_timeout = std::chrono::seconds(60))
+        : min_size_(min_size), max_size_(max_size), idle_timeout_(idle_timeout), debug_(false)
+    {
+        if (min_size_ > max_size_ || max_size_ == 0) {
+            throw std::invalid_argument("object pool size out of range");
+        }
+    }
+
+    virtual ~ObjectPool()
+    {
+        // 当前线程缓存的对象立即归还；其他线程缓存的对象在其缓存被替换或线程退出时归还
+        // Core在最后一个引用释放后析构
+        for (auto& core : cores_) {
+            if (core) {
+                auto slot = cache_.Find(core.get());
+                if (slot != nullptr) {
+                    LocalCache::Release(*slot);
+                }
+            }
+        }
+    }
+
+    // 对象归还时调用，重置对象状态（如清空缓冲区），不能抛出异常
+    // 钩子和调试模式只对之后首次Init的构造签名生效，需要在Init之前设置
+    void SetReset(const std::function<void(T&)>& reset)
+    {
+        reset_ = reset;
+    }
+
+    // 对象归还时调用，返回false表示对象已损坏，直接销毁而不放回池中，不能抛出异常
+    void SetValidate(const std::function<bool(const T&)>& validate)
+    {
+        validate_ = validate;
+    }
+
+    // 调试模式：归还的对象立即销毁并填充0xDD（ASan下标记为不可访问），重复归还抛出异常
+    void SetDebug(bool debug)
+    {
+        debug_ = debug;
+    }
+
+    // 初始化。num 预先创建多少个对象（至少创建min_size个）
+    // 首次初始化某个构造签名时记录构造参数，池为空时用这些参数新建对象
     template<typename... Args>
     void Init(size_t num, Args&&... args)
     {
-        if (num <= 0 || num > g_object_max) {
+        if (num > max_size_) {
             throw std::logic_error("object num out of range");
         }
 
-        std::string consturct_name = typeid(Constructor<Args...>).name();  // 不区分应用
-        std::cout << "Init consturct_name = " << consturct_name << std::endl;
-        for (size_t i = 0; i < num; i++) {
-            object_map_.emplace(consturct_name, std::shared_ptr<T>(new T(std::forward<Args>(args)...), 
-                [this, consturct_name](T* p) {
-                    // 删除器中不直接删除对象，而是回收到对象池中，以供下次使用
-                    if (!clear_flag_) {     // 析构时不需要将对象回收
-                        std::cout << "reset object pool" << std::endl;
-                        object_map_.emplace(std::move(consturct_name), std::shared_ptr<T>(p));
-                    }
-                }));
+        Core* core = GetCore<Args...>(true, args...);   // 不区分应用
+        if (core->Debug()) {
+            return;     // 调试模式下对象用时再构造
+        }
+        for (size_t i = (num > min_size_ ? num : min_size_); i > 0; i--) {
+            Node* node = core->Grow();
+            if (node == nullptr) {
+                break;  // 已达到最大容量
+            }
+            core->Give(node, node);
+        }
+    }
+
+    // 从对象池中获取一个元素，池为空且达到最大容量时返回空句柄，不等待
+    // 句柄析构时，对象回收到对象池中，以供下次使用
+    template<typename... Args>
+    Ptr Get()
+    {
+        Core* core = CoreAt(PoolTypeIndex<T>::template Find<Constructor<Args...>>());
+        if (core == nullptr) {
+            return nullptr;
+        }
+
+        Node* node = nullptr;
+        auto slot = cache_.Find(core);
+        if (slot != nullptr && slot->count > 0) {
+            node = slot->nodes[--slot->count];
+            slot->hits++;
+        } else {
+            node = core->Take();
         }
+
+        if (node == nullptr) {
+            core->AddFailure();
+            return nullptr;
+        }
+        return Ptr(node, core);
     }
 
-    // 从对象池中获取一个元素
+    // 从对象池中获取一个元素，池为空且达到最大容量时等待其他线程归还，超时返回空句柄
     template<typename... Args>
-    std::shared_ptr<T> Get()
+    Ptr AcquireFor(std::chrono::milliseconds timeout)
     {
-        std::string consturct_name = typeid(Constructor<Args...>).name();
-        std::cout << "Get consturct_name = " << consturct_name << std::endl;
+        Core* core = CoreAt(PoolTypeIndex<T>::template Find<Constructor<Args...>>());
+        if (core == nullptr) {
+            return nullptr;
+        }
 
-        auto range = object_map_.equal_range(consturct_name);
-        for (auto it = range.first; it != range.second; ++it) {
-            auto ptr = it->second;
-            object_map_.erase(it);  // 获取到后从pool中删除
-            return ptr;
+        Node* node = nullptr;
+        auto slot = cache_.Find(core);
+        if (slot != nullptr && slot->count > 0) {
+            node = slot->nodes[--slot->count];
+            slot->hits++;
+        } else {
+            node = core->Take();
+            if (node == nullptr) {
+                node = core->Wait(timeout);
+            }
+        }
+
+        if (node == nullptr) {
+            core->AddFailure();
+            return nullptr;
+        }
+        return Ptr(node, core);
+    }
+
+    // 收缩对象池：空闲超时的Core销毁多余的空闲对象，返回销毁的对象数
+    // 需要定期调用（例如由定时器），当前线程缓存的对象会先归还
+    size_t Shrink()
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < kMaxSignatures; i++) {
+            Core* core = CoreAt(i);
+            if (core != nullptr) {
+                auto slot = cache_.Find(core);
+                if (slot != nullptr) {
+                    LocalCache::Flush(*slot, 0);
+                }
+                count += core->Shrink(idle_timeout_);
+            }
+        }
+        return count;
+    }
+
+    // 统计信息，其他线程缓存中的命中数在缓存归还时才会汇总
+    ObjectPoolStats Stats()
+    {
+        ObjectPoolStats stats;
+        for (size_t i = 0; i < kMaxSignatures; i++) {
+            Core* core = CoreAt(i);
+            if (core != nullptr) {
+                core->CollectStats(stats);
+                auto slot = cache_.Find(core);
+                if (slot != nullptr) {
+                    stats.hits += slot->hits;
+                }
+            }
         }
-        return nullptr;
+        return stats;
     }
 
 private:
@@ -81,12 +810,88 @@ private:
     ObjectPool(const ObjectPool&) = delete;
     ObjectPool& operator=(const ObjectPool&) = delete;
 
+    Core* CoreAt(size_t index)
+    {
+        if (index >= kMaxSignatures) {
+            return nullptr;
+        }
+        return core_ptrs_[index].load(std::memory_order_acquire);
+    }
+
+    // 根据构造签名获取Core，不存在则创建，并以args作为新建对象的构造参数
+    template<typename... Args, typename... Params>
+    Core* GetCore(bool create, Params&... params)
+    {
+        size_t index = create ? PoolTypeIndex<T>::template Alloc<Constructor<Args...>>()
+            : PoolTypeIndex<T>::template Find<Constructor<Args...>>();
+        if (index >= kMaxSignatures) {
+            if (!create) {
+                return nullptr;
+            }
+            throw std::logic_error("too many object constructors");
+        }
+
+        Core* core = CoreAt(index);
+        if (core == nullptr && create) {
+            std::lock_guard<std::mutex> locker(init_mtx_);
+            if (!cores_[index]) {
+                // 按值保存构造参数
+                std::function<void(void*)> factory = [params...](void* mem) mutable {
+                    new (mem) T(params...);
+                };
+                cores_[index] = std::make_shared<Core>(min_size_, max_size_, std::move(factory),
+                    reset_, validate_, debug_);
+                core_ptrs_[index].store(cores_[index].get(), std::memory_order_release);
+            }
+            core = cores_[index].get();
+        }
+        return core;
+    }
+
+    // 回收对象：先执行钩子，再优先放入线程本地缓存，缓存满时将一半对象还给Core
+    static void Put(Core* core, Node* node, uint32_t generation)
+    {
+        if (!core->Recycle(node, generation)) {
+            return;
+        }
+
+        if (!core->Cached()) {
+            core->Give(node, node);
+            return;
+        }
+
+        auto slot = cache_.Find(core);
+        if (slot == nullptr) {
+            slot = cache_.Acquire(core->shared_from_this());
+        }
+        if (slot->count == kLocalMax) {
+            LocalCache::Flush(*slot, kLocalMax / 2);
+        }
+        slot->nodes[slot->count++] = node;
+    }
+
 private:
-    bool clear_flag_;
-    // 多索引容器，存储对象
-    std::multimap<std::string, std::shared_ptr<T>> object_map_;
+    const size_t min_size_;
+    const size_t max_size_;
+    const std::chrono::milliseconds idle_timeout_;
+
+    std::function<void(T&)>        reset_;
+    std::function<bool(const T&)>  validate_;
+    bool                           debug_;
+
+    std::mutex         init_mtx_;
+    CorePtr            cores_[kMaxSignatures];      // 只在Init中创建，之后不再改变
+    std::atomic<Core*> core_ptrs_[kMaxSignatures] = {};
+
+    static thread_local LocalCache cache_;
 };
 
+template<typename T>
+const size_t ObjectPool<T>::kUnlimited;
+
+template<typename T>
+thread_local typename ObjectPool<T>::LocalCache ObjectPool<T>::cache_;
+
 } // namespace util
 
 #endif // UTIL_OBJECT_POOL_H_
@@ -17,27 +17,61 @@
 
 namespace util {
 
-template<typename T>
-class Optional
+// Optional的存储：数据在前，1字节的初始化标志在后，没有虚函数表指针
+// T可以平凡析构时，存储也可以平凡析构（不声明析构函数）
+template<typename T, bool TrivialDestroy = std::is_trivially_destructible<T>::value>
+struct OptionalStorage
 {
     // 定义内存对齐的缓冲区类型
     using data_t = typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type;
 
+    OptionalStorage() : has_init_(false) {}
+
+    data_t data_;
+    bool   has_init_;
+};
+
+template<typename T>
+struct OptionalStorage<T, false>
+{
+    using data_t = typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type;
+
+    OptionalStorage() : has_init_(false) {}
+
+    ~OptionalStorage()
+    {
+        if (has_init_) {
+            ((T*)(&data_))->~T();   // 使用 placement new 创建对象，需要手动调用析构
+        }
+    }
+
+    data_t data_;
+    bool   has_init_;
+};
+
+template<typename T>
+class Optional : private OptionalStorage<T>
+{
+    using Base = OptionalStorage<T>;
+    using data_t = typename Base::data_t;
+    using Base::data_;
+    using Base::has_init_;
+
 public:
-    Optional() : has_init_(false) {}
+    Optional() {}
 
-    Optional(const T& v) : has_init_(false)
+    Optional(const T& v)
     {
         Create(v);  // 创建对象
     }
 
     // 右值构造函数
-    Optional(T&& v) : has_init_(false)
+    Optional(T&& v)
     {
         Create(std::move(v));
     }
 
-    Optional(const Optional& other) : has_init_(false)
+    Optional(const Optional& other)
     {
         if (other.IsInit()) {
             Assign(other);
@@ -45,7 +79,7 @@ public:
     }
 
     // 右值拷贝构造函数
-    Optional(Optional&& other) : has_init_(false)
+    Optional(Optional&& other)
     {
         if (other.IsInit()) {
             Assign(std::move(other));
@@ -55,21 +89,20 @@ public:
 
     Optional& operator=(const Optional& other)
     {
-        Assign(other);
+        if (this != &other) {
+            Assign(other);
+        }
         return *this;
     }
 
     Optional& operator=(Optional&& other)
     {
-        Assign(std::move(other));
+        if (this != &other) {
+            Assign(std::move(other));
+        }
         return *this;
     }
 
-    virtual ~Optional()
-    {
-        Destroy();
-    }
-
     // 根据参数创建对象
     template<typename... Args>
     void Emplace(Args&&... args)
@@ -196,10 +229,6 @@ private:
         Destroy();
         new (&data_) T(std::move(*((T*)(&val))));
     }
-
-private:
-    bool   has_init_;
-    data_t data_;
 };
 
 } // namespace util
@@ -13,39 +13,49 @@
 #define UTIL_SINGLETON_H_
 
 #include <stdexcept>
+#include <atomic>
+#include <mutex>
+#include <utility>
 
 namespace util {
 
+// 线程安全的单例，多个线程同时调用Instance只会构造一次
+// 创建后的读取只是一次acquire读，不加锁；Destroy不能与其他线程对单例的使用并发
 template<typename T>
 class Singleton
 {
 public:
-    // 初始化单例对象
+    // 初始化单例对象，已创建时直接返回，参数被忽略
     template<typename... Args>
     static T* Instance(Args&&... args)
     {
-        if (instance_ == nullptr) {
-            instance_ = new T(std::forward<Args>(args)...);
+        T* instance = instance_.load(std::memory_order_acquire);
+        if (instance == nullptr) {
+            std::lock_guard<std::mutex> locker(mtx_);
+            instance = instance_.load(std::memory_order_relaxed);
+            if (instance == nullptr) {
+                instance = new T(std::forward<Args>(args)...);
+                instance_.store(instance, std::memory_order_release);
+            }
         }
-        return instance_;
+        return instance;
     }
 
     // 获取单例
     static T* GetInstance()
     {
-        if (instance_ == nullptr) {
+        T* instance = instance_.load(std::memory_order_acquire);
+        if (instance == nullptr) {
             throw std::logic_error("the Instance is not init, please initialize the instance first");
         }
-        return instance_;
+        return instance;
     }
 
     // 销毁单例
     static void Destroy()
     {
-        if (instance_ != nullptr) {
-            delete instance_;
-            instance_ = nullptr;
-        }
+        std::lock_guard<std::mutex> locker(mtx_);
+        delete instance_.exchange(nullptr, std::memory_order_acq_rel);
     }
 
 private:
@@ -57,11 +67,15 @@ private:
     Singleton& operator=(const Singleton&) = delete;
 
 private:
-    static T* instance_;
+    static std::atomic<T*> instance_;
+    static std::mutex      mtx_;        // 只在创建和销毁时使用
 };
 
 template<typename T>
-T* Singleton<T>::instance_ = nullptr;
+std::atomic<T*> Singleton<T>::instance_{nullptr};
+
+template<typename T>
+std::mutex Singleton<T>::mtx_;
 
 } // namespace util
 
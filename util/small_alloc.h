@@ -0,0 +1,311 @@
+/**
+ * desc: 小对象分配器，按大小分级，每个线程独立缓存
+ * file: small_alloc.h
+ *
+ * author:  myw31415926
+ * date:    20190415
+ * version: V0.1
+ *
+ * the closer you look, the less you see
+ */
+
+#ifndef UTIL_SMALL_ALLOC_H_
+#define UTIL_SMALL_ALLOC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <type_traits>
+#include <mutex>
+#include <memory>
+#include <utility>
+
+namespace util {
+
+// 小对象分配器，用于容器节点、shared_ptr控制块、回调函数等频繁申请释放的小块内存
+// 不超过kMaxSize字节的请求按16字节分级，每个线程有独立的堆（Heap），分配和本线程释放无需加锁；
+// 其他线程释放的内存通过无锁的远程释放链表（remote）还给所属的堆，由所属线程在本地链表为空时一次性取回
+// 内存以span（kSpanSize字节，按kSpanSize对齐）为单位申请，span头部记录所属的堆和级别，释放时通过地址找到span
+// 线程退出时堆被放入废弃链表，由新线程接管，span不会归还给系统
+class SmallAlloc
+{
+public:
+    enum {
+        kGranularity = 16,                      // 级别间隔，也是块的对齐
+        kMaxSize     = 256,                     // 超过该大小直接使用operator new
+        kClassNum    = kMaxSize / kGranularity,
+        kSpanSize    = 64 * 1024,
+        kHeaderSize  = 64,                      // span头部大小
+    };
+
+    // 分配size字节，按16字节对齐
+    static void* Allocate(size_t size)
+    {
+        if (size > kMaxSize) {
+            return ::operator new(size);
+        }
+
+        size_t cls = (size != 0 ? size - 1 : 0) / kGranularity;
+        Heap* heap = LocalHeap();
+        if (heap == nullptr) {
+            return SharedAllocate(cls);
+        }
+        return heap->Allocate(cls);
+    }
+
+    // 释放内存，size必须与分配时一致
+    static void Deallocate(void* p, size_t size)
+    {
+        if (p == nullptr) {
+            return;
+        }
+        if (size > kMaxSize) {
+            ::operator delete(p);
+            return;
+        }
+
+        Span* span = SpanOf(p);
+        FreeBlock* block = static_cast<FreeBlock*>(p);
+        if (span->heap == TlsHeap()) {
+            // 本线程的内存，直接放回本地链表
+            Bin& bin = span->heap->bins[span->size_class];
+            block->next = bin.local;
+            bin.local = block;
+        } else {
+            // 其他线程的内存，放入所属堆的远程释放链表。只有push和整体exchange，不存在ABA问题
+            std::atomic<FreeBlock*>& remote = span->heap->bins[span->size_class].remote;
+            block->next = remote.load(std::memory_order_relaxed);
+            while (!remote.compare_exchange_weak(block->next, block,
+                std::memory_order_release, std::memory_order_relaxed)) {}
+        }
+    }
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    // 每个级别的空闲内存，独占一个cache line，避免远程释放时的伪共享
+    struct alignas(64) Bin
+    {
+        FreeBlock* local;                   // 本线程的空闲链表
+        char*      bump;                    // 当前span中未切分的内存
+        char*      end;
+        std::atomic<FreeBlock*> remote;     // 其他线程释放的内存
+    };
+
+    struct Heap
+    {
+        Heap() : next(nullptr)
+        {
+            for (auto& bin : bins) {
+                bin.local = nullptr;
+                bin.bump = bin.end = nullptr;
+                bin.remote.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        void* Allocate(size_t cls)
+        {
+            Bin& bin = bins[cls];
+            FreeBlock* block = bin.local;
+            if (block != nullptr) {
+                bin.local = block->next;
+                return block;
+            }
+            return AllocateSlow(cls);
+        }
+
+        // 本地链表为空：先取回远程释放的内存，再从span中切分，最后申请新的span
+        void* AllocateSlow(size_t cls)
+        {
+            Bin& bin = bins[cls];
+            FreeBlock* block = bin.remote.exchange(nullptr, std::memory_order_acquire);
+            if (block != nullptr) {
+                bin.local = block->next;
+                return block;
+            }
+
+            size_t block_size = (cls + 1) * kGranularity;
+            if (bin.bump + block_size > bin.end) {
+                void* mem = nullptr;
+                if (posix_memalign(&mem, kSpanSize, kSpanSize) != 0) {
+                    throw std::bad_alloc();
+                }
+                Span* span = static_cast<Span*>(mem);
+                span->heap = this;
+                span->size_class = static_cast<uint32_t>(cls);
+                bin.bump = static_cast<char*>(mem) + kHeaderSize;
+                bin.end = static_cast<char*>(mem) + kSpanSize;
+            }
+
+            void* p = bin.bump;
+            bin.bump += block_size;
+            return p;
+        }
+
+        Bin   bins[kClassNum];
+        Heap* next;             // 废弃链表
+    };
+
+    // span头部
+    struct Span
+    {
+        Heap*    heap;
+        uint32_t size_class;
+    };
+
+    // 全局状态：废弃的堆，以及线程退出后仍需分配内存时使用的共享堆
+    struct Global
+    {
+        Global() : abandoned(nullptr) {}
+
+        std::mutex mtx;
+        Heap*      abandoned;
+        Heap       shared;
+    };
+
+    // 线程退出时将堆放入废弃链表
+    struct HeapGuard
+    {
+        ~HeapGuard()
+        {
+            Heap* heap = TlsHeap();
+            TlsHeap() = nullptr;
+            TlsDead() = true;
+
+            Global& global = GetGlobal();
+            std::lock_guard<std::mutex> locker(global.mtx);
+            heap->next = global.abandoned;
+            global.abandoned = heap;
+        }
+    };
+
+    static Span* SpanOf(void* p)
+    {
+        return reinterpret_cast<Span*>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(kSpanSize - 1));
+    }
+
+    // 进程内不析构，保证其他静态对象析构时仍然可以释放内存
+    static Global& GetGlobal()
+    {
+        static Global* global = new (Aligned(sizeof(Global))) Global();
+        return *global;
+    }
+
+    static Heap*& TlsHeap()
+    {
+        static thread_local Heap* heap = nullptr;
+        return heap;
+    }
+
+    static bool& TlsDead()
+    {
+        static thread_local bool dead = false;
+        return dead;
+    }
+
+    static Heap* LocalHeap()
+    {
+        Heap* heap = TlsHeap();
+        if (heap != nullptr || TlsDead()) {
+            return heap;
+        }
+        return AttachHeap();
+    }
+
+    // 线程第一次分配：接管废弃的堆或者创建新堆，注册线程退出时的回收
+    static Heap* AttachHeap()
+    {
+        Heap* heap = nullptr;
+        {
+            Global& global = GetGlobal();
+            std::lock_guard<std::mutex> locker(global.mtx);
+            heap = global.abandoned;
+            if (heap != nullptr) {
+                global.abandoned = heap->next;
+                heap->next = nullptr;
+            }
+        }
+        if (heap == nullptr) {
+            heap = new (Aligned(sizeof(Heap))) Heap();
+        }
+
+        TlsHeap() = heap;
+        static thread_local HeapGuard guard;
+        (void)guard;
+        return heap;
+    }
+
+    // 线程局部对象析构后的分配，使用加锁的共享堆
+    static void* SharedAllocate(size_t cls)
+    {
+        Global& global = GetGlobal();
+        std::lock_guard<std::mutex> locker(global.mtx);
+        return global.shared.Allocate(cls);
+    }
+
+    static void* Aligned(size_t size)
+    {
+        void* mem = nullptr;
+        if (posix_memalign(&mem, 64, size) != 0) {
+            throw std::bad_alloc();
+        }
+        return mem;
+    }
+};
+
+
+// STL分配器适配，无状态，所有实例相等。分配的内存只按16字节对齐
+template<typename T>
+class SmallAllocator
+{
+    static_assert(std::alignment_of<T>::value <= SmallAlloc::kGranularity,
+        "SmallAllocator only guarantees 16-byte alignment");
+
+public:
+    using value_type = T;
+
+    SmallAllocator() = default;
+
+    template<typename U>
+    SmallAllocator(const SmallAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(SmallAlloc::Allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        SmallAlloc::Deallocate(p, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const SmallAllocator<U>&) const
+    {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(const SmallAllocator<U>&) const
+    {
+        return false;
+    }
+};
+
+// 对象和控制块一起从小对象分配器中分配
+template<typename T, typename... Args>
+std::shared_ptr<T> MakeSmallShared(Args&&... args)
+{
+    static_assert(std::alignment_of<T>::value <= SmallAlloc::kGranularity,
+        "MakeSmallShared only guarantees 16-byte alignment");
+    return std::allocate_shared<T>(SmallAllocator<T>(), std::forward<Args>(args)...);
+}
+
+} // namespace util
+
+#endif // UTIL_SMALL_ALLOC_H_
@@ -0,0 +1,141 @@
+/**
+ * desc: 类型擦除的小对象缓冲区，Any和线程池任务共用
+ * file: small_buffer.h
+ *
+ * author:  myw31415926
+ * date:    20190415
+ * version: V0.1
+ *
+ * the closer you look, the less you see
+ */
+
+#ifndef UTIL_SMALL_BUFFER_H_
+#define UTIL_SMALL_BUFFER_H_
+
+#include "small_alloc.h"
+
+#include <cstddef>
+#include <new>          // placement new
+#include <type_traits>
+#include <utility>
+
+namespace util {
+
+// 类型擦除容器的存储：小对象（不超过kSmallSize字节且移动构造不抛异常）直接存放在内部缓冲区，
+// 大对象从小对象分配器中分配（对齐超过16字节时使用operator new），缓冲区只保存指针
+// 使用者按需组合Handler<T>中的函数生成自己的函数表，未使用的函数（如不可复制类型的Copy）不会被实例化
+struct SmallBuffer
+{
+    // 内部缓冲区大小，可以容纳std::function（libstdc++中为32字节）
+    static const size_t kSmallSize  = 4 * sizeof(void*);
+    static const size_t kSmallAlign = std::alignment_of<void*>::value;
+
+    union Storage
+    {
+        void* ptr;
+        typename std::aligned_storage<kSmallSize, kSmallAlign>::type buf;
+    };
+
+    // 小对象：移动构造不抛异常，才能保证容器的移动不抛异常
+    template<typename T>
+    struct IsSmall : std::integral_constant<bool,
+        sizeof(T) <= kSmallSize && std::alignment_of<T>::value <= kSmallAlign &&
+        std::is_nothrow_move_constructible<T>::value> {};
+
+    template<typename T, bool Small = IsSmall<T>::value>
+    struct Handler;
+};
+
+// 小对象，直接在buf上构造
+template<typename T>
+struct SmallBuffer::Handler<T, true>
+{
+    template<typename U>
+    static void Create(Storage& s, U&& value)
+    {
+        new (&s.buf) T(std::forward<U>(value));
+    }
+
+    static T* Get(Storage& s)
+    {
+        return reinterpret_cast<T*>(&s.buf);
+    }
+
+    static void Destroy(Storage& s)
+    {
+        Get(s)->~T();
+    }
+
+    static void Copy(const Storage& src, Storage& dst)
+    {
+        new (&dst.buf) T(*reinterpret_cast<const T*>(&src.buf));
+    }
+
+    static void Move(Storage& src, Storage& dst)
+    {
+        T* p = Get(src);
+        new (&dst.buf) T(std::move(*p));
+        p->~T();
+    }
+};
+
+// 大对象，在堆上构造，移动时只需要移交指针
+template<typename T>
+struct SmallBuffer::Handler<T, false>
+{
+    template<typename U>
+    static void Create(Storage& s, U&& value)
+    {
+        void* mem = Allocate();
+        try {
+            s.ptr = new (mem) T(std::forward<U>(value));
+        } catch (...) {
+            Deallocate(mem);
+            throw;
+        }
+    }
+
+    static T* Get(Storage& s)
+    {
+        return static_cast<T*>(s.ptr);
+    }
+
+    static void Destroy(Storage& s)
+    {
+        Get(s)->~T();
+        Deallocate(s.ptr);
+    }
+
+    static void Copy(const Storage& src, Storage& dst)
+    {
+        Create(dst, *static_cast<const T*>(src.ptr));
+    }
+
+    static void Move(Storage& src, Storage& dst)
+    {
+        dst.ptr = src.ptr;
+        src.ptr = nullptr;
+    }
+
+private:
+    // 小对象分配器只保证16字节对齐
+    static const bool kUseSmallAlloc = std::alignment_of<T>::value <= SmallAlloc::kGranularity;
+
+    static void* Allocate()
+    {
+        return kUseSmallAlloc ? SmallAlloc::Allocate(sizeof(T)) : ::operator new(sizeof(T));
+    }
+
+    static void Deallocate(void* p)
+    {
+        if (kUseSmallAlloc) {
+            SmallAlloc::Deallocate(p, sizeof(T));
+        } else {
+            ::operator delete(p);
+        }
+    }
+};
+
+} // namespace util
+
+#endif // UTIL_SMALL_BUFFER_H_
@@ -12,6 +12,8 @@
 #ifndef UTIL_SYNC_QUEUE_H_
 #define UTIL_SYNC_QUEUE_H_
 
+#include "small_alloc.h"
+
 #include <iostream>
 #include <list>
 #include <mutex>
@@ -24,12 +26,15 @@ template<typename T>
 class SyncQueue
 {
 public:
+    // 链表节点从小对象分配器中分配
+    using Queue = std::list<T, SmallAllocator<T>>;
+
     SyncQueue(int max_size) : max_size_(max_size), stop_flag_(false) {}
 
     void Push(const T& t) { Add(t); }
     void Push(T&& t) { Add(std::forward<T>(t)); }
 
-    void Pop(std::list<T>& queue)
+    void Pop(Queue& queue)
     {
         // wait前必须先获得 std::unique_lock<std::mutex> 
         std::unique_lock<std::mutex> locker(mtx_);
@@ -51,7 +56,7 @@ public:
         if (stop_flag_) {
             return;
         }
-        t = queue_.front();
+        t = std::move(queue_.front());
         queue_.pop_front();
         not_full_.notify_one();
     }
@@ -122,7 +127,7 @@ private:
 private:
     int  max_size_;         // 同步队列最大size
     bool stop_flag_;        // 停在标志
-    std::list<T> queue_;    // 缓冲区
+    Queue        queue_;    // 缓冲区
     std::mutex   mtx_;      // 缓冲区互斥锁
     std::condition_variable not_empty_; // 队列不空的条件
     std::condition_variable not_full_;  // 队列不满的条件
@@ -13,15 +13,116 @@
 #define UTIL_THREAD_POOL_H_
 
 #include "sync_queue.h"
+#include "small_buffer.h"
 
 #include <list>
 #include <thread>
 #include <functional>
 #include <memory>
 #include <atomic>
+#include <type_traits>
 
 namespace util {
 
+// 线程池队列中的任务，只能移动的void()可调用对象，可以保存std::packaged_task等不可复制的对象
+// 可调用对象存放在SmallBuffer中，小对象不分配堆内存，避免std::function的堆分配
+class PoolTask
+{
+public:
+    PoolTask() : vtable_(nullptr) {}
+
+    template<typename F, class = typename
+        std::enable_if<!std::is_same<typename std::decay<F>::type, PoolTask>::value>::type>
+    PoolTask(F&& f) : vtable_(&VTableFor<typename std::decay<F>::type>::value)
+    {
+        Handler<typename std::decay<F>::type>::Create(storage_, std::forward<F>(f));
+    }
+
+    PoolTask(PoolTask&& other) noexcept : vtable_(other.vtable_)
+    {
+        if (vtable_ != nullptr) {
+            vtable_->move(other.storage_, storage_);
+            other.vtable_ = nullptr;
+        }
+    }
+
+    PoolTask& operator=(PoolTask&& other) noexcept
+    {
+        if (this != &other) {
+            Reset();
+            vtable_ = other.vtable_;
+            if (vtable_ != nullptr) {
+                vtable_->move(other.storage_, storage_);
+                other.vtable_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    ~PoolTask()
+    {
+        Reset();
+    }
+
+    void operator()()
+    {
+        vtable_->invoke(storage_);
+    }
+
+    explicit operator bool() const
+    {
+        return vtable_ != nullptr;
+    }
+
+    void Reset()
+    {
+        if (vtable_ != nullptr) {
+            vtable_->destroy(storage_);
+            vtable_ = nullptr;
+        }
+    }
+
+private:
+    // 禁止复制
+    PoolTask(const PoolTask&) = delete;
+    PoolTask& operator=(const PoolTask&) = delete;
+
+    using Storage = SmallBuffer::Storage;
+
+    template<typename F>
+    using Handler = SmallBuffer::Handler<F>;
+
+    // 不包含复制，不可复制的可调用对象也可以保存
+    struct VTable
+    {
+        void (*invoke)(Storage& s);
+        void (*destroy)(Storage& s);
+        void (*move)(Storage& src, Storage& dst);   // 移动后src视为已析构
+    };
+
+    template<typename F>
+    static void Invoke(Storage& s)
+    {
+        (*Handler<F>::Get(s))();
+    }
+
+    template<typename F>
+    struct VTableFor
+    {
+        static const VTable value;
+    };
+
+private:
+    const VTable* vtable_;
+    Storage       storage_;
+};
+
+template<typename F>
+const PoolTask::VTable PoolTask::VTableFor<F>::value = {
+    &PoolTask::Invoke<F>, &PoolTask::Handler<F>::Destroy, &PoolTask::Handler<F>::Move
+};
+
+
 class ThreadPool
 {
 public:
@@ -46,8 +147,12 @@ public:
         std::call_once(onceflag_, [this] { StopThreadGroup(); });
     }
 
-    void AddTask(const Task& t) { queue_.Push(t); }
-    void AddTask(Task&& t) { queue_.Push(std::forward<Task>(t)); }
+    void AddTask(const Task& t) { queue_.Push(PoolTask(t)); }
+    void AddTask(Task&& t) { queue_.Push(PoolTask(std::move(t))); }
+
+    // 其他可调用对象直接放入队列，不经过std::function，可以是std::packaged_task等只能移动的对象
+    template<typename F>
+    void AddTask(F&& f) { queue_.Push(PoolTask(std::forward<F>(f))); }
 
     size_t TaskCount() { return queue_.Size() + tasking_num_.load(); }
 
@@ -70,7 +175,7 @@ private:
     {
         while (running_) {
             // 取任务执行
-            /* std::list<Task> tasks;   // 批量取出任务
+            /* SyncQueue<PoolTask>::Queue tasks;   // 批量取出任务
             / queue_.Pop(tasks);
 
             tasking_num_ = tasks.size();
@@ -82,10 +187,11 @@ private:
                 tasking_num_--;
             }*/
 
-            Task t;
+            PoolTask t;
             queue_.Pop(t);
 
-            if (!running_) {
+            // 队列停止时Pop不会取出任务
+            if (!running_ || !t) {
                 return;
             }
 
@@ -113,7 +219,7 @@ private:
     std::once_flag        onceflag_;
     std::atomic_bool      running_;     // 运行标志位
     std::atomic_size_t    tasking_num_; // 运行标志位
-    util::SyncQueue<Task> queue_;       // 同步队列
+    util::SyncQueue<PoolTask> queue_;   // 同步队列
     std::list<std::shared_ptr<std::thread>> threadgroup_;   // 处理任务的线程组
 };
 
@@ -12,6 +12,10 @@
 #ifndef UTIL_VARIANT_H_
 #define UTIL_VARIANT_H_
 
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
 #include <stdexcept>
 #include <typeindex>
 #include <type_traits>
@@ -29,7 +33,7 @@ struct IntegerMax<arg> : std::integral_constant<size_t, arg> {};
 
 template<size_t arg1, size_t arg2, size_t... rest>
 struct IntegerMax<arg1, arg2, rest...> : std::integral_constant<size_t,
-    arg1 >= arg2 ? IntegerMax<arg1, rest...>::value : IntegerMax<arg1, rest...>::value > {};
+    arg1 >= arg2 ? IntegerMax<arg1, rest...>::value : IntegerMax<arg2, rest...>::value > {};
 
 // 获取字节对齐的最大的align
 template<typename... Args>
@@ -86,57 +90,134 @@ template<typename T>
 struct Contains<T> : std::false_type {};
 
 
+// 所有类型是否都可以按位复制，可以则复制和移动直接memcpy，析构什么也不做
+template<typename... Types>
+struct AllTrivial;
+
+template<>
+struct AllTrivial<> : std::true_type {};
+
+template<typename First, typename... Types>
+struct AllTrivial<First, Types...> : std::integral_constant<bool,
+    std::is_trivial<First>::value && AllTrivial<Types...>::value> {};
+
+
 // 前置声明。Variant协助类，提供Destroy, Move, Copy接口
-template<typename... Args>
+// 通过类型索引查函数指针表完成分派，代价为O(1)
+template<bool Trivial, typename... Types>
 struct VariantHelper;
 
-template<typename T, typename... Args>
-struct VariantHelper<T, Args...>
+template<typename... Types>
+struct VariantHelper<false, Types...>
 {
-    inline static void Destroy(std::type_index id, void* data)
+    inline static void Destroy(uint8_t index, void* data)
     {
-        if (id == std::type_index(typeid(T))) {
-            // reinterpret_cast允许将任何指针转换为任何其他指针类型，也允许将任何整数类型转换为任何指针类型以及反向转换
-            reinterpret_cast<T*>(data)->~T();   // 先强转，再调用析构函数
-        } else {
-            VariantHelper<Args...>::Destroy(id, data);  // 递归向后执行
-        }
+        static constexpr void (*table[])(void*) = { &DestroyImpl<Types>... };
+        table[index](data);
     }
 
-    inline static void Move(std::type_index old_id, void* old_data, void* new_data)
+    inline static void Move(uint8_t index, void* old_data, void* new_data)
     {
-        if (old_id == std::type_index(typeid(T))) {
-            new (new_data)T(std::move(*reinterpret_cast<T*>(old_data))); // palcement new
-        } else {
-            VariantHelper<Args...>::Move(old_id, old_data, new_data);
-        }
+        static constexpr void (*table[])(void*, void*) = { &MoveImpl<Types>... };
+        table[index](old_data, new_data);
     }
 
-    inline static void Copy(std::type_index old_id, void* old_data, void* new_data)
+    inline static void Copy(uint8_t index, const void* old_data, void* new_data)
     {
-        if (old_id == std::type_index(typeid(T))) {
-            new (new_data)T(*reinterpret_cast<T*>(old_data));   // palcement new
-        } else {
-            VariantHelper<Args...>::Copy(old_id, old_data, new_data);
-        }
+        static constexpr void (*table[])(const void*, void*) = { &CopyImpl<Types>... };
+        table[index](old_data, new_data);
+    }
+
+private:
+    template<typename T>
+    static void DestroyImpl(void* data)
+    {
+        // reinterpret_cast允许将任何指针转换为任何其他指针类型，也允许将任何整数类型转换为任何指针类型以及反向转换
+        reinterpret_cast<T*>(data)->~T();   // 先强转，再调用析构函数
+    }
+
+    template<typename T>
+    static void MoveImpl(void* old_data, void* new_data)
+    {
+        new (new_data)T(std::move(*reinterpret_cast<T*>(old_data)));   // palcement new
+    }
+
+    template<typename T>
+    static void CopyImpl(const void* old_data, void* new_data)
+    {
+        new (new_data)T(*reinterpret_cast<const T*>(old_data));    // palcement new
     }
 };
 
-// 特化，终止条件
-template<>
-struct VariantHelper<>
+// 特化，全部为trivial类型，不需要查表
+template<typename... Types>
+struct VariantHelper<true, Types...>
+{
+    enum { DataSize = IntegerMax<sizeof(Types)...>::value };
+
+    inline static void Destroy(uint8_t, void*) {}
+
+    inline static void Move(uint8_t, void* old_data, void* new_data)
+    {
+        std::memcpy(new_data, old_data, DataSize);
+    }
+
+    inline static void Copy(uint8_t, const void* old_data, void* new_data)
+    {
+        std::memcpy(new_data, old_data, DataSize);
+    }
+};
+
+
+// 访问者辅助类，每次解出一个Variant的值并绑定到访问者上，全部解出后调用访问者
+template<typename R, typename Visitor, typename T>
+struct VariantBoundVisitor
 {
-    inline static void Destroy(std::type_index id, void* data) {}
-    inline static void Move(std::type_index old_id, void* old_data, void* new_data) {}
-    inline static void Copy(std::type_index old_id, void* old_data, void* new_data) {}
+    template<typename... Us>
+    R operator()(Us&&... us) const
+    {
+        return visitor_(value_, std::forward<Us>(us)...);
+    }
+
+    Visitor& visitor_;
+    T&       value_;
+};
+
+template<typename R>
+struct VariantVisit
+{
+    // 终止条件，全部Variant已经解出
+    template<typename Visitor>
+    static R Apply(Visitor& visitor)
+    {
+        return visitor();
+    }
+
+    template<typename Visitor, typename First, typename... Rest>
+    static R Apply(Visitor& visitor, First& first, Rest&... rest)
+    {
+        return first.template Dispatch<R>(visitor, rest...);
+    }
 };
 
 
+// 所有类型是否都可以平凡析构
 template<typename... Types>
-class Variant
-{
-    using VarHelper = VariantHelper<Types...>;
+struct AllTriviallyDestructible;
+
+template<>
+struct AllTriviallyDestructible<> : std::true_type {};
 
+template<typename First, typename... Types>
+struct AllTriviallyDestructible<First, Types...> : std::integral_constant<bool,
+    std::is_trivially_destructible<First>::value && AllTriviallyDestructible<Types...>::value> {};
+
+
+// Variant的存储：数据在前，1字节的类型索引在后，没有虚函数表指针
+// 所有类型都可以平凡析构时，存储也可以平凡析构（不声明析构函数）
+template<bool TrivialDestroy, typename... Types>
+struct VariantStorage
+{
     enum
     {
         DataSize = IntegerMax<sizeof(Types)...>::value, // 数据常量，表示最大的数据长度
@@ -144,69 +225,131 @@ class Variant
     };
     using Data = typename std::aligned_storage<DataSize, AlignSize>::type;
 
+    explicit VariantStorage(uint8_t index) : index_(index) {}
+
+    Data    data_;
+    uint8_t index_;     // 当前值在Types中的索引
+};
+
+template<typename... Types>
+struct VariantStorage<false, Types...>
+{
+    enum
+    {
+        DataSize = IntegerMax<sizeof(Types)...>::value,
+        AlignSize = MaxAlign<Types...>::value
+    };
+    using Data = typename std::aligned_storage<DataSize, AlignSize>::type;
+
+    explicit VariantStorage(uint8_t index) : index_(index) {}
+
+    ~VariantStorage()
+    {
+        if (index_ != 0xFF) {
+            VariantHelper<false, Types...>::Destroy(index_, &data_);
+        }
+    }
+
+    Data    data_;
+    uint8_t index_;
+};
+
+
+template<typename... Types>
+class Variant : private VariantStorage<AllTriviallyDestructible<Types...>::value, Types...>
+{
+    static_assert(sizeof...(Types) > 0 && sizeof...(Types) < 255, "variant types count out of range");
+
+    using Base = VariantStorage<AllTriviallyDestructible<Types...>::value, Types...>;
+    using Data = typename Base::Data;
+    using VarHelper = VariantHelper<AllTrivial<Types...>::value, Types...>;
+    using Base::data_;
+    using Base::index_;
+
+    template<typename R>
+    friend struct VariantVisit;
+
 public:
     template<int index>
     using IndexType = typename IndexType<index, Types...>::DataType;
 
-    Variant(void) : typeindex_(typeid(void)) {}
+    // 未保存任何值时的索引
+    static const uint8_t npos = 0xFF;
 
-    Variant(Variant<Types...>&& othre) : typeindex_(othre.typeindex_)
-    {
-        VarHelper::Move(othre.typeindex_, &othre.data_, &data_);
-    }
+    Variant(void) : Base(npos) {}
 
-    Variant(const Variant<Types...>& othre) : typeindex_(othre.typeindex_)
+    Variant(Variant<Types...>&& othre) : Base(othre.index_)
     {
-        VarHelper::Copy(othre.typeindex_, &othre.data_, &data_);
+        if (!othre.Empty()) {
+            VarHelper::Move(othre.index_, &othre.data_, &data_);
+        }
     }
 
-    virtual ~Variant()
+    Variant(const Variant<Types...>& othre) : Base(othre.index_)
     {
-        VarHelper::Destroy(typeindex_, &data_);
+        if (!othre.Empty()) {
+            VarHelper::Copy(othre.index_, &othre.data_, &data_);
+        }
     }
 
     Variant& operator=(const Variant& othre)
     {
-        VarHelper::Copy(othre.typeindex_, &othre.data_, &data_);
-        typeindex_ = othre.typeindex_;
+        if (this != &othre) {
+            Destroy();
+            if (!othre.Empty()) {
+                VarHelper::Copy(othre.index_, &othre.data_, &data_);
+            }
+            index_ = othre.index_;
+        }
         return *this;
     }
 
     Variant& operator=(Variant&& othre)
     {
-        VarHelper::Move(othre.typeindex_, &othre.data_, &data_);
-        typeindex_ = othre.typeindex_;
+        if (this != &othre) {
+            Destroy();
+            if (!othre.Empty()) {
+                VarHelper::Move(othre.index_, &othre.data_, &data_);
+            }
+            index_ = othre.index_;
+        }
         return *this;
     }
 
-    // remove_reference若类型 T 为引用类型，则提供成员 typedef type ，其为 T 所引用的类型。否则 type 为 T
+    // std::decay去掉引用和cv修饰符，const T&也可以构造
     template<class T, class = typename std::enable_if<
-        Contains<typename std::remove_reference<T>::type, Types...>::value>::type>
-    Variant(T&& value) : typeindex_(typeid(void))
+        Contains<typename std::decay<T>::type, Types...>::value>::type>
+    Variant(T&& value) : Base(npos)
     {
-        VarHelper::Destroy(typeindex_, &data_);
-        using U = typename std::remove_reference<T>::type;
+        using U = typename std::decay<T>::type;
         new (&data_) U(std::forward<T>(value));
-        typeindex_ = std::type_index(typeid(T));
+        index_ = IndexOf<U, Types...>::value;
     }
 
     template<typename T>
     bool Is() const
     {
-        return (typeindex_ == std::type_index(typeid(T)));
+        return index_ == IndexOf<T, Types...>::value;
     }
 
     bool Empty() const
     {
-        return (typeindex_ == std::type_index(typeid(void)));
+        return index_ == npos;
+    }
+
+    // 当前值的类型索引，为空时返回npos
+    uint8_t Index() const
+    {
+        return index_;
     }
 
     std::type_index Type() const
     {
-        return typeindex_;
+        static const std::type_info* types[] = { &typeid(Types)... };
+        return Empty() ? std::type_index(typeid(void)) : std::type_index(*types[index_]);
     }
 
-    // maybe throw std::bad_cast
+    // maybe throw std::logic_error
     template<typename T>
     typename std::decay<T>::type& Get()     // std::decay退化类型的修饰，去掉引用、const修饰符
     {
@@ -214,7 +357,7 @@ public:
         if (!Is<U>()) {
             std::string errmsg = typeid(U).name();
             errmsg += " is not define, current type is ";
-            errmsg += typeindex_.name();
+            errmsg += Type().name();
             throw std::logic_error(errmsg);
         }
         return *reinterpret_cast<U*>(&data_);
@@ -223,27 +366,102 @@ public:
     template<typename T>
     int GetIndexOf() const
     {
-        // std::cout << "sizeof...(Types)=" << sizeof...(Types) << std::endl;
-        // std::cout << "GetLeftSize<T, Types...>::value=" << GetLeftSize<T, Types...>::value << std::endl;
-        // std::cout << sizeof...(Types) - GetLeftSize<T, Types...>::value - 1 << std::endl;
         return IndexOf<T, Types...>::value;
     }
 
+    // 使用访问者访问当前的值，访问者需要能处理所有类型
+    template<typename Visitor>
+    auto Visit(Visitor&& visitor)
+        -> decltype(visitor(std::declval<IndexType<0>&>()))
+    {
+        using R = decltype(visitor(std::declval<IndexType<0>&>()));
+        return Dispatch<R>(visitor);
+    }
+
+    template<typename Visitor>
+    auto Visit(Visitor&& visitor) const
+        -> decltype(visitor(std::declval<const IndexType<0>&>()))
+    {
+        using R = decltype(visitor(std::declval<const IndexType<0>&>()));
+        return Dispatch<R>(visitor);
+    }
+
     bool operator==(const Variant& rhs) const
     {
-        return (typeindex_ == rhs.typeindex_);
+        return (index_ == rhs.index_);
     }
 
     bool operator<(const Variant& rhs) const
     {
-        return (typeindex_ < rhs.typeindex_);
+        return (index_ < rhs.index_);
     }
 
 private:
-    Data data_;
-    std::type_index typeindex_;
+    void Destroy()
+    {
+        if (!Empty()) {
+            VarHelper::Destroy(index_, &data_);
+            index_ = npos;
+        }
+    }
+
+    // 根据索引查表，解出当前值后继续访问剩余的Variant
+    template<typename R, typename Visitor, typename... Rest>
+    R Dispatch(Visitor& visitor, Rest&... rest)
+    {
+        using Func = R (*)(Visitor&, void*, Rest&...);
+        static constexpr Func table[] = { &Invoke<R, Types, Visitor, Rest...>... };
+        if (Empty()) {
+            throw std::logic_error("visit an empty variant");
+        }
+        return table[index_](visitor, &data_, rest...);
+    }
+
+    template<typename R, typename Visitor, typename... Rest>
+    R Dispatch(Visitor& visitor, Rest&... rest) const
+    {
+        using Func = R (*)(Visitor&, void*, Rest&...);
+        static constexpr Func table[] = { &Invoke<R, const Types, Visitor, Rest...>... };
+        if (Empty()) {
+            throw std::logic_error("visit an empty variant");
+        }
+        return table[index_](visitor, const_cast<Data*>(&data_), rest...);
+    }
+
+    template<typename R, typename T, typename Visitor, typename... Rest>
+    static R Invoke(Visitor& visitor, void* data, Rest&... rest)
+    {
+        VariantBoundVisitor<R, Visitor, T> bound{ visitor, *reinterpret_cast<T*>(data) };
+        return VariantVisit<R>::Apply(bound, rest...);
+    }
 };
 
+template<typename... Types>
+const uint8_t Variant<Types...>::npos;
+
+
+// 获取Variant第一个类型的引用，用于推导访问者的返回值
+template<typename V>
+struct VariantFront
+{
+    using type = typename V::template IndexType<0>&;
+};
+
+template<typename V>
+struct VariantFront<const V>
+{
+    using type = const typename V::template IndexType<0>&;
+};
+
+// 访问一个或多个Variant，visitor(v1的值, v2的值, ...)，每个Variant的分派都是一次查表
+template<typename Visitor, typename... Variants>
+auto Visit(Visitor&& visitor, Variants&... variants)
+    -> decltype(visitor(std::declval<typename VariantFront<Variants>::type>()...))
+{
+    using R = decltype(visitor(std::declval<typename VariantFront<Variants>::type>()...));
+    return VariantVisit<R>::Apply(visitor, variants...);
+}
+
 } // namespace util
 
 #endif // UTIL_VARIANT_H_